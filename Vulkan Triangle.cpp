@@ -7,6 +7,9 @@
 #include <fstream>
 #include <filesystem>
 #include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
 #include <GLFW/glfw3.h>
 #include <GLFW/glfw3native.h>
 #include <glm/glm.hpp>
@@ -16,61 +19,187 @@
 
 #include "volk.h"
 #include "vulkan_helper.h"
+#include "frame_capture.h"
+#include "dynamic_resolution.h"
+#include "memory_tracker.h"
+#include "trace.h"
+#include "debug_message_sink.h"
+#include "particle_animation.h"
+#include "post_process.h"
+#include "scene.h"
+#include "mesh_lod.h"
+#include "geometry_pool.h"
+#include "task_graph.h"
+#include "texture.h"
+#include "pipeline_registry.h"
+#include "command_stream.h"
+#include "perf_hud.h"
 
 class VulkanTriangle {
+public:
+    struct Options {
+        uint32_t capture_interval = 0;
+        FrameCapture::Format capture_format = FrameCapture::PNG;
+        uint32_t capture_ring_size = 4;
+        bool dynamic_resolution = true;
+        float target_gpu_msec = 14.0f;
+        float min_render_scale = 0.5f;
+        float max_render_scale = 1.0f;
+        std::string memory_json_path = "memory.json";
+        std::string trace_path;
+        uint32_t window_count = 1;
+        uint32_t particle_count = 0;
+        bool particle_benchmark = false;
+        PostProcess::Mode post_process = PostProcess::NONE;
+        uint32_t scene_object_count = 0;
+        uint32_t cull_thread_count = std::max(1u, std::thread::hardware_concurrency()) - 1;
+        uint32_t mesh_subdivisions = 0;
+        float lod_error_pixels = 1.0f;
+        bool parallel_startup = true;
+        std::string pipeline_cache_path = "pipeline_cache.bin";
+        std::string texture_path;
+        uint32_t texture_budget_mib = 64;
+        uint32_t texture_upload_kib = 256;
+        uint32_t material_count = 1;
+        uint32_t mesh_count = 1;
+        uint32_t mesh_reload_interval = 0;
+        std::string stream_capture_path;
+        uint32_t stream_capture_frame = 100;
+        bool hud = false;
+        float hud_budget_msec = 0.25f;
+    };
+
 private:
+    // with post-processing there is one per frame in flight, so that a frame's scene can be rendered while
+    // the compute queue still reads the previous one; rendered_extent is the area the scene was drawn into
+    typedef struct RenderTarget {
+        VkImage image = VK_NULL_HANDLE;
+        VkDeviceMemory memory;
+        VkImageView view;
+        VkFramebuffer framebuffer;
+        VkImage post_image = VK_NULL_HANDLE;
+        VkDeviceMemory post_memory;
+        VkImageView post_view;
+        VkExtent2D rendered_extent = { 0,0 };
+    } RenderTarget;
+
+    // one per window: everything tied to a surface, while device, pipeline, geometry and command buffers are shared
+    typedef struct Output {
+        VkExtent2D window_size = { 800,800 };
+        GLFWwindow* window = nullptr;
+        VkSurfaceKHR surface = VK_NULL_HANDLE;
+
+        VkSwapchainKHR old_swapchain = VK_NULL_HANDLE;
+        VkSwapchainCreateInfoKHR swapchain_create_info;
+        VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+        uint32_t swapchain_images_count;
+        std::vector<VkImage> swapchain_images;
+        std::vector<VkSemaphore> acquire_semaphores;
+        uint32_t image_index = 0;
+        bool is_acquired = false;
+
+        VkExtent2D render_target_extent;
+        std::vector<RenderTarget> render_targets;
+        VkExtent2D render_extent;
+    } Output;
+
 	void create_instance();
     void setup_debug_callback();
     void create_window();
     void create_surface();
     void create_logical_device();
-    void create_swapchain();
+    void create_swapchain(Output& output);
     void create_command_pool();
     void allocate_command_buffers();
+    void import_mesh();
+    std::vector<glm::vec3> get_mesh_variant(uint32_t variant) const;
+    void create_geometry_pool();
+    void reload_meshes();
     void create_host_buffers();
     void create_device_buffers();
     void create_descriptor_pool();
     void allocate_descriptor_sets();
     void create_renderpass();
-    void create_framebuffers();
+    void create_render_target(Output& output);
+    void destroy_render_target(Output& output);
+    void create_dynamic_resolution();
+    void load_shaders();
+    void load_pipeline_cache();
+    void create_pipeline_cache();
+    void save_pipeline_cache();
+    void create_pipeline_registry();
     void create_pipeline();
     void upload_input_data();
-    void record_command_buffers();
+    void create_query_pools();
+    void calibrate_gpu_clock();
+    int64_t measure_clock_offset(VkQueue timed_queue, VkCommandBuffer command_buffer, uint32_t valid_bits);
+    void benchmark_particle_animation();
+    void create_particle_animation();
+    void create_post_process();
+    void create_scene();
+    void create_texture();
+    void create_instance_buffer();
+    void write_instances(uint32_t frame);
+    void create_indirect_buffer();
+    void write_draw_commands(uint32_t frame);
+    void record_command_buffer(uint32_t frame);
+    void record_blit(VkCommandBuffer command_buffer, uint32_t frame);
+    void submit_post_process(uint32_t frame);
+    bool submit_and_present(uint32_t frame, bool is_post_processed);
     void create_semaphores();
+    void read_gpu_frame_time(uint32_t frame);
+    void read_query_statistics(uint32_t frame);
+    void create_frame_capture();
+    void create_perf_hud();
+    void record_perf_hud(VkCommandBuffer command_buffer, uint32_t frame, PerfHud::Counters counters);
+    void end_stream_capture(uint32_t frame);
+    bool is_any_window_closed();
     void frame_loop();
 
-    void on_window_resize();
+    void on_window_resize(Output& output);
+
+    Options options;
+    std::vector<Output> outputs;
 
     VkInstance instance;
+    bool is_properties2_extension_enabled = false;
     VkDebugReportCallbackEXT debug_report_callback;
-
-    VkExtent2D window_size = { 800,800 };
-    GLFWwindow* window;
-    VkSurfaceKHR surface;
+    std::unique_ptr<DebugMessageSink> debug_message_sink;
 
     VkPhysicalDevice physical_device;
     VkPhysicalDeviceMemoryProperties physical_device_memory_properties;
     uint32_t queue_family_index;
+    float timestamp_period;
+    uint32_t timestamp_valid_bits;
+    bool is_pipeline_statistics_supported;
+    bool is_occlusion_query_precise_supported;
+    bool is_multi_draw_indirect_supported;
     VkDevice device;
     VkQueue queue;
-
-    VkSwapchainKHR old_swapchain = VK_NULL_HANDLE;
-    VkSwapchainCreateInfoKHR swapchain_create_info;
-    VkSwapchainKHR swapchain;
-    uint32_t swapchain_images_count;
-    std::vector<VkImage> swapchain_images;
-
+    // a family with compute but no graphics when available, otherwise the graphics queue itself
+    uint32_t compute_queue_family_index;
+    uint32_t compute_timestamp_valid_bits;
+    VkQueue compute_queue;
+    std::unique_ptr<MemoryTracker> memory_tracker;
+    bool memory_key_was_pressed = false;
+
+    uint32_t frames_in_flight = 2;
     VkCommandPool command_pool;
     std::vector<VkCommandBuffer> command_buffers;
 
-    VkBuffer host_vertex_buffer;
+    // contents of the uniform buffer, texture_parameters.x is the finest texture level streamed in so far
+    struct UniformData {
+        glm::mat4 m_matrix;
+        glm::vec4 texture_parameters;
+    };
+    // one region per frame in flight, the copy into the device buffer runs when the frame executes
     VkBuffer host_m_matrix_buffer;
-    VkMemoryRequirements host_memory_requirements[2];
+    VkDeviceSize uniform_region_size;
+    VkMemoryRequirements host_memory_requirements;
     VkDeviceMemory host_memory;
     void* host_data_pointer;
-    VkBuffer device_vertex_buffer;
     VkBuffer device_m_matrix_buffer;
-    VkMemoryRequirements device_memory_requirements[2];
+    VkMemoryRequirements device_memory_requirements;
     VkDeviceMemory device_memory;
 
     VkDescriptorPool descriptor_pool;
@@ -78,14 +207,145 @@ private:
     VkDescriptorSet descriptor_set;
 
     VkRenderPass render_pass;
-    std::vector<VkFramebuffer> framebuffers;
-    std::vector<VkImageView> swapchain_images_views;
-
+    VkFormat render_target_format;
+    // layout the scene pass leaves the render target in for the blit or the post-process
+    VkImageLayout render_target_layout;
+    VkFilter blit_filter;
+
+    // read from disk while the instance, windows and device are created
+    std::vector<char> vertex_shader_code;
+    std::vector<char> fragment_shader_code;
+    std::vector<char> pipeline_cache_data;
+    VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+
+    // pipelines, their layouts and the scene's descriptor set layout are owned by the registry
+    std::unique_ptr<PipelineRegistry> pipeline_registry;
+    std::vector<VkDescriptorSetLayoutBinding> scene_bindings;
+    uint32_t scene_layout;
     VkPipelineLayout pipeline_layout;
-    VkPipeline pipeline;
+    static constexpr uint32_t material_variants = 6;
+    std::vector<uint32_t> material_pipelines;
+
+    std::vector<VkSemaphore> render_finished_semaphores;
+    std::vector<VkFence> frame_fences;
+
+    // frame N is rendered, post-processed on the compute queue and presented during frame N+1,
+    // so its post-processing overlaps the scene of frame N+1 on the graphics queue
+    std::unique_ptr<PostProcess> post_process;
+    std::vector<VkCommandBuffer> present_command_buffers;
+    std::vector<VkSemaphore> scene_finished_semaphores;
+    std::vector<VkSemaphore> post_finished_semaphores;
+    std::vector<bool> is_post_pending;
+
+    // the post-process pair is written on the compute queue
+    typedef enum Timestamps {
+        TIMESTAMP_FRAME_BEGIN,
+        TIMESTAMP_ANIMATION_END,
+        TIMESTAMP_SCENE_END,
+        TIMESTAMP_HUD_END,
+        TIMESTAMP_BLIT_BEGIN,
+        TIMESTAMP_FRAME_END,
+        TIMESTAMP_POST_BEGIN,
+        TIMESTAMP_POST_END,
+        TIMESTAMPS_PER_FRAME
+    } Timestamps;
+    VkQueryPool timestamp_query_pool = VK_NULL_HANDLE;
+    int64_t gpu_clock_offset_ns = 0;
+    // the compute queue may run on a family with a clock of its own, it is aligned separately
+    int64_t compute_clock_offset_ns = 0;
+    double gpu_scene_msec = 0.0;
+    double gpu_animation_msec = 0.0;
+    double gpu_post_msec = 0.0;
+    double gpu_hud_msec = 0.0;
+    double total_post_msec = 0.0;
+    double total_post_overlap_msec = 0.0;
+
+    // per frame counters of the scene pass, read back without waiting through availability results
+    typedef struct QueryStatistics {
+        uint64_t vertex_invocations;
+        uint64_t clipping_invocations;
+        uint64_t clipping_primitives;
+        uint64_t fragment_invocations;
+        uint64_t samples_passed;
+        double overdraw_ratio;
+        double primitives_per_second;
+    } QueryStatistics;
+    VkQueryPool pipeline_statistics_query_pool = VK_NULL_HANDLE;
+    VkQueryPool occlusion_query_pool = VK_NULL_HANDLE;
+    QueryStatistics query_statistics = {};
+    uint64_t unavailable_query_results = 0;
+    double gpu_frame_msec = 0.0;
+    std::unique_ptr<DynamicResolution> dynamic_resolution;
+
+    std::unique_ptr<ParticleAnimation> particle_animation;
+    std::unique_ptr<Texture> texture;
+
+    // the visible objects of the scene are drawn as instances of the triangle, XYZ offset - scale per instance,
+    // written by the CPU into one region per frame in flight; without a scene there is a single identity instance
+    std::unique_ptr<Scene> scene;
+    VkBuffer instance_buffer;
+    VkDeviceMemory instance_memory;
+    void* instance_data_pointer;
+    VkDeviceSize instance_region_size;
+    uint32_t instance_count = 1;
+    double total_cull_msec = 0.0;
+    glm::vec3 camera_position = glm::vec3(0.0f);
+    float camera_fov = glm::radians(60.0f);
+
+    // every mesh variant is suballocated from the geometry pool with the indices of all its LODs; instances are grouped
+    // by material pipeline, mesh and LOD when written, so each batch is one indexed draw over a contiguous range of
+    // instances. Batch b uses batch_pipelines[b / (mesh count * LOD count)], mesh (b / LOD count) % mesh count and
+    // LOD b % LOD count; objects get material object % material count and mesh object % mesh count
+    std::unique_ptr<MeshLod> mesh_lod;
+    std::unique_ptr<GeometryPool> geometry_pool;
+    // pool mesh of every variant, UINT32_MAX while the variant is unloaded
+    std::vector<uint32_t> mesh_ids;
+    uint32_t unloaded_mesh = UINT32_MAX;
+    uint32_t next_unloaded_mesh = 0;
+    std::vector<uint32_t> batch_pipelines;
+    std::vector<uint32_t> material_batches;
+    std::vector<uint32_t> batch_instance_counts;
+    std::vector<uint32_t> batch_first_instances;
+    std::vector<uint32_t> selected_batches;
+    uint64_t total_lod_triangles = 0;
+    uint64_t total_full_triangles = 0;
+
+    // the batches of a pipeline are one vkCmdDrawIndexedIndirect over adjacent commands, written into one region per
+    // frame in flight; the CPU copy is drawn from one command at a time without multiDrawIndirect
+    VkBuffer indirect_buffer;
+    VkDeviceMemory indirect_memory;
+    void* indirect_data_pointer;
+    VkDeviceSize indirect_region_size;
+    std::vector<VkDrawIndexedIndirectCommand> draw_commands;
+    std::vector<uint32_t> pipeline_first_draws;
+    std::vector<uint32_t> pipeline_draw_counts;
+    // bind calls are descriptor set, vertex buffer, index buffer and pipeline binds, draws count indirect commands
+    uint64_t total_bind_calls = 0;
+    uint64_t total_draw_calls = 0;
+    uint64_t total_draws = 0;
+    // triangles of one output's scene pass, written with the instances
+    uint64_t frame_triangles = 0;
+
+    std::unique_ptr<FrameCapture> frame_capture;
+    bool capture_key_was_pressed = false;
+
+    // drawn over the first output's scene and fed from the counters above; F10 hides it, which also saves its cost
+    std::unique_ptr<PerfHud> perf_hud;
+    bool is_hud_visible = true;
+    bool hud_key_was_pressed = false;
+    std::chrono::steady_clock::time_point last_frame_begin;
+    double cpu_frame_msec = 0.0;
+    double cpu_wait_msec = 0.0;
+    double cpu_record_msec = 0.0;
+
+    // one frame's scene commands and the resources they use, written for the replay tool; the frame is taken once
+    // the texture has streamed in and every mesh variant is loaded, and never with particles, whose vertices only exist on the GPU
+    std::unique_ptr<CommandStreamWriter> stream_capture;
+    bool is_stream_captured = false;
 
-    std::vector<VkSemaphore> semaphores;
     glm::mat4 mv_matrix;
+    std::chrono::steady_clock::time_point startup_begin;
+    bool is_first_frame_presented = false;
     double start_time;
     uint32_t rendered_frames = 0;
     uint32_t modulus_result = 0;
@@ -98,7 +358,7 @@ private:
     std::vector<glm::vec3> input_data = { {-0.2f,-0.2f,0.5f},{0.5f,0.8f,0.72f},{0.2f,-0.2f,0.5f},{0.0f,0.3f,0.1f},{0.0f,0.2f,0.5f},{0.4f,0.1f,0.8f} };
 
 public:
-	VulkanTriangle();
+	VulkanTriangle(const Options& options);
     void start_main_loop();
     ~VulkanTriangle();
 
@@ -115,7 +375,8 @@ public:
         MEMORY_ALLOCATION_FAILED = -10,
         SHADER_MODULE_CREATION_FAILED = -11,
         ACQUIRE_NEXT_IMAGE_FAILED = -12,
-        QUEUE_PRESENT_FAILED = -13
+        QUEUE_PRESENT_FAILED = -13,
+        IMAGE_CREATION_FAILED = -14
     } Errors;
 };
 
@@ -141,6 +402,16 @@ void VulkanTriangle::create_instance() {
     std::vector<const char*> desired_instance_level_extensions = { "VK_KHR_surface","VK_KHR_win32_surface","VK_EXT_debug_report" };
 #endif
 
+    // needed to query VK_EXT_memory_budget, optional
+    uint32_t instance_extensions_count;
+    vkEnumerateInstanceExtensionProperties(nullptr, &instance_extensions_count, nullptr);
+    std::vector<VkExtensionProperties> instance_extensions(instance_extensions_count);
+    vkEnumerateInstanceExtensionProperties(nullptr, &instance_extensions_count, instance_extensions.data());
+    if (vulkan_helper::is_extension_supported(instance_extensions, "VK_KHR_get_physical_device_properties2")) {
+        desired_instance_level_extensions.push_back("VK_KHR_get_physical_device_properties2");
+        is_properties2_extension_enabled = true;
+    }
+
     VkInstanceCreateInfo instance_create_info = {
         VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
         nullptr,
@@ -161,30 +432,41 @@ void VulkanTriangle::create_instance() {
 
 void VulkanTriangle::create_window() {
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    window = glfwCreateWindow(window_size.width, window_size.height, "Vulkan", nullptr, nullptr);
-    if (window == NULL) { throw GLFW_WINDOW_CREATION_FAILED; }
+    outputs.resize(options.window_count);
+    for (size_t i = 0; i < outputs.size(); i++) {
+        std::string title = outputs.size() == 1 ? "Vulkan" : "Vulkan - output " + std::to_string(i);
+        outputs[i].window = glfwCreateWindow(outputs[i].window_size.width, outputs[i].window_size.height, title.c_str(), nullptr, nullptr);
+        if (outputs[i].window == NULL) { throw GLFW_WINDOW_CREATION_FAILED; }
+        // cascade the windows so they do not open on top of each other
+        int x, y;
+        glfwGetWindowPos(outputs[i].window, &x, &y);
+        glfwSetWindowPos(outputs[i].window, x + 40 * static_cast<int>(i), y + 40 * static_cast<int>(i));
+    }
 }
 
 void VulkanTriangle::setup_debug_callback() {
+    debug_message_sink = std::make_unique<DebugMessageSink>();
     VkDebugReportCallbackCreateInfoEXT debug_report_callback_create_info_EXT = {
         VK_STRUCTURE_TYPE_DEBUG_REPORT_CALLBACK_CREATE_INFO_EXT,
         nullptr,
         VK_DEBUG_REPORT_ERROR_BIT_EXT | VK_DEBUG_REPORT_WARNING_BIT_EXT,
         vulkan_helper::debug_callback,
-        nullptr
+        debug_message_sink.get()
     };
     vkCreateDebugReportCallbackEXT(instance, &debug_report_callback_create_info_EXT, nullptr, &debug_report_callback);
 }
 
 void VulkanTriangle::create_surface() {
-    VkWin32SurfaceCreateInfoKHR surface_create_info = {
-        VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR,
-        nullptr,
-        0,
-        GetModuleHandle(NULL),
-        glfwGetWin32Window(window)
-    };
-    if (vkCreateWin32SurfaceKHR(instance, &surface_create_info, nullptr, &surface) != VK_SUCCESS) { throw SURFACE_CREATION_FAILED; }
+    for (auto& output : outputs) {
+        VkWin32SurfaceCreateInfoKHR surface_create_info = {
+            VK_STRUCTURE_TYPE_WIN32_SURFACE_CREATE_INFO_KHR,
+            nullptr,
+            0,
+            GetModuleHandle(NULL),
+            glfwGetWin32Window(output.window)
+        };
+        if (vkCreateWin32SurfaceKHR(instance, &surface_create_info, nullptr, &output.surface) != VK_SUCCESS) { throw SURFACE_CREATION_FAILED; }
+    }
 }
 
 void VulkanTriangle::create_logical_device() {
@@ -211,13 +493,33 @@ void VulkanTriangle::create_logical_device() {
     std::vector<VkQueueFamilyProperties> queue_families_properties(families_count);
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &families_count, queue_families_properties.data());
 
-    queue_family_index = -1;
-    VkBool32 does_queue_family_support_surface = VK_FALSE;
-    while (does_queue_family_support_surface == VK_FALSE) {
-        queue_family_index++;
-        vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, queue_family_index, surface, &does_queue_family_support_surface);
+    // all swapchains are presented with one vkQueuePresentKHR, so the queue must support every surface
+    queue_family_index = families_count;
+    for (uint32_t i = 0; i < families_count && queue_family_index == families_count; i++) {
+        VkBool32 does_queue_family_support_surfaces = VK_TRUE;
+        for (auto& output : outputs) {
+            VkBool32 does_queue_family_support_surface = VK_FALSE;
+            vkGetPhysicalDeviceSurfaceSupportKHR(physical_device, i, output.surface, &does_queue_family_support_surface);
+            does_queue_family_support_surfaces &= does_queue_family_support_surface;
+        }
+        if (does_queue_family_support_surfaces == VK_TRUE) { queue_family_index = i; }
     }
+    if (queue_family_index == families_count) { throw DEVICE_CREATION_FAILED; }
     // TODO: check for other properties we require
+    timestamp_period = devices_properties[selected_device_number].limits.timestampPeriod;
+    timestamp_valid_bits = queue_families_properties[queue_family_index].timestampValidBits;
+
+    // post-processing prefers a compute only family, which maps to the asynchronous compute engines
+    compute_queue_family_index = queue_family_index;
+    if (options.post_process != PostProcess::NONE) {
+        for (uint32_t i = 0; i < families_count; i++) {
+            if (i != queue_family_index && (queue_families_properties[i].queueFlags & VK_QUEUE_COMPUTE_BIT) && !(queue_families_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT)) {
+                compute_queue_family_index = i;
+                break;
+            }
+        }
+    }
+    compute_timestamp_valid_bits = queue_families_properties[compute_queue_family_index].timestampValidBits;
 
     //logical device creation
     std::vector<float> queue_priorities = { 1.0f };
@@ -230,10 +532,39 @@ void VulkanTriangle::create_logical_device() {
         static_cast<uint32_t>(queue_priorities.size()),
         queue_priorities.data()
         });
+    if (compute_queue_family_index != queue_family_index) {
+        queue_create_info.push_back({
+            VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            nullptr,
+            0,
+            compute_queue_family_index,
+            static_cast<uint32_t>(queue_priorities.size()),
+            queue_priorities.data()
+            });
+    }
+
+    is_pipeline_statistics_supported = devices_features[selected_device_number].pipelineStatisticsQuery;
+    is_occlusion_query_precise_supported = devices_features[selected_device_number].occlusionQueryPrecise;
+    // a multi-draw needs both, to draw more than one command and to start each at its own instance
+    is_multi_draw_indirect_supported = devices_features[selected_device_number].multiDrawIndirect && devices_features[selected_device_number].drawIndirectFirstInstance;
 
     std::vector<const char*> desired_device_level_extensions = { "VK_KHR_swapchain" };
+    uint32_t device_extensions_count;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &device_extensions_count, nullptr);
+    std::vector<VkExtensionProperties> device_extensions(device_extensions_count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &device_extensions_count, device_extensions.data());
+    bool is_memory_budget_extension_enabled = is_properties2_extension_enabled && vulkan_helper::is_extension_supported(device_extensions, "VK_EXT_memory_budget");
+    if (is_memory_budget_extension_enabled) {
+        desired_device_level_extensions.push_back("VK_EXT_memory_budget");
+    }
     VkPhysicalDeviceFeatures selected_device_features = { 0 };
     // TODO: enable here features we need
+    selected_device_features.pipelineStatisticsQuery = is_pipeline_statistics_supported;
+    selected_device_features.occlusionQueryPrecise = is_occlusion_query_precise_supported;
+    selected_device_features.textureCompressionBC = devices_features[selected_device_number].textureCompressionBC;
+    selected_device_features.textureCompressionASTC_LDR = devices_features[selected_device_number].textureCompressionASTC_LDR;
+    selected_device_features.multiDrawIndirect = is_multi_draw_indirect_supported;
+    selected_device_features.drawIndirectFirstInstance = is_multi_draw_indirect_supported;
     VkDeviceCreateInfo device_create_info = {
         VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
         nullptr,
@@ -249,36 +580,45 @@ void VulkanTriangle::create_logical_device() {
 
     if (vkCreateDevice(physical_device, &device_create_info, nullptr, &device)) { throw DEVICE_CREATION_FAILED; }
     vkGetDeviceQueue(device, queue_family_index, 0, &queue);
+    vkGetDeviceQueue(device, compute_queue_family_index, 0, &compute_queue);
     volkLoadDevice(device);
+    memory_tracker = std::make_unique<MemoryTracker>(physical_device, is_memory_budget_extension_enabled);
 }
 
-void VulkanTriangle::create_swapchain() {
+void VulkanTriangle::create_swapchain(Output& output) {
+    TRACE_SCOPE("create_swapchain");
 
     uint32_t presentation_modes_number;
-    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &presentation_modes_number, nullptr);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, output.surface, &presentation_modes_number, nullptr);
     std::vector<VkPresentModeKHR> presentation_modes(presentation_modes_number);
-    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &presentation_modes_number, presentation_modes.data());
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, output.surface, &presentation_modes_number, presentation_modes.data());
     VkPresentModeKHR selected_present_mode = vulkan_helper::select_presentation_mode(presentation_modes, VK_PRESENT_MODE_MAILBOX_KHR);
 
     VkSurfaceCapabilitiesKHR surface_capabilities;
-    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &surface_capabilities);
+    vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, output.surface, &surface_capabilities);
 
     uint32_t number_of_images = vulkan_helper::select_number_of_images(surface_capabilities);
-    VkExtent2D size_of_images = vulkan_helper::select_size_of_images(surface_capabilities, window_size);
-    VkImageUsageFlags image_usage = vulkan_helper::select_image_usage(surface_capabilities, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT);
+    VkExtent2D size_of_images = vulkan_helper::select_size_of_images(surface_capabilities, output.window_size);
+    // the frame is blitted from the render target, so transfer destination is required;
+    // transfer source is needed to read back frames for capture and is dropped if unsupported
+    VkImageUsageFlags image_usage = vulkan_helper::select_image_usage(surface_capabilities, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+    if (!(image_usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+        image_usage = vulkan_helper::select_image_usage(surface_capabilities, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+        if (!(image_usage & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) { throw SWAPCHAIN_CREATION_FAILED; }
+    }
     VkSurfaceTransformFlagBitsKHR surface_transform = vulkan_helper::select_surface_transform(surface_capabilities, VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR);
 
     uint32_t formats_count = 0;
-    vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &formats_count, nullptr);
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, output.surface, &formats_count, nullptr);
     std::vector<VkSurfaceFormatKHR> surface_formats(formats_count);
-    vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &formats_count, surface_formats.data());
+    vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, output.surface, &formats_count, surface_formats.data());
     VkSurfaceFormatKHR surface_format = vulkan_helper::select_surface_format(surface_formats, { VK_FORMAT_B8G8R8A8_UNORM ,VK_COLOR_SPACE_SRGB_NONLINEAR_KHR });
 
-    swapchain_create_info = {
+    output.swapchain_create_info = {
         VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
         nullptr,
         0,
-        surface,
+        output.surface,
         number_of_images,
         surface_format.format,
         surface_format.colorSpace,
@@ -292,21 +632,21 @@ void VulkanTriangle::create_swapchain() {
         VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
         selected_present_mode,
         VK_TRUE,
-        old_swapchain
+        output.old_swapchain
     };
 
-    if (vkCreateSwapchainKHR(device, &swapchain_create_info, nullptr, &swapchain) != VK_SUCCESS) { throw SWAPCHAIN_CREATION_FAILED; }
+    if (vkCreateSwapchainKHR(device, &output.swapchain_create_info, nullptr, &output.swapchain) != VK_SUCCESS) { throw SWAPCHAIN_CREATION_FAILED; }
     
-    vkGetSwapchainImagesKHR(device, swapchain, &swapchain_images_count, nullptr);
-    swapchain_images.resize(swapchain_images_count);
-    vkGetSwapchainImagesKHR(device, swapchain, &swapchain_images_count, swapchain_images.data());
+    vkGetSwapchainImagesKHR(device, output.swapchain, &output.swapchain_images_count, nullptr);
+    output.swapchain_images.resize(output.swapchain_images_count);
+    vkGetSwapchainImagesKHR(device, output.swapchain, &output.swapchain_images_count, output.swapchain_images.data());
 }
 
 void VulkanTriangle::create_command_pool() {
     VkCommandPoolCreateInfo command_pool_create_info = {
         VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         nullptr,
-        0,
+        VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
         queue_family_index
     };
     if (vkCreateCommandPool(device, &command_pool_create_info, nullptr, &command_pool)) { throw COMMAND_POOL_CREATION_FAILED; }
@@ -318,46 +658,101 @@ void VulkanTriangle::allocate_command_buffers() {
         nullptr,
         command_pool,
         VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        swapchain_images_count
+        frames_in_flight
     };
-    command_buffers.resize(swapchain_images_count);
+    command_buffers.resize(frames_in_flight);
     if (vkAllocateCommandBuffers(device, &command_buffer_allocate_info, command_buffers.data())) { throw COMMAND_BUFFER_CREATION_FAILED; }
 }
 
+// the triangle is optionally tessellated into a dense mesh, then its LOD chain is generated
+void VulkanTriangle::import_mesh() {
+    std::vector<uint32_t> indices = { 0, 1, 2 };
+    if (options.mesh_subdivisions > 0) {
+        MeshLod::subdivide_triangle(input_data, indices, options.mesh_subdivisions);
+    }
+    mesh_lod = std::make_unique<MeshLod>(input_data, indices);
+
+    std::cout << "Mesh LODs (triangles/error):";
+    for (uint32_t lod = 0; lod < mesh_lod->get_lods().size(); lod++) {
+        std::cout << " " << mesh_lod->get_triangle_count(lod) << "/" << mesh_lod->get_lods()[lod].error;
+    }
+    std::cout << std::endl;
+}
+
+// variant v is the imported mesh shrunk towards its center by v / (2 * mesh count), with its colors rotated, so
+// every variant stays inside the bounds the scene is built from
+std::vector<glm::vec3> VulkanTriangle::get_mesh_variant(uint32_t variant) const {
+    glm::vec3 mesh_min = input_data[0];
+    glm::vec3 mesh_max = input_data[0];
+    for (size_t i = 0; i < input_data.size(); i += 2) {
+        mesh_min = glm::min(mesh_min, input_data[i]);
+        mesh_max = glm::max(mesh_max, input_data[i]);
+    }
+    glm::vec3 center = (mesh_min + mesh_max) * 0.5f;
+    float scale = 1.0f - 0.5f * variant / options.mesh_count;
+    std::vector<glm::vec3> vertices = input_data;
+    for (size_t i = 0; i < vertices.size(); i += 2) {
+        vertices[i] = center + (input_data[i] - center) * scale;
+        vertices[i + 1] = glm::vec3(input_data[i + 1][variant % 3], input_data[i + 1][(variant + 1) % 3], input_data[i + 1][(variant + 2) % 3]);
+    }
+    return vertices;
+}
+
+// the pool is sized for every variant at once, so a variant that was unloaded always fits again
+void VulkanTriangle::create_geometry_pool() {
+    uint32_t vertex_count = static_cast<uint32_t>(input_data.size() / 2);
+    uint32_t index_count = static_cast<uint32_t>(mesh_lod->get_indices().size());
+    geometry_pool = std::make_unique<GeometryPool>(device, physical_device_memory_properties, *memory_tracker, static_cast<uint32_t>(2 * sizeof(glm::vec3)),
+        vertex_count * options.mesh_count, index_count * options.mesh_count, frames_in_flight);
+    for (uint32_t variant = 0; variant < options.mesh_count; variant++) {
+        std::vector<glm::vec3> vertices = get_mesh_variant(variant);
+        mesh_ids.push_back(geometry_pool->add_mesh(vertices.data(), vertex_count, mesh_lod->get_indices()));
+    }
+}
+
+// every interval either the unloaded variant is added back or the next one in turn is removed, the objects of an
+// unloaded variant are not drawn; removals leave holes that the pool compacts in the next frame
+void VulkanTriangle::reload_meshes() {
+    if (unloaded_mesh != UINT32_MAX) {
+        std::vector<glm::vec3> vertices = get_mesh_variant(unloaded_mesh);
+        mesh_ids[unloaded_mesh] = geometry_pool->add_mesh(vertices.data(), static_cast<uint32_t>(vertices.size() / 2), mesh_lod->get_indices());
+        unloaded_mesh = UINT32_MAX;
+        return;
+    }
+    unloaded_mesh = next_unloaded_mesh;
+    next_unloaded_mesh = (next_unloaded_mesh + 1) % options.mesh_count;
+    geometry_pool->remove_mesh(mesh_ids[unloaded_mesh]);
+    mesh_ids[unloaded_mesh] = UINT32_MAX;
+}
+
 void VulkanTriangle::create_host_buffers() {
+    // regions are flushed separately, 256 bytes is the largest nonCoherentAtomSize allowed
+    uniform_region_size = (sizeof(UniformData) + 255) & ~VkDeviceSize(255);
     VkBufferCreateInfo buffer_create_info = {
         VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         nullptr,
         0,
-        input_data.size() * sizeof(decltype(input_data[0])),
+        uniform_region_size * frames_in_flight,
         VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
         VK_SHARING_MODE_EXCLUSIVE,
         0,
         nullptr
     };
-    vkCreateBuffer(device, &buffer_create_info, nullptr, &host_vertex_buffer);
-
-    buffer_create_info.size = sizeof(glm::mat4);
     vkCreateBuffer(device, &buffer_create_info, nullptr, &host_m_matrix_buffer);
 
-    vkGetBufferMemoryRequirements(device, host_vertex_buffer, &host_memory_requirements[0]);
-    vkGetBufferMemoryRequirements(device, host_m_matrix_buffer, &host_memory_requirements[1]);
+    vkGetBufferMemoryRequirements(device, host_m_matrix_buffer, &host_memory_requirements);
 
     VkMemoryAllocateInfo memory_allocate_info = {
         VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
         nullptr,
-        host_memory_requirements[0].size + host_memory_requirements[1].size,
-        vulkan_helper::select_memory_index(physical_device_memory_properties,host_memory_requirements[0],VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        host_memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties,host_memory_requirements,VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
     };
-    if (vkAllocateMemory(device, &memory_allocate_info, nullptr, &host_memory) != VK_SUCCESS) { throw MEMORY_ALLOCATION_FAILED; }
+    if (memory_tracker->allocate(device, memory_allocate_info, uniform_region_size * frames_in_flight, "host_buffers", &host_memory) != VK_SUCCESS) { throw MEMORY_ALLOCATION_FAILED; }
 
-    vkBindBufferMemory(device, host_vertex_buffer, host_memory, 0);
-    vkBindBufferMemory(device, host_m_matrix_buffer, host_memory, host_memory_requirements[0].size);
+    vkBindBufferMemory(device, host_m_matrix_buffer, host_memory, 0);
 
     vkMapMemory(device, host_memory, 0, VK_WHOLE_SIZE, 0, &host_data_pointer);
-    memcpy(host_data_pointer, input_data.data(), input_data.size() * sizeof(decltype(input_data[0])));
-    VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, host_memory,0,VK_WHOLE_SIZE };
-    vkFlushMappedMemoryRanges(device, 1, &mapped_memory_range);
 }
 
 void VulkanTriangle::create_device_buffers() {
@@ -365,63 +760,44 @@ void VulkanTriangle::create_device_buffers() {
         VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
         nullptr,
         0,
-        input_data.size() * sizeof(decltype(input_data[0])),
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        sizeof(UniformData),
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
         VK_SHARING_MODE_EXCLUSIVE,
         0,
         nullptr
     };
-    vkCreateBuffer(device, &buffer_create_info, nullptr, &device_vertex_buffer);
-
-    buffer_create_info.size = sizeof(glm::mat4);
-    buffer_create_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
     vkCreateBuffer(device, &buffer_create_info, nullptr, &device_m_matrix_buffer);
 
-    vkGetBufferMemoryRequirements(device, device_m_matrix_buffer, &device_memory_requirements[0]);
-    vkGetBufferMemoryRequirements(device, device_vertex_buffer, &device_memory_requirements[1]);
+    vkGetBufferMemoryRequirements(device, device_m_matrix_buffer, &device_memory_requirements);
 
     VkMemoryAllocateInfo memory_allocate_info = {
         VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
         nullptr,
-        device_memory_requirements[0].size + device_memory_requirements[1].size,
-        vulkan_helper::select_memory_index(physical_device_memory_properties,device_memory_requirements[0],VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+        device_memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties,device_memory_requirements,VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
     };
-    if (vkAllocateMemory(device, &memory_allocate_info, nullptr, &device_memory) != VK_SUCCESS) { throw MEMORY_ALLOCATION_FAILED; }
+    if (memory_tracker->allocate(device, memory_allocate_info, sizeof(UniformData), "device_buffers", &device_memory) != VK_SUCCESS) { throw MEMORY_ALLOCATION_FAILED; }
 
-    vkBindBufferMemory(device, device_vertex_buffer, device_memory, 0);
-    vkBindBufferMemory(device, device_m_matrix_buffer, device_memory, device_memory_requirements[0].size);
+    vkBindBufferMemory(device, device_m_matrix_buffer, device_memory, 0);
 }
 
 void VulkanTriangle::create_descriptor_pool() {
-    VkDescriptorPoolSize descriptor_pool_size = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 };
+    VkDescriptorPoolSize descriptor_pool_sizes[2] = {
+        { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 }
+    };
     VkDescriptorPoolCreateInfo descriptor_pool_create_info = {
         VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
         nullptr,
         0,
         1,
-        1,
-        &descriptor_pool_size
+        2,
+        descriptor_pool_sizes
     };
     vkCreateDescriptorPool(device, &descriptor_pool_create_info, nullptr, &descriptor_pool);
 }
 
 void VulkanTriangle::allocate_descriptor_sets() {
-    VkDescriptorSetLayoutBinding descriptor_set_layout_binding = {
-    0,
-    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-    1,
-    VK_SHADER_STAGE_VERTEX_BIT,
-    nullptr
-    };
-    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {
-        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
-        nullptr,
-        0,
-        1,
-        &descriptor_set_layout_binding
-    };
-    vkCreateDescriptorSetLayout(device, &descriptor_set_layout_create_info, nullptr, &descriptor_set_layout);
-
     VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
         VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
         nullptr,
@@ -431,33 +807,52 @@ void VulkanTriangle::allocate_descriptor_sets() {
     };
     vkAllocateDescriptorSets(device, &descriptor_set_allocate_info, &descriptor_set);
 
-    VkDescriptorBufferInfo descriptor_buffer_info = { device_m_matrix_buffer,0,sizeof(glm::mat4) };
-    VkWriteDescriptorSet write_descriptor_set = {
-        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-        nullptr,
-        descriptor_set,
-        0,
-        0,
-        1,
-        VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-        nullptr,
-        &descriptor_buffer_info,
-        nullptr
+    VkDescriptorBufferInfo descriptor_buffer_info = { device_m_matrix_buffer,0,sizeof(UniformData) };
+    VkDescriptorImageInfo descriptor_image_info = { texture->get_sampler(), texture->get_view(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    VkWriteDescriptorSet write_descriptor_sets[2] = {
+        {
+            VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            nullptr,
+            descriptor_set,
+            0,
+            0,
+            1,
+            VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+            nullptr,
+            &descriptor_buffer_info,
+            nullptr
+        },
+        {
+            VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            nullptr,
+            descriptor_set,
+            1,
+            0,
+            1,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            &descriptor_image_info,
+            nullptr,
+            nullptr
+        }
     };
-    vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
+    vkUpdateDescriptorSets(device, 2, write_descriptor_sets, 0, nullptr);
 }
 
 void VulkanTriangle::create_renderpass() {
+    // the scene is rendered into an offscreen target and blitted to the swapchain image afterwards,
+    // one render pass is shared by all outputs so their render targets use the first swapchain's format
+    render_target_format = outputs[0].swapchain_create_info.imageFormat;
+    render_target_layout = options.post_process != PostProcess::NONE ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
     VkAttachmentDescription attachment_description = {
         0,
-        swapchain_create_info.imageFormat,
+        render_target_format,
         VK_SAMPLE_COUNT_1_BIT,
         VK_ATTACHMENT_LOAD_OP_CLEAR,
         VK_ATTACHMENT_STORE_OP_STORE,
         VK_ATTACHMENT_LOAD_OP_DONT_CARE,
         VK_ATTACHMENT_STORE_OP_DONT_CARE,
-        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-        VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        render_target_layout
     };
 
     VkAttachmentReference attachment_reference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
@@ -474,6 +869,29 @@ void VulkanTriangle::create_renderpass() {
         nullptr
     };
 
+    // previous frame's blit must finish reading before we clear, and this frame's blit must wait for the draw;
+    // when post-processing, the compute queue is synchronized with semaphores and the frame fences instead
+    VkSubpassDependency subpass_dependencies[2] = {
+        {
+            VK_SUBPASS_EXTERNAL,
+            0,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            0,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            0
+        },
+        {
+            0,
+            VK_SUBPASS_EXTERNAL,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_ACCESS_TRANSFER_READ_BIT,
+            0
+        }
+    };
+
     VkRenderPassCreateInfo render_pass_create_info = {
         VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
         nullptr,
@@ -482,28 +900,76 @@ void VulkanTriangle::create_renderpass() {
         &attachment_description,
         1,
         &subpass_description,
-        0,
-        nullptr
+        2,
+        subpass_dependencies
     };
     vkCreateRenderPass(device, &render_pass_create_info, nullptr, &render_pass);
+
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, render_target_format, &format_properties);
+    blit_filter = (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
 }
 
-void VulkanTriangle::create_framebuffers() {
-    framebuffers.resize(swapchain_images_count);
-    swapchain_images_views.resize(swapchain_images_count);
+void VulkanTriangle::create_render_target(Output& output) {
+    // allocated once at the largest scale, lower resolutions only render into a corner of it
+    float max_scale = options.dynamic_resolution ? options.max_render_scale : 1.0f;
+    output.render_target_extent = {
+        std::max(1u, static_cast<uint32_t>(output.swapchain_create_info.imageExtent.width * max_scale)),
+        std::max(1u, static_cast<uint32_t>(output.swapchain_create_info.imageExtent.height * max_scale))
+    };
+
+    // with a separate compute family the images are shared concurrently instead of transferring ownership every frame
+    bool is_post_processed = options.post_process != PostProcess::NONE;
+    uint32_t queue_family_indices[2] = { queue_family_index, compute_queue_family_index };
+    bool is_shared = is_post_processed && compute_queue_family_index != queue_family_index;
+    VkImageCreateInfo image_create_info = {
+        VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        nullptr,
+        0,
+        VK_IMAGE_TYPE_2D,
+        render_target_format,
+        { output.render_target_extent.width, output.render_target_extent.height, 1 },
+        1,
+        1,
+        VK_SAMPLE_COUNT_1_BIT,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (is_post_processed ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_TRANSFER_SRC_BIT),
+        is_shared ? VK_SHARING_MODE_CONCURRENT : VK_SHARING_MODE_EXCLUSIVE,
+        is_shared ? 2u : 0u,
+        is_shared ? queue_family_indices : nullptr,
+        VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    VkImageViewCreateInfo image_view_create_info = {
+        VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        nullptr,
+        0,
+        VK_NULL_HANDLE,
+        VK_IMAGE_VIEW_TYPE_2D,
+        render_target_format,
+        {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY },
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0 , VK_REMAINING_ARRAY_LAYERS}
+    };
+
+    output.render_targets.resize(is_post_processed ? frames_in_flight : 1);
+    for (auto& render_target : output.render_targets) {
+        image_create_info.format = render_target_format;
+        image_create_info.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | (is_post_processed ? VK_IMAGE_USAGE_SAMPLED_BIT : VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+        if (vkCreateImage(device, &image_create_info, nullptr, &render_target.image) != VK_SUCCESS) { throw IMAGE_CREATION_FAILED; }
 
-    for (int i = 0; i < swapchain_images_count; i++) {
-        VkImageViewCreateInfo image_view_create_info = {
-            VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        VkMemoryRequirements memory_requirements;
+        vkGetImageMemoryRequirements(device, render_target.image, &memory_requirements);
+        VkMemoryAllocateInfo memory_allocate_info = {
+            VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
             nullptr,
-            0,
-            swapchain_images[i],
-            VK_IMAGE_VIEW_TYPE_2D,
-            swapchain_create_info.imageFormat,
-            {VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY },
-            {VK_IMAGE_ASPECT_COLOR_BIT, 0, VK_REMAINING_MIP_LEVELS, 0 , VK_REMAINING_ARRAY_LAYERS}
+            memory_requirements.size,
+            vulkan_helper::select_memory_index(physical_device_memory_properties,memory_requirements,VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
         };
-        vkCreateImageView(device, &image_view_create_info, nullptr, &swapchain_images_views[i]);
+        if (memory_tracker->allocate(device, memory_allocate_info, memory_requirements.size, "render_target", &render_target.memory) != VK_SUCCESS) { throw MEMORY_ALLOCATION_FAILED; }
+        vkBindImageMemory(device, render_target.image, render_target.memory, 0);
+
+        image_view_create_info.image = render_target.image;
+        image_view_create_info.format = render_target_format;
+        vkCreateImageView(device, &image_view_create_info, nullptr, &render_target.view);
 
         VkFramebufferCreateInfo framebuffer_create_info = {
             VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
@@ -511,209 +977,168 @@ void VulkanTriangle::create_framebuffers() {
             0,
             render_pass,
             1,
-            &swapchain_images_views[i],
-            swapchain_create_info.imageExtent.width,
-            swapchain_create_info.imageExtent.height,
-            swapchain_create_info.imageArrayLayers
+            &render_target.view,
+            output.render_target_extent.width,
+            output.render_target_extent.height,
+            1
         };
-        vkCreateFramebuffer(device, &framebuffer_create_info, nullptr, &framebuffers[i]);
+        vkCreateFramebuffer(device, &framebuffer_create_info, nullptr, &render_target.framebuffer);
+        render_target.rendered_extent = { 0,0 };
+
+        if (!is_post_processed) { continue; }
+        // written by the compute queue, blitted to the swapchain by the graphics queue
+        image_create_info.format = PostProcess::output_format;
+        image_create_info.usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        if (vkCreateImage(device, &image_create_info, nullptr, &render_target.post_image) != VK_SUCCESS) { throw IMAGE_CREATION_FAILED; }
+        vkGetImageMemoryRequirements(device, render_target.post_image, &memory_requirements);
+        memory_allocate_info.allocationSize = memory_requirements.size;
+        memory_allocate_info.memoryTypeIndex = vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+        if (memory_tracker->allocate(device, memory_allocate_info, memory_requirements.size, "post_target", &render_target.post_memory) != VK_SUCCESS) { throw MEMORY_ALLOCATION_FAILED; }
+        vkBindImageMemory(device, render_target.post_image, render_target.post_memory, 0);
+
+        image_view_create_info.image = render_target.post_image;
+        image_view_create_info.format = PostProcess::output_format;
+        vkCreateImageView(device, &image_view_create_info, nullptr, &render_target.post_view);
     }
+    output.render_extent = output.render_target_extent;
 }
 
-void VulkanTriangle::create_pipeline() {
+void VulkanTriangle::destroy_render_target(Output& output) {
+    for (auto& render_target : output.render_targets) {
+        vkDestroyFramebuffer(device, render_target.framebuffer, nullptr);
+        vkDestroyImageView(device, render_target.view, nullptr);
+        vkDestroyImage(device, render_target.image, nullptr);
+        memory_tracker->free(device, render_target.memory);
+        if (render_target.post_image != VK_NULL_HANDLE) {
+            vkDestroyImageView(device, render_target.post_view, nullptr);
+            vkDestroyImage(device, render_target.post_image, nullptr);
+            memory_tracker->free(device, render_target.post_memory);
+        }
+    }
+    output.render_targets.clear();
+}
+
+// one controller for all outputs: the GPU frame time covers every output, so they share a render scale
+void VulkanTriangle::create_dynamic_resolution() {
+    if (options.dynamic_resolution && timestamp_valid_bits != 0) {
+        dynamic_resolution = std::make_unique<DynamicResolution>(options.target_gpu_msec, options.min_render_scale, options.max_render_scale);
+    }
+    else {
+        dynamic_resolution.reset();
+    }
+    for (auto& output : outputs) {
+        output.render_extent = output.render_target_extent;
+    }
+}
+
+void VulkanTriangle::load_shaders() {
     std::ifstream shader_file("shader//spirv.vert", std::ios::in | std::ios::binary);
-    std::vector<char> shader_contents(std::filesystem::file_size("shader//spirv.vert"));
-    shader_file.read(shader_contents.data(), std::filesystem::file_size("shader//spirv.vert"));
-    VkShaderModuleCreateInfo shader_module_create_info = {
-        VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        nullptr,
-        0,
-        std::filesystem::file_size("shader//spirv.vert"),
-        reinterpret_cast<uint32_t*>(shader_contents.data())
-    };
-    VkShaderModule vertex_shader_module;
-    if (vkCreateShaderModule(device, &shader_module_create_info, nullptr, &vertex_shader_module)) { throw SHADER_MODULE_CREATION_FAILED; }
+    vertex_shader_code.resize(std::filesystem::file_size("shader//spirv.vert"));
+    shader_file.read(vertex_shader_code.data(), vertex_shader_code.size());
     shader_file.close();
 
     shader_file.open("shader//spirv.frag", std::ios::in | std::ios::binary);
-    shader_contents.resize(std::filesystem::file_size("shader//spirv.frag"));
-    shader_file.read(shader_contents.data(), std::filesystem::file_size("shader//spirv.frag"));
-    shader_module_create_info.codeSize = std::filesystem::file_size("shader//spirv.frag");
-    shader_module_create_info.pCode = reinterpret_cast<uint32_t*>(shader_contents.data());
-    VkShaderModule fragment_shader_module;
-    if (vkCreateShaderModule(device, &shader_module_create_info, nullptr, &fragment_shader_module)) { throw SHADER_MODULE_CREATION_FAILED; }
+    fragment_shader_code.resize(std::filesystem::file_size("shader//spirv.frag"));
+    shader_file.read(fragment_shader_code.data(), fragment_shader_code.size());
     shader_file.close();
+}
 
-    VkPipelineShaderStageCreateInfo pipeline_shaders_stage_create_info[2] = {
-        {
-            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            nullptr,
-            0,
-            VK_SHADER_STAGE_VERTEX_BIT,
-            vertex_shader_module,
-            "main",
-            nullptr
-        },
-        {
-            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
-            nullptr,
-            0,
-            VK_SHADER_STAGE_FRAGMENT_BIT,
-            fragment_shader_module,
-            "main",
-            nullptr
-        }
-    };
-
-    VkVertexInputBindingDescription vertex_input_binding_description = {
-        0,
-        6 * sizeof(float),
-        VK_VERTEX_INPUT_RATE_VERTEX
-    };
-    VkVertexInputAttributeDescription vertex_input_attribute_description[] = { {
-        0,
-        0,
-        VK_FORMAT_R32G32B32_SFLOAT,
-        0
-    },
-    {
-        1,
-        0,
-        VK_FORMAT_R32G32B32_SFLOAT,
-        3 * sizeof(float)
-    }
-    };
-    VkPipelineVertexInputStateCreateInfo pipeline_vertex_input_state_create_info = {
-        VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-        nullptr,
-        0,
-        1,
-        &vertex_input_binding_description,
-        2,
-        vertex_input_attribute_description
-    };
-
-    VkPipelineInputAssemblyStateCreateInfo pipeline_input_assembly_create_info = {
-        VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
-        nullptr,
-        0,
-        VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
-        VK_FALSE
-    };
-
-    VkViewport viewport = {
-        0.0f,
-        0.0f,
-        swapchain_create_info.imageExtent.width,
-        swapchain_create_info.imageExtent.height,
-        0.0f,
-        1.0f
-    };
-    VkRect2D scissor = {
-        {0,0},
-        swapchain_create_info.imageExtent
-    };
-    VkPipelineViewportStateCreateInfo pipeline_viewport_state_create_info = {
-        VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
-        nullptr,
-        0,
-        1,
-        &viewport,
-        1,
-        &scissor
-    };
+// a missing or stale cache file is not an error, the driver ignores data from another device or driver version
+void VulkanTriangle::load_pipeline_cache() {
+    if (options.pipeline_cache_path.empty() || !std::filesystem::exists(options.pipeline_cache_path)) { return; }
+    std::ifstream cache_file(options.pipeline_cache_path, std::ios::in | std::ios::binary);
+    pipeline_cache_data.resize(std::filesystem::file_size(options.pipeline_cache_path));
+    cache_file.read(pipeline_cache_data.data(), pipeline_cache_data.size());
+}
 
-    VkPipelineRasterizationStateCreateInfo pipeline_rasterization_state_create_info = {
-        VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+void VulkanTriangle::create_pipeline_cache() {
+    VkPipelineCacheCreateInfo pipeline_cache_create_info = {
+        VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
         nullptr,
         0,
-        VK_FALSE,
-        VK_FALSE,
-        VK_POLYGON_MODE_FILL,
-        VK_CULL_MODE_NONE,
-        VK_FRONT_FACE_COUNTER_CLOCKWISE,
-        VK_FALSE,
-        0.0f,
-        0.0f,
-        0.0f,
-        1.0f
+        pipeline_cache_data.size(),
+        pipeline_cache_data.data()
     };
+    if (vkCreatePipelineCache(device, &pipeline_cache_create_info, nullptr, &pipeline_cache) != VK_SUCCESS) {
+        pipeline_cache_create_info.initialDataSize = 0;
+        pipeline_cache_create_info.pInitialData = nullptr;
+        if (vkCreatePipelineCache(device, &pipeline_cache_create_info, nullptr, &pipeline_cache) != VK_SUCCESS) { pipeline_cache = VK_NULL_HANDLE; }
+    }
+    pipeline_cache_data.clear();
+}
 
-    VkPipelineMultisampleStateCreateInfo pipeline_multisample_state_create_info = {
-        VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
-        nullptr,
-        0,
-        VK_SAMPLE_COUNT_1_BIT,
-        VK_FALSE,
-        1.0f,
-        nullptr,
-        VK_FALSE,
-        VK_FALSE
-    };
+void VulkanTriangle::save_pipeline_cache() {
+    if (pipeline_cache == VK_NULL_HANDLE || options.pipeline_cache_path.empty()) { return; }
+    size_t data_size = 0;
+    vkGetPipelineCacheData(device, pipeline_cache, &data_size, nullptr);
+    std::vector<char> data(data_size);
+    if (vkGetPipelineCacheData(device, pipeline_cache, &data_size, data.data()) != VK_SUCCESS) { return; }
+    std::ofstream cache_file(options.pipeline_cache_path, std::ios::out | std::ios::binary);
+    cache_file.write(data.data(), data_size);
+}
 
-    VkPipelineColorBlendAttachmentState pipeline_color_blend_attachment_state = {
-        VK_FALSE,
-        VK_BLEND_FACTOR_ONE,
-        VK_BLEND_FACTOR_ZERO,
-        VK_BLEND_OP_ADD,
-        VK_BLEND_FACTOR_ONE,
-        VK_BLEND_FACTOR_ZERO,
-        VK_BLEND_OP_ADD,
-        VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
-    };
-    VkPipelineColorBlendStateCreateInfo pipeline_color_blend_state_create_info = {
-        VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
-        nullptr,
-        0,
-        VK_FALSE,
-        VK_LOGIC_OP_COPY,
-        1,
-        &pipeline_color_blend_attachment_state,
-        {0.0f,0.0f,0.0f,0.0f}
+void VulkanTriangle::create_pipeline_registry() {
+    pipeline_registry = std::make_unique<PipelineRegistry>(device, pipeline_cache);
+    scene_bindings = {
+        { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr },
+        { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr }
     };
+    scene_layout = pipeline_registry->add_layout({ scene_bindings });
+    descriptor_set_layout = pipeline_registry->get_descriptor_set_layout(scene_layout, 0);
+    pipeline_layout = pipeline_registry->get_pipeline_layout(scene_layout);
+}
 
-    VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
-        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        nullptr,
-        0,
-        1,
-        &descriptor_set_layout,
-        0,
-        nullptr
-    };
-    vkCreatePipelineLayout(device, &pipeline_layout_create_info, nullptr, &pipeline_layout);
+// one pipeline per material, the variants differ in blending and color write mask; beyond the distinct variants
+// materials repeat earlier states and the registry hands back the pipeline it already has
+void VulkanTriangle::create_pipeline() {
+    PipelineRegistry::State state;
+    state.vertex_shader = pipeline_registry->add_shader(vertex_shader_code);
+    state.fragment_shader = pipeline_registry->add_shader(fragment_shader_code);
+    state.layout = scene_layout;
+    state.render_pass = pipeline_registry->add_render_pass(render_pass, { render_target_format }, VK_SAMPLE_COUNT_1_BIT);
+    state.vertex_binding_count = 2;
+    state.vertex_bindings[0] = { 0, 6 * sizeof(float), VK_VERTEX_INPUT_RATE_VERTEX };
+    state.vertex_bindings[1] = { 1, sizeof(glm::vec4), VK_VERTEX_INPUT_RATE_INSTANCE };
+    state.vertex_attribute_count = 3;
+    state.vertex_attributes[0] = { 0, 0, VK_FORMAT_R32G32B32_SFLOAT, 0 };
+    state.vertex_attributes[1] = { 1, 0, VK_FORMAT_R32G32B32_SFLOAT, 3 * sizeof(float) };
+    state.vertex_attributes[2] = { 2, 1, VK_FORMAT_R32G32B32A32_SFLOAT, 0 };
+
+    for (uint32_t material = 0; material < options.material_count; material++) {
+        PipelineRegistry::State material_state = state;
+        uint32_t variant = material % material_variants;
+        if (variant % 3 == 1) {
+            material_state.blend_enable = VK_TRUE;
+            material_state.dst_color_blend_factor = VK_BLEND_FACTOR_ONE;
+        }
+        else if (variant % 3 == 2) {
+            material_state.blend_enable = VK_TRUE;
+            material_state.src_color_blend_factor = VK_BLEND_FACTOR_SRC_ALPHA;
+            material_state.dst_color_blend_factor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+        }
+        if (variant >= 3) {
+            material_state.color_write_mask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT;
+        }
+        material_pipelines.push_back(pipeline_registry->get(material_state));
+    }
 
-    VkGraphicsPipelineCreateInfo graphics_pipeline_create_info = {
-        VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        nullptr,
-        0,
-        2,
-        pipeline_shaders_stage_create_info,
-        &pipeline_vertex_input_state_create_info,
-        &pipeline_input_assembly_create_info,
-        nullptr,
-        &pipeline_viewport_state_create_info,
-        &pipeline_rasterization_state_create_info,
-        &pipeline_multisample_state_create_info,
-        nullptr,
-        &pipeline_color_blend_state_create_info,
-        nullptr,
-        pipeline_layout,
-        render_pass,
-        0,
-        VK_NULL_HANDLE,
-        -1
-    };
-    vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &graphics_pipeline_create_info, nullptr, &pipeline);
-    vkDestroyShaderModule(device, vertex_shader_module, nullptr);
-    vkDestroyShaderModule(device, fragment_shader_module, nullptr);
+    // the distinct pipelines in bind order, instances are grouped by pipeline, then by mesh and by LOD
+    batch_pipelines = material_pipelines;
+    std::sort(batch_pipelines.begin(), batch_pipelines.end(), [this](uint32_t a, uint32_t b) { return pipeline_registry->get_sort_key(a) < pipeline_registry->get_sort_key(b); });
+    batch_pipelines.erase(std::unique(batch_pipelines.begin(), batch_pipelines.end()), batch_pipelines.end());
+    for (uint32_t pipeline : material_pipelines) {
+        material_batches.push_back(static_cast<uint32_t>(std::find(batch_pipelines.begin(), batch_pipelines.end(), pipeline) - batch_pipelines.begin()));
+    }
+    batch_instance_counts.assign(batch_pipelines.size() * options.mesh_count * mesh_lod->get_lods().size(), 0);
+    batch_first_instances.assign(batch_instance_counts.size(), 0);
+    batch_instance_counts[0] = 1;
+    pipeline_registry->report(std::cout, 0);
 }
 
 void VulkanTriangle::upload_input_data() {
     VkCommandBufferBeginInfo command_buffer_begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,nullptr };
     vkBeginCommandBuffer(command_buffers[0], &command_buffer_begin_info);
-    VkBufferCopy buffer_copy = { 0,0,input_data.size() * sizeof(decltype(input_data[0])) };
-    vkCmdCopyBuffer(command_buffers[0], host_vertex_buffer, device_vertex_buffer, 1, &buffer_copy);
+    geometry_pool->record_updates(command_buffers[0]);
     vkEndCommandBuffer(command_buffers[0]);
 
     VkFenceCreateInfo fence_create_info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,nullptr,0 };
@@ -739,167 +1164,1178 @@ void VulkanTriangle::upload_input_data() {
     vkDestroyFence(device, fence, nullptr);
 }
 
-void VulkanTriangle::record_command_buffers() {
-    VkClearValue clearColor = { { 0.0f, 0.0f, 0.0f, 1.0f } };
-
-    for (int i = 0; i < swapchain_images_count; i++) {
-        VkCommandBufferBeginInfo command_buffer_begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT, nullptr };
-        vkBeginCommandBuffer(command_buffers[i], &command_buffer_begin_info);
-
-        VkBufferCopy buffer_copy = { 0,0,sizeof(glm::mat4) };
-        vkCmdCopyBuffer(command_buffers[i], host_m_matrix_buffer, device_m_matrix_buffer, 1, &buffer_copy);
-
-        VkMemoryBarrier memory_barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_UNIFORM_READ_BIT };
-        vkCmdPipelineBarrier(command_buffers[i], VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
-
-        VkImageMemoryBarrier image_memory_barrier = {
-            VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-            nullptr,
-            0,
-            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-            VK_IMAGE_LAYOUT_UNDEFINED,
-            VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-            VK_QUEUE_FAMILY_IGNORED,
-            VK_QUEUE_FAMILY_IGNORED,
-            swapchain_images[i],
-            { VK_IMAGE_ASPECT_COLOR_BIT,0,1,0,1 }
-        };
-        vkCmdPipelineBarrier(command_buffers[i], VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+void VulkanTriangle::create_query_pools() {
+    VkQueryPoolCreateInfo query_pool_create_info = {
+        VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        nullptr,
+        0,
+        VK_QUERY_TYPE_TIMESTAMP,
+        TIMESTAMPS_PER_FRAME * frames_in_flight,
+        0
+    };
+    if (timestamp_valid_bits != 0) {
+        vkCreateQueryPool(device, &query_pool_create_info, nullptr, &timestamp_query_pool);
+    }
 
-        VkRenderPassBeginInfo render_pass_begin_info = {
-            VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-            nullptr,
-            render_pass,
-            framebuffers[i],
-            {{0,0},{swapchain_create_info.imageExtent}},
-            1,
-            &clearColor
-        };
-        vkCmdBeginRenderPass(command_buffers[i], &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    // results are returned in bit order: vertex, clipping invocations, clipping primitives, fragment
+    if (is_pipeline_statistics_supported) {
+        query_pool_create_info.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        query_pool_create_info.queryCount = frames_in_flight;
+        query_pool_create_info.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+            VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+        vkCreateQueryPool(device, &query_pool_create_info, nullptr, &pipeline_statistics_query_pool);
+    }
 
-        vkCmdBindDescriptorSets(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+    query_pool_create_info.queryType = VK_QUERY_TYPE_OCCLUSION;
+    query_pool_create_info.queryCount = frames_in_flight;
+    query_pool_create_info.pipelineStatistics = 0;
+    vkCreateQueryPool(device, &query_pool_create_info, nullptr, &occlusion_query_pool);
+}
 
-        vkCmdBindPipeline(command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+// without VK_EXT_calibrated_timestamps the GPU clock is aligned to the CPU clock by timing a single
+// timestamp write, the error is bounded by half of the submit-to-wait round trip
+void VulkanTriangle::calibrate_gpu_clock() {
+    if (timestamp_query_pool == VK_NULL_HANDLE) { return; }
+    gpu_clock_offset_ns = measure_clock_offset(queue, command_buffers[0], timestamp_valid_bits);
+    compute_clock_offset_ns = gpu_clock_offset_ns;
+    if (compute_timestamp_valid_bits == 0 || compute_queue_family_index == queue_family_index) { return; }
+
+    VkCommandPoolCreateInfo command_pool_create_info = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,nullptr,VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,compute_queue_family_index };
+    VkCommandPool compute_command_pool;
+    vkCreateCommandPool(device, &command_pool_create_info, nullptr, &compute_command_pool);
+    VkCommandBufferAllocateInfo command_buffer_allocate_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,nullptr,compute_command_pool,VK_COMMAND_BUFFER_LEVEL_PRIMARY,1 };
+    VkCommandBuffer compute_command_buffer;
+    vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &compute_command_buffer);
+    compute_clock_offset_ns = measure_clock_offset(compute_queue, compute_command_buffer, compute_timestamp_valid_bits);
+    vkDestroyCommandPool(device, compute_command_pool, nullptr);
+}
 
-        VkDeviceSize offset = 0;
-        vkCmdBindVertexBuffers(command_buffers[i], 0, 1, &device_vertex_buffer, &offset);
+// CPU time in nanoseconds minus GPU time in nanoseconds of the clock that timed_queue's timestamps are taken from
+int64_t VulkanTriangle::measure_clock_offset(VkQueue timed_queue, VkCommandBuffer command_buffer, uint32_t valid_bits) {
+    VkCommandBufferBeginInfo command_buffer_begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,nullptr };
+    vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+    vkCmdResetQueryPool(command_buffer, timestamp_query_pool, 0, 1);
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_query_pool, 0);
+    vkEndCommandBuffer(command_buffer);
 
-        vkCmdDraw(command_buffers[i], 3, 1, 0, 0);
+    VkFenceCreateInfo fence_create_info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,nullptr,0 };
+    VkFence fence;
+    vkCreateFence(device, &fence_create_info, nullptr, &fence);
+    VkSubmitInfo submit_info = {
+        VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        nullptr,
+        0,
+        nullptr,
+        nullptr,
+        1,
+        &command_buffer,
+        0,
+        nullptr
+    };
+    uint64_t cpu_before = trace::now();
+    vkQueueSubmit(timed_queue, 1, &submit_info, fence);
+    vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+    uint64_t cpu_after = trace::now();
 
-        vkCmdEndRenderPass(command_buffers[i]);
+    uint64_t gpu_timestamp;
+    vkGetQueryPoolResults(device, timestamp_query_pool, 0, 1, sizeof(gpu_timestamp), &gpu_timestamp, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    uint64_t mask = valid_bits == 64 ? UINT64_MAX : (1ull << valid_bits) - 1;
 
-        vkEndCommandBuffer(command_buffers[i]);
-    }
-    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+    vkResetCommandBuffer(command_buffer, 0);
+    vkDestroyFence(device, fence, nullptr);
+    return static_cast<int64_t>(cpu_before + (cpu_after - cpu_before) / 2) - static_cast<int64_t>((gpu_timestamp & mask) * static_cast<double>(timestamp_period));
 }
 
-void VulkanTriangle::create_semaphores() {
-    VkSemaphoreCreateInfo semaphore_create_info = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, nullptr, 0 };
-    semaphores.resize(2);
-    for (int i = 0; i < semaphores.size(); i++) {
-        vkCreateSemaphore(device, &semaphore_create_info, nullptr, &semaphores[i]);
+// update-only throughput of the compute animation from 10^4 to 10^7 elements, timed with GPU timestamps
+void VulkanTriangle::benchmark_particle_animation() {
+    if (!options.particle_benchmark) { return; }
+    if (timestamp_valid_bits == 0) {
+        std::cerr << "Particle benchmark skipped: the queue does not support timestamps" << std::endl;
+        return;
     }
-}
-
-void VulkanTriangle::frame_loop() {
-    while (!glfwWindowShouldClose(window)) {
-        rendered_frames++;
-        modulus_result = rendered_frames % 1000;
-        if (modulus_result == 0) {
-            t1 = std::chrono::steady_clock::now();
-        }
-
-        mv_matrix = glm::rotate(static_cast<float>(glfwGetTime() * 0.2f), glm::vec3(0.0f, 0.0f, 1.0f));
-        memcpy(static_cast<uint8_t*>(host_data_pointer) + host_memory_requirements[0].size, glm::value_ptr(mv_matrix), sizeof(mv_matrix));
-        VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, host_memory,host_memory_requirements[0].size,VK_WHOLE_SIZE };
-        vkFlushMappedMemoryRanges(device, 1, &mapped_memory_range);
-
-        uint32_t image_index = 0;
-        VkResult res = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, semaphores[0], VK_NULL_HANDLE, &image_index);
-        if (res == VK_SUBOPTIMAL_KHR || res == VK_ERROR_OUT_OF_DATE_KHR) {
-            on_window_resize();
-        }
-        else if(res != VK_SUCCESS) {
-            throw ACQUIRE_NEXT_IMAGE_FAILED;
+    constexpr uint32_t updates_per_size = 32;
+    VkQueryPoolCreateInfo query_pool_create_info = {
+        VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        nullptr,
+        0,
+        VK_QUERY_TYPE_TIMESTAMP,
+        2,
+        0
+    };
+    VkQueryPool query_pool;
+    vkCreateQueryPool(device, &query_pool_create_info, nullptr, &query_pool);
+    VkFenceCreateInfo fence_create_info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,nullptr,0 };
+    VkFence fence;
+    vkCreateFence(device, &fence_create_info, nullptr, &fence);
+    uint64_t mask = timestamp_valid_bits == 64 ? UINT64_MAX : (1ull << timestamp_valid_bits) - 1;
+
+    std::cout << "Particle animation benchmark, " << updates_per_size << " updates per size:" << std::endl;
+    for (uint32_t element_count = 10000; element_count <= 10000000; element_count *= 10) {
+        ParticleAnimation animation(device, physical_device_memory_properties, *memory_tracker, element_count, "shader//spirv.comp");
+
+        VkCommandBufferBeginInfo command_buffer_begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,nullptr };
+        vkBeginCommandBuffer(command_buffers[0], &command_buffer_begin_info);
+        vkCmdResetQueryPool(command_buffers[0], query_pool, 0, 2);
+        vkCmdWriteTimestamp(command_buffers[0], VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool, 0);
+        for (uint32_t i = 0; i < updates_per_size; i++) {
+            animation.record(command_buffers[0], i / 60.0f);
         }
+        vkCmdWriteTimestamp(command_buffers[0], VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, query_pool, 1);
+        vkEndCommandBuffer(command_buffers[0]);
 
-        VkPipelineStageFlags pipeline_stage_flags = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
         VkSubmitInfo submit_info = {
             VK_STRUCTURE_TYPE_SUBMIT_INFO,
             nullptr,
+            0,
+            nullptr,
+            nullptr,
             1,
-            &semaphores[0],
-            &pipeline_stage_flags,
-            1,
-            &command_buffers[image_index],
-            1,
-            &semaphores[1]
+            &command_buffers[0],
+            0,
+            nullptr
         };
-        vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
+        vkQueueSubmit(queue, 1, &submit_info, fence);
+        vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+        vkResetFences(device, 1, &fence);
+        vkResetCommandBuffer(command_buffers[0], 0);
+
+        uint64_t timestamps[2];
+        vkGetQueryPoolResults(device, query_pool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+        double msec = ((timestamps[1] - timestamps[0]) & mask) * timestamp_period / 1e6 / updates_per_size;
+        uint64_t elements = animation.get_element_count();
+        std::cout << "  " << elements << " elements: " << msec << " msec/update, " << elements / (msec * 1e6) << " Gelements/s, "
+            << elements * 6 * sizeof(float) / (msec * 1e6) << " GB/s written" << std::endl;
+    }
+
+    vkDestroyFence(device, fence, nullptr);
+    vkDestroyQueryPool(device, query_pool, nullptr);
+}
+
+void VulkanTriangle::create_particle_animation() {
+    if (options.particle_count == 0) { return; }
+    particle_animation = std::make_unique<ParticleAnimation>(device, physical_device_memory_properties, *memory_tracker, options.particle_count, "shader//spirv.comp");
+    if (!options.stream_capture_path.empty()) { std::cerr << "Command stream capture skipped: particle vertices are not captured" << std::endl; }
+}
+
+void VulkanTriangle::create_scene() {
+    if (options.scene_object_count == 0) { return; }
+    if (particle_animation) {
+        std::cout << "The scene instances the triangle, it is disabled when particles are animated" << std::endl;
+        return;
+    }
+    // bounds of the triangle in the XYZ - RGB input data
+    glm::vec3 mesh_min = input_data[0];
+    glm::vec3 mesh_max = input_data[0];
+    for (size_t i = 0; i < input_data.size(); i += 2) {
+        mesh_min = glm::min(mesh_min, input_data[i]);
+        mesh_max = glm::max(mesh_max, input_data[i]);
+    }
+    scene = std::make_unique<Scene>(options.scene_object_count, options.cull_thread_count, mesh_min, mesh_max);
+}
+
+void VulkanTriangle::create_texture() {
+    texture = std::make_unique<Texture>(physical_device, device, physical_device_memory_properties, *memory_tracker, options.texture_path,
+        static_cast<VkDeviceSize>(options.texture_budget_mib) << 20, static_cast<VkDeviceSize>(options.texture_upload_kib) << 10, frames_in_flight);
+    texture->report(std::cout);
+}
+
+void VulkanTriangle::create_instance_buffer() {
+    uint32_t max_instances = scene ? scene->get_object_count() : 1;
+    // regions are flushed separately, 256 bytes is the largest nonCoherentAtomSize allowed
+    instance_region_size = (max_instances * sizeof(glm::vec4) + 255) & ~VkDeviceSize(255);
+    VkBufferCreateInfo buffer_create_info = {
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        nullptr,
+        0,
+        instance_region_size * frames_in_flight,
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        0,
+        nullptr
+    };
+    vkCreateBuffer(device, &buffer_create_info, nullptr, &instance_buffer);
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, instance_buffer, &memory_requirements);
+    VkMemoryAllocateInfo memory_allocate_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        nullptr,
+        memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    };
+    if (memory_tracker->allocate(device, memory_allocate_info, buffer_create_info.size, "instances", &instance_memory) != VK_SUCCESS) { throw MEMORY_ALLOCATION_FAILED; }
+    vkBindBufferMemory(device, instance_buffer, instance_memory, 0);
+    vkMapMemory(device, instance_memory, 0, VK_WHOLE_SIZE, 0, &instance_data_pointer);
+
+    glm::vec4 identity_instance = { 0.0f, 0.0f, 0.0f, 1.0f };
+    for (uint32_t frame = 0; frame < frames_in_flight; frame++) {
+        memcpy(static_cast<uint8_t*>(instance_data_pointer) + instance_region_size * frame, &identity_instance, sizeof(identity_instance));
+    }
+    VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, instance_memory, 0, VK_WHOLE_SIZE };
+    vkFlushMappedMemoryRanges(device, 1, &mapped_memory_range);
+}
+
+// consumes the draw list of the last cull, the region of this frame is no longer read since its fence was waited;
+// each object gets the coarsest LOD whose error projects to at most lod_error_pixels on the first output
+void VulkanTriangle::write_instances(uint32_t frame) {
+    if (!scene) {
+        total_lod_triangles += mesh_lod->get_triangle_count(0);
+        total_full_triangles += mesh_lod->get_triangle_count(0);
+        frame_triangles = particle_animation ? particle_animation->get_element_count() / 3 : mesh_lod->get_triangle_count(0);
+        return;
+    }
+    const std::vector<uint32_t>& draw_list = scene->get_draw_list();
+    float pixels_per_unit_at_unit_distance = outputs[0].render_extent.height / (2.0f * std::tan(camera_fov * 0.5f));
+    uint32_t lod_count = static_cast<uint32_t>(mesh_lod->get_lods().size());
+    std::fill(batch_instance_counts.begin(), batch_instance_counts.end(), 0);
+    selected_batches.resize(draw_list.size());
+    for (size_t i = 0; i < draw_list.size(); i++) {
+        uint32_t mesh = draw_list[i] % options.mesh_count;
+        if (mesh_ids[mesh] == UINT32_MAX) {
+            selected_batches[i] = UINT32_MAX;
+            continue;
+        }
+        const glm::vec4& instance = scene->get_instance(draw_list[i]);
+        float distance = std::max(0.1f, glm::length(glm::vec3(instance) - camera_position));
+        uint32_t lod = options.lod_error_pixels > 0.0f ? mesh_lod->select_lod(pixels_per_unit_at_unit_distance * instance.w / distance, options.lod_error_pixels) : 0;
+        selected_batches[i] = (material_batches[draw_list[i] % material_batches.size()] * options.mesh_count + mesh) * lod_count + lod;
+        batch_instance_counts[selected_batches[i]]++;
+    }
+
+    uint32_t first_instance = 0;
+    uint64_t lod_triangles = 0;
+    for (uint32_t batch = 0; batch < batch_instance_counts.size(); batch++) {
+        batch_first_instances[batch] = first_instance;
+        first_instance += batch_instance_counts[batch];
+        lod_triangles += static_cast<uint64_t>(batch_instance_counts[batch]) * mesh_lod->get_triangle_count(batch % lod_count);
+    }
+    total_lod_triangles += lod_triangles;
+    frame_triangles = lod_triangles;
+    total_full_triangles += static_cast<uint64_t>(first_instance) * mesh_lod->get_triangle_count(0);
+
+    // stable counting sort, the draw order inside a batch stays the order of the draw list
+    std::vector<uint32_t> batch_cursors = batch_first_instances;
+    glm::vec4* instances = reinterpret_cast<glm::vec4*>(static_cast<uint8_t*>(instance_data_pointer) + instance_region_size * frame);
+    for (size_t i = 0; i < draw_list.size(); i++) {
+        if (selected_batches[i] == UINT32_MAX) { continue; }
+        instances[batch_cursors[selected_batches[i]]++] = scene->get_instance(draw_list[i]);
+    }
+    instance_count = first_instance;
+    VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, instance_memory, instance_region_size * frame, instance_region_size };
+    vkFlushMappedMemoryRanges(device, 1, &mapped_memory_range);
+}
+
+void VulkanTriangle::create_indirect_buffer() {
+    // regions are flushed separately, as in create_instance_buffer
+    indirect_region_size = (batch_instance_counts.size() * sizeof(VkDrawIndexedIndirectCommand) + 255) & ~VkDeviceSize(255);
+    VkBufferCreateInfo buffer_create_info = {
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        nullptr,
+        0,
+        indirect_region_size * frames_in_flight,
+        VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        0,
+        nullptr
+    };
+    vkCreateBuffer(device, &buffer_create_info, nullptr, &indirect_buffer);
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, indirect_buffer, &memory_requirements);
+    VkMemoryAllocateInfo memory_allocate_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        nullptr,
+        memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    };
+    if (memory_tracker->allocate(device, memory_allocate_info, buffer_create_info.size, "indirect_draws", &indirect_memory) != VK_SUCCESS) { throw MEMORY_ALLOCATION_FAILED; }
+    vkBindBufferMemory(device, indirect_buffer, indirect_memory, 0);
+    vkMapMemory(device, indirect_memory, 0, VK_WHOLE_SIZE, 0, &indirect_data_pointer);
+    draw_commands.reserve(batch_instance_counts.size());
+    pipeline_first_draws.assign(batch_pipelines.size(), 0);
+    pipeline_draw_counts.assign(batch_pipelines.size(), 0);
+}
+
+// one command per non-empty batch of a loaded mesh, at the offsets the pool has just been updated to; batches are
+// ordered by pipeline, so the commands of a pipeline are adjacent
+void VulkanTriangle::write_draw_commands(uint32_t frame) {
+    const std::vector<MeshLod::Lod>& lods = mesh_lod->get_lods();
+    uint32_t lod_count = static_cast<uint32_t>(lods.size());
+    uint32_t pipeline_batch_count = options.mesh_count * lod_count;
+    draw_commands.clear();
+    for (uint32_t pipeline = 0; pipeline < batch_pipelines.size(); pipeline++) {
+        pipeline_first_draws[pipeline] = static_cast<uint32_t>(draw_commands.size());
+        for (uint32_t batch = pipeline * pipeline_batch_count; batch < (pipeline + 1) * pipeline_batch_count; batch++) {
+            uint32_t mesh = (batch / lod_count) % options.mesh_count;
+            if (batch_instance_counts[batch] == 0 || mesh_ids[mesh] == UINT32_MAX) { continue; }
+            const GeometryPool::Mesh& pool_mesh = geometry_pool->get_mesh(mesh_ids[mesh]);
+            const MeshLod::Lod& lod = lods[batch % lod_count];
+            draw_commands.push_back({ lod.index_count, batch_instance_counts[batch], pool_mesh.first_index + lod.first_index, static_cast<int32_t>(pool_mesh.first_vertex), batch_first_instances[batch] });
+        }
+        pipeline_draw_counts[pipeline] = static_cast<uint32_t>(draw_commands.size()) - pipeline_first_draws[pipeline];
+    }
+    memcpy(static_cast<uint8_t*>(indirect_data_pointer) + indirect_region_size * frame, draw_commands.data(), draw_commands.size() * sizeof(VkDrawIndexedIndirectCommand));
+    VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, indirect_memory, indirect_region_size * frame, indirect_region_size };
+    vkFlushMappedMemoryRanges(device, 1, &mapped_memory_range);
+}
 
-        VkPresentInfoKHR present_info = {
-            VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+void VulkanTriangle::create_post_process() {
+    if (options.post_process == PostProcess::NONE) { return; }
+    post_process = std::make_unique<PostProcess>(device, compute_queue_family_index, frames_in_flight, outputs.size(), options.post_process, "shader//spirv_post.comp");
+    if (compute_queue_family_index == queue_family_index) {
+        std::cout << "No separate compute queue family, post-processing runs on the graphics queue" << std::endl;
+    }
+
+    VkCommandBufferAllocateInfo command_buffer_allocate_info = {
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        nullptr,
+        command_pool,
+        VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        frames_in_flight
+    };
+    present_command_buffers.resize(frames_in_flight);
+    if (vkAllocateCommandBuffers(device, &command_buffer_allocate_info, present_command_buffers.data())) { throw COMMAND_BUFFER_CREATION_FAILED; }
+    is_post_pending.assign(frames_in_flight, false);
+}
+
+void VulkanTriangle::record_command_buffer(uint32_t frame) {
+    VkClearValue clearColor = { { 0.0f, 0.0f, 0.0f, 1.0f } };
+    VkCommandBuffer command_buffer = command_buffers[frame];
+    auto record_begin = std::chrono::steady_clock::now();
+    uint64_t first_bind_call = total_bind_calls;
+    uint64_t first_draw_call = total_draw_calls;
+    uint64_t first_draw = total_draws;
+    uint32_t rendered_outputs = 0;
+
+    VkCommandBufferBeginInfo command_buffer_begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr };
+    vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+
+    if (timestamp_query_pool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(command_buffer, timestamp_query_pool, TIMESTAMPS_PER_FRAME * frame, TIMESTAMPS_PER_FRAME);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_query_pool, TIMESTAMPS_PER_FRAME * frame + TIMESTAMP_FRAME_BEGIN);
+    }
+
+    if (pipeline_statistics_query_pool != VK_NULL_HANDLE) {
+        vkCmdResetQueryPool(command_buffer, pipeline_statistics_query_pool, frame, 1);
+    }
+    vkCmdResetQueryPool(command_buffer, occlusion_query_pool, frame, 1);
+
+    if (!options.stream_capture_path.empty() && !is_stream_captured && !particle_animation && rendered_frames >= options.stream_capture_frame && !texture->is_streaming() &&
+        unloaded_mesh == UINT32_MAX) {
+        stream_capture = std::make_unique<CommandStreamWriter>();
+    }
+
+    // meshes added or moved by a compaction are in place before anything reads the pool
+    geometry_pool->record_updates(command_buffer);
+
+    // the shader never samples finer than what has been streamed in, including the levels uploaded just now
+    texture->record_streaming(command_buffer);
+    glm::vec4 texture_parameters = glm::vec4(texture->get_min_lod(), 0.0f, 0.0f, 0.0f);
+    memcpy(static_cast<uint8_t*>(host_data_pointer) + uniform_region_size * frame + offsetof(UniformData, texture_parameters), glm::value_ptr(texture_parameters), sizeof(texture_parameters));
+    VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, host_memory, uniform_region_size * frame, uniform_region_size };
+    vkFlushMappedMemoryRanges(device, 1, &mapped_memory_range);
+
+    VkBufferCopy buffer_copy = { uniform_region_size * frame,0,sizeof(UniformData) };
+    vkCmdCopyBuffer(command_buffer, host_m_matrix_buffer, device_m_matrix_buffer, 1, &buffer_copy);
+
+    VkMemoryBarrier memory_barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_UNIFORM_READ_BIT };
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+    if (stream_capture) {
+        stream_capture->copy_buffer(host_m_matrix_buffer, device_m_matrix_buffer, buffer_copy);
+        stream_capture->pipeline_barrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, memory_barrier);
+    }
+
+    if (particle_animation) {
+        particle_animation->record(command_buffer, static_cast<float>(glfwGetTime()));
+    }
+    if (timestamp_query_pool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool, TIMESTAMPS_PER_FRAME * frame + TIMESTAMP_ANIMATION_END);
+    }
+
+    write_instances(frame);
+    if (!particle_animation) { write_draw_commands(frame); }
+
+    // descriptors and geometry are bound once and stay bound across the render passes of all outputs, as does the
+    // last pipeline, so the registry skips binding it again in the next render pass. Every mesh is in the pool
+    // buffers, the vertices and the instances are bound with a single call
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+    total_bind_calls++;
+    pipeline_registry->begin_recording();
+
+    // the animated particles replace the meshes when enabled
+    VkBuffer vertex_buffers[2] = { particle_animation ? particle_animation->get_vertex_buffer() : geometry_pool->get_vertex_buffer(), instance_buffer };
+    VkDeviceSize vertex_buffer_offsets[2] = { 0, scene ? instance_region_size * frame : 0 };
+    vkCmdBindVertexBuffers(command_buffer, 0, 2, vertex_buffers, vertex_buffer_offsets);
+    total_bind_calls++;
+    if (!particle_animation) {
+        vkCmdBindIndexBuffer(command_buffer, geometry_pool->get_index_buffer(), 0, VK_INDEX_TYPE_UINT32);
+        total_bind_calls++;
+    }
+    if (stream_capture) {
+        stream_capture->bind_descriptor_set(scene_layout, descriptor_set);
+        stream_capture->bind_vertex_buffer(0, vertex_buffers[0], vertex_buffer_offsets[0]);
+        stream_capture->bind_vertex_buffer(1, vertex_buffers[1], vertex_buffer_offsets[1]);
+        stream_capture->bind_index_buffer(geometry_pool->get_index_buffer(), 0, VK_INDEX_TYPE_UINT32);
+    }
+
+    // the queries are begun outside the render passes so they accumulate over every output
+    if (pipeline_statistics_query_pool != VK_NULL_HANDLE) {
+        vkCmdBeginQuery(command_buffer, pipeline_statistics_query_pool, frame, 0);
+    }
+    vkCmdBeginQuery(command_buffer, occlusion_query_pool, frame, is_occlusion_query_precise_supported ? VK_QUERY_CONTROL_PRECISE_BIT : 0);
+
+    // when post-processing the swapchains are acquired later, at present time, so every output is rendered
+    for (auto& output : outputs) {
+        if (!post_process && !output.is_acquired) { continue; }
+        RenderTarget& render_target = output.render_targets[frame % output.render_targets.size()];
+        render_target.rendered_extent = output.render_extent;
+        rendered_outputs++;
+        VkRenderPassBeginInfo render_pass_begin_info = {
+            VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
             nullptr,
+            render_pass,
+            render_target.framebuffer,
+            {{0,0},{output.render_extent}},
             1,
-            &semaphores[1],
+            &clearColor
+        };
+        vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+
+        VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(output.render_extent.width), static_cast<float>(output.render_extent.height), 0.0f, 1.0f };
+        VkRect2D scissor = { {0,0}, output.render_extent };
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+        if (stream_capture) { stream_capture->begin_render_pass(render_target.framebuffer, output.render_extent, clearColor); }
+
+        if (particle_animation) {
+            if (pipeline_registry->bind(command_buffer, material_pipelines[0])) { total_bind_calls++; }
+            vkCmdDraw(command_buffer, particle_animation->get_element_count(), 1, 0, 0);
+            total_draw_calls++;
+            total_draws++;
+        }
+        else {
+            for (uint32_t pipeline = 0; pipeline < batch_pipelines.size(); pipeline++) {
+                uint32_t first_draw = pipeline_first_draws[pipeline];
+                uint32_t draw_count = pipeline_draw_counts[pipeline];
+                if (draw_count == 0) { continue; }
+                if (pipeline_registry->bind(command_buffer, batch_pipelines[pipeline])) {
+                    total_bind_calls++;
+                    if (stream_capture) { stream_capture->bind_pipeline(pipeline_registry->get_pipeline(batch_pipelines[pipeline])); }
+                }
+                if (is_multi_draw_indirect_supported) {
+                    VkDeviceSize draw_offset = indirect_region_size * frame + first_draw * sizeof(VkDrawIndexedIndirectCommand);
+                    vkCmdDrawIndexedIndirect(command_buffer, indirect_buffer, draw_offset, draw_count, sizeof(VkDrawIndexedIndirectCommand));
+                    if (stream_capture) { stream_capture->draw_indexed_indirect(indirect_buffer, draw_offset, draw_count, sizeof(VkDrawIndexedIndirectCommand)); }
+                    total_draw_calls++;
+                }
+                else {
+                    for (uint32_t draw = first_draw; draw < first_draw + draw_count; draw++) {
+                        const VkDrawIndexedIndirectCommand& command = draw_commands[draw];
+                        vkCmdDrawIndexed(command_buffer, command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+                        if (stream_capture) { stream_capture->draw_indexed(command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance); }
+                    }
+                    total_draw_calls += draw_count;
+                }
+                total_draws += draw_count;
+            }
+        }
+
+        vkCmdEndRenderPass(command_buffer);
+        if (stream_capture) { stream_capture->end_render_pass(); }
+    }
+
+    vkCmdEndQuery(command_buffer, occlusion_query_pool, frame);
+    if (pipeline_statistics_query_pool != VK_NULL_HANDLE) {
+        vkCmdEndQuery(command_buffer, pipeline_statistics_query_pool, frame);
+    }
+
+    if (timestamp_query_pool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool, TIMESTAMPS_PER_FRAME * frame + TIMESTAMP_SCENE_END);
+    }
+    cpu_record_msec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - record_begin).count();
+
+    // the HUD is drawn after the queries so it is not counted as scene work, HUD_END is written with or without it
+    // so the frame's timestamps are always complete
+    if (perf_hud && is_hud_visible && (post_process || outputs[0].is_acquired)) {
+        PerfHud::Counters counters = {};
+        counters.bind_calls = total_bind_calls - first_bind_call;
+        counters.draw_calls = total_draw_calls - first_draw_call;
+        counters.draws = total_draws - first_draw;
+        counters.triangles = frame_triangles * rendered_outputs;
+        record_perf_hud(command_buffer, frame, counters);
+    }
+    if (timestamp_query_pool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool, TIMESTAMPS_PER_FRAME * frame + TIMESTAMP_HUD_END);
+    }
+
+    if (!post_process) { record_blit(command_buffer, frame); }
+    vkEndCommandBuffer(command_buffer);
+    if (stream_capture) { end_stream_capture(frame); }
+}
+
+// the counters of the scene pass are filled in by the caller, the timings are those of the last frame whose queries
+// were read; the quads are laid out for the first window and stretched with the render target when it is scaled
+void VulkanTriangle::record_perf_hud(VkCommandBuffer command_buffer, uint32_t frame, PerfHud::Counters counters) {
+    TRACE_SCOPE("hud");
+    counters.cpu_frame_msec = cpu_frame_msec;
+    counters.cpu_wait_msec = cpu_wait_msec;
+    counters.cpu_cull_msec = scene ? scene->get_cull_msec() + scene->get_refit_msec() : 0.0;
+    counters.cpu_record_msec = cpu_record_msec;
+    counters.gpu_frame_msec = gpu_frame_msec;
+    counters.gpu_animation_msec = particle_animation ? gpu_animation_msec : 0.0;
+    counters.gpu_scene_msec = gpu_scene_msec;
+    counters.gpu_post_msec = gpu_post_msec;
+    counters.gpu_hud_msec = gpu_hud_msec;
+    counters.render_scale = dynamic_resolution ? dynamic_resolution->get_scale() : 1.0f;
+    memory_tracker->get_device_local_usage(&counters.device_memory_allocated, &counters.device_memory_budget);
+
+    Output& output = outputs[0];
+    RenderTarget& render_target = output.render_targets[frame % output.render_targets.size()];
+    perf_hud->update(frame, counters, output.swapchain_create_info.imageExtent);
+    perf_hud->record(command_buffer, frame, render_target.framebuffer, output.render_extent);
+}
+
+// the resources are added once the frame is recorded, when the instances, draw commands and uniforms it reads have
+// been written. The pool buffers hold the CPU copies of the meshes, the texture is read back from the GPU
+void VulkanTriangle::end_stream_capture(uint32_t frame) {
+    const uint8_t* uniform_data = static_cast<const uint8_t*>(host_data_pointer) + uniform_region_size * frame;
+    std::vector<char> vertex_data = geometry_pool->get_vertex_data();
+    std::vector<char> index_data = geometry_pool->get_index_data();
+    stream_capture->add_buffer(geometry_pool->get_vertex_buffer(), true, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, vertex_data.data(), vertex_data.size());
+    stream_capture->add_buffer(geometry_pool->get_index_buffer(), true, VK_BUFFER_USAGE_INDEX_BUFFER_BIT, index_data.data(), index_data.size());
+    stream_capture->add_buffer(indirect_buffer, false, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT, indirect_data_pointer, indirect_region_size * frames_in_flight);
+    stream_capture->add_buffer(host_m_matrix_buffer, false, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, host_data_pointer, uniform_region_size * frames_in_flight);
+    stream_capture->add_buffer(device_m_matrix_buffer, true, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, uniform_data, sizeof(UniformData));
+    stream_capture->add_buffer(instance_buffer, false, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, instance_data_pointer, instance_region_size * frames_in_flight);
+    stream_capture->add_image(texture->get_view(), texture->get_format(), texture->get_extent(), texture->read_levels(command_pool, queue));
+    stream_capture->add_layout(scene_layout, scene_bindings);
+    for (uint32_t pipeline : batch_pipelines) {
+        PipelineRegistry::State state = pipeline_registry->get_state(pipeline);
+        stream_capture->add_shader(state.vertex_shader, vertex_shader_code);
+        stream_capture->add_shader(state.fragment_shader, fragment_shader_code);
+        stream_capture->add_pipeline(pipeline_registry->get_pipeline(pipeline), state, render_target_format);
+    }
+    stream_capture->add_descriptor_set(descriptor_set, scene_layout, {
+        { 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, device_m_matrix_buffer, 0, sizeof(UniformData), VK_NULL_HANDLE },
+        { 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_NULL_HANDLE, 0, 0, texture->get_view() }
+    });
+    for (auto& output : outputs) {
+        for (RenderTarget& render_target : output.render_targets) {
+            stream_capture->add_target(render_target.framebuffer, render_target_format, output.render_target_extent);
+        }
+    }
+
+    size_t size = stream_capture->write(options.stream_capture_path);
+    std::cout << "Command stream of frame " << rendered_frames << " written to " << options.stream_capture_path << ": " << stream_capture->get_command_count()
+        << " commands, " << size / 1024.0 << " KiB" << std::endl;
+    stream_capture.reset();
+    is_stream_captured = true;
+}
+
+// the scene goes to the graphics queue, its post-processing to the compute queue once the scene semaphore is signaled
+void VulkanTriangle::submit_post_process(uint32_t frame) {
+    {
+        TRACE_SCOPE("record");
+        record_command_buffer(frame);
+    }
+    std::vector<PostProcess::Target> targets;
+    for (auto& output : outputs) {
+        RenderTarget& render_target = output.render_targets[frame];
+        targets.push_back({ render_target.view, render_target.post_image, render_target.post_view, render_target.rendered_extent });
+    }
+    VkQueryPool post_timestamp_query_pool = compute_timestamp_valid_bits != 0 ? timestamp_query_pool : VK_NULL_HANDLE;
+    VkCommandBuffer post_command_buffer = post_process->record(frame, targets, post_timestamp_query_pool, TIMESTAMPS_PER_FRAME * frame + TIMESTAMP_POST_BEGIN, TIMESTAMPS_PER_FRAME * frame + TIMESTAMP_POST_END);
+
+    TRACE_SCOPE("submit");
+    VkSubmitInfo submit_info = {
+        VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        nullptr,
+        0,
+        nullptr,
+        nullptr,
+        1,
+        &command_buffers[frame],
+        1,
+        &scene_finished_semaphores[frame]
+    };
+    vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE);
+
+    VkPipelineStageFlags pipeline_stage_flags = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+    VkSubmitInfo post_submit_info = {
+        VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        nullptr,
+        1,
+        &scene_finished_semaphores[frame],
+        &pipeline_stage_flags,
+        1,
+        &post_command_buffer,
+        1,
+        &post_finished_semaphores[frame]
+    };
+    vkQueueSubmit(compute_queue, 1, &post_submit_info, VK_NULL_HANDLE);
+}
+
+// upscales the rendered region, or its post-processed copy, of every acquired output to the whole swapchain image
+void VulkanTriangle::record_blit(VkCommandBuffer command_buffer, uint32_t frame) {
+    if (timestamp_query_pool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool, TIMESTAMPS_PER_FRAME * frame + TIMESTAMP_BLIT_BEGIN);
+    }
+
+    // layout transitions of all outputs are batched
+    std::vector<VkImageMemoryBarrier> image_memory_barriers;
+    for (auto& output : outputs) {
+        if (!output.is_acquired) { continue; }
+        image_memory_barriers.push_back({
+            VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            nullptr,
+            0,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            output.swapchain_images[output.image_index],
+            { VK_IMAGE_ASPECT_COLOR_BIT,0,1,0,1 }
+        });
+    }
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, image_memory_barriers.size(), image_memory_barriers.data());
+
+    for (auto& output : outputs) {
+        if (!output.is_acquired) { continue; }
+        RenderTarget& render_target = output.render_targets[frame % output.render_targets.size()];
+        VkImageBlit image_blit = {
+            { VK_IMAGE_ASPECT_COLOR_BIT,0,0,1 },
+            { { 0,0,0 }, { static_cast<int32_t>(render_target.rendered_extent.width), static_cast<int32_t>(render_target.rendered_extent.height), 1 } },
+            { VK_IMAGE_ASPECT_COLOR_BIT,0,0,1 },
+            { { 0,0,0 }, { static_cast<int32_t>(output.swapchain_create_info.imageExtent.width), static_cast<int32_t>(output.swapchain_create_info.imageExtent.height), 1 } }
+        };
+        if (post_process) {
+            vkCmdBlitImage(command_buffer, render_target.post_image, VK_IMAGE_LAYOUT_GENERAL, output.swapchain_images[output.image_index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &image_blit, blit_filter);
+        }
+        else {
+            vkCmdBlitImage(command_buffer, render_target.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, output.swapchain_images[output.image_index], VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &image_blit, blit_filter);
+        }
+    }
+
+    for (auto& image_memory_barrier : image_memory_barriers) {
+        image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        image_memory_barrier.dstAccessMask = 0;
+        image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    }
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, image_memory_barriers.size(), image_memory_barriers.data());
+
+    if (timestamp_query_pool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool, TIMESTAMPS_PER_FRAME * frame + TIMESTAMP_FRAME_END);
+    }
+}
+
+void VulkanTriangle::create_semaphores() {
+    // per frame in flight: an image acquired semaphore for each output, one rendering finished semaphore
+    // waited on by the single present of all outputs and a fence guarding the command buffer
+    VkSemaphoreCreateInfo semaphore_create_info = { VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, nullptr, 0 };
+    for (auto& output : outputs) {
+        output.acquire_semaphores.resize(frames_in_flight);
+        for (int i = 0; i < output.acquire_semaphores.size(); i++) {
+            vkCreateSemaphore(device, &semaphore_create_info, nullptr, &output.acquire_semaphores[i]);
+        }
+    }
+    render_finished_semaphores.resize(frames_in_flight);
+    for (int i = 0; i < render_finished_semaphores.size(); i++) {
+        vkCreateSemaphore(device, &semaphore_create_info, nullptr, &render_finished_semaphores[i]);
+    }
+    if (post_process) {
+        scene_finished_semaphores.resize(frames_in_flight);
+        post_finished_semaphores.resize(frames_in_flight);
+        for (int i = 0; i < frames_in_flight; i++) {
+            vkCreateSemaphore(device, &semaphore_create_info, nullptr, &scene_finished_semaphores[i]);
+            vkCreateSemaphore(device, &semaphore_create_info, nullptr, &post_finished_semaphores[i]);
+        }
+    }
+
+    VkFenceCreateInfo fence_create_info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr, VK_FENCE_CREATE_SIGNALED_BIT };
+    frame_fences.resize(frames_in_flight);
+    for (int i = 0; i < frame_fences.size(); i++) {
+        vkCreateFence(device, &fence_create_info, nullptr, &frame_fences[i]);
+    }
+}
+
+void VulkanTriangle::read_gpu_frame_time(uint32_t frame) {
+    // called after the frame's fence has been waited on, so the results are already available
+    if (timestamp_query_pool == VK_NULL_HANDLE || rendered_frames <= frames_in_flight) { return; }
+    // the post-process pair is only written when the compute queue supports timestamps
+    bool is_post_timed = post_process && compute_timestamp_valid_bits != 0;
+    uint32_t timestamps_count = is_post_timed ? TIMESTAMPS_PER_FRAME : TIMESTAMP_POST_BEGIN;
+    uint64_t timestamps[TIMESTAMPS_PER_FRAME] = {};
+    if (vkGetQueryPoolResults(device, timestamp_query_pool, TIMESTAMPS_PER_FRAME * frame, timestamps_count, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) != VK_SUCCESS) { return; }
+    uint64_t mask = timestamp_valid_bits == 64 ? UINT64_MAX : (1ull << timestamp_valid_bits) - 1;
+    auto to_cpu_ns = [this](uint64_t gpu_timestamp, int64_t clock_offset_ns) { return static_cast<int64_t>(gpu_timestamp * static_cast<double>(timestamp_period)) + clock_offset_ns; };
+    gpu_frame_msec = ((timestamps[TIMESTAMP_FRAME_END] - timestamps[TIMESTAMP_FRAME_BEGIN]) & mask) * timestamp_period / 1e6;
+    if (is_post_timed) {
+        uint64_t post_mask = compute_timestamp_valid_bits == 64 ? UINT64_MAX : (1ull << compute_timestamp_valid_bits) - 1;
+        gpu_post_msec = ((timestamps[TIMESTAMP_POST_END] - timestamps[TIMESTAMP_POST_BEGIN]) & post_mask) * timestamp_period / 1e6;
+
+        // frame N's post-processing against frame N+1's scene, whose queries are complete since it was submitted before frame N's blit
+        uint32_t next_frame = (frame + 1) % frames_in_flight;
+        uint64_t next_timestamps[TIMESTAMP_SCENE_END + 1];
+        if (vkGetQueryPoolResults(device, timestamp_query_pool, TIMESTAMPS_PER_FRAME * next_frame, TIMESTAMP_SCENE_END + 1, sizeof(next_timestamps), next_timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT) == VK_SUCCESS) {
+            // the two queues may count on different clocks, both are compared in CPU time
+            int64_t overlap_begin = std::max(to_cpu_ns(timestamps[TIMESTAMP_POST_BEGIN] & post_mask, compute_clock_offset_ns), to_cpu_ns(next_timestamps[TIMESTAMP_FRAME_BEGIN] & mask, gpu_clock_offset_ns));
+            int64_t overlap_end = std::min(to_cpu_ns(timestamps[TIMESTAMP_POST_END] & post_mask, compute_clock_offset_ns), to_cpu_ns(next_timestamps[TIMESTAMP_SCENE_END] & mask, gpu_clock_offset_ns));
+            total_post_msec += gpu_post_msec;
+            total_post_overlap_msec += overlap_end > overlap_begin ? (overlap_end - overlap_begin) / 1e6 : 0.0;
+        }
+    }
+    if (post_process) {
+        // the span from FRAME_BEGIN to FRAME_END includes the next frame's scene, count only this frame's own work
+        gpu_frame_msec = ((timestamps[TIMESTAMP_HUD_END] - timestamps[TIMESTAMP_FRAME_BEGIN]) & mask) * timestamp_period / 1e6 +
+            ((timestamps[TIMESTAMP_FRAME_END] - timestamps[TIMESTAMP_BLIT_BEGIN]) & mask) * timestamp_period / 1e6 + gpu_post_msec;
+    }
+    gpu_animation_msec = ((timestamps[TIMESTAMP_ANIMATION_END] - timestamps[TIMESTAMP_FRAME_BEGIN]) & mask) * timestamp_period / 1e6;
+    gpu_scene_msec = ((timestamps[TIMESTAMP_SCENE_END] - timestamps[TIMESTAMP_ANIMATION_END]) & mask) * timestamp_period / 1e6;
+    gpu_hud_msec = ((timestamps[TIMESTAMP_HUD_END] - timestamps[TIMESTAMP_SCENE_END]) & mask) * timestamp_period / 1e6;
+
+    if (trace::is_enabled()) {
+        uint64_t cpu_timestamps[TIMESTAMPS_PER_FRAME];
+        for (int i = 0; i < TIMESTAMP_POST_BEGIN; i++) {
+            cpu_timestamps[i] = static_cast<uint64_t>(to_cpu_ns(timestamps[i] & mask, gpu_clock_offset_ns));
+        }
+        if (is_post_timed) {
+            uint64_t post_mask = compute_timestamp_valid_bits == 64 ? UINT64_MAX : (1ull << compute_timestamp_valid_bits) - 1;
+            cpu_timestamps[TIMESTAMP_POST_BEGIN] = static_cast<uint64_t>(to_cpu_ns(timestamps[TIMESTAMP_POST_BEGIN] & post_mask, compute_clock_offset_ns));
+            cpu_timestamps[TIMESTAMP_POST_END] = static_cast<uint64_t>(to_cpu_ns(timestamps[TIMESTAMP_POST_END] & post_mask, compute_clock_offset_ns));
+        }
+        if (particle_animation) { trace::record_gpu("GPU particle animation", cpu_timestamps[TIMESTAMP_FRAME_BEGIN], cpu_timestamps[TIMESTAMP_ANIMATION_END]); }
+        trace::record_gpu("GPU scene", cpu_timestamps[TIMESTAMP_ANIMATION_END], cpu_timestamps[TIMESTAMP_SCENE_END]);
+        if (perf_hud) { trace::record_gpu("GPU HUD", cpu_timestamps[TIMESTAMP_SCENE_END], cpu_timestamps[TIMESTAMP_HUD_END]); }
+        trace::record_gpu("GPU upscale blit", cpu_timestamps[TIMESTAMP_BLIT_BEGIN], cpu_timestamps[TIMESTAMP_FRAME_END]);
+        if (is_post_timed) { trace::record_gpu("GPU post-process", cpu_timestamps[TIMESTAMP_POST_BEGIN], cpu_timestamps[TIMESTAMP_POST_END], true); }
+    }
+
+    if (dynamic_resolution) {
+        float scale = dynamic_resolution->update(gpu_frame_msec);
+        for (auto& output : outputs) {
+            output.render_extent = {
+                std::clamp(static_cast<uint32_t>(output.swapchain_create_info.imageExtent.width * scale), 1u, output.render_target_extent.width),
+                std::clamp(static_cast<uint32_t>(output.swapchain_create_info.imageExtent.height * scale), 1u, output.render_target_extent.height)
+            };
+        }
+    }
+}
+
+void VulkanTriangle::read_query_statistics(uint32_t frame) {
+    if (rendered_frames <= frames_in_flight) { return; }
+
+    // each result is followed by its availability value, queries not yet written by the GPU are skipped
+    uint64_t occlusion_results[2];
+    VkResult res = vkGetQueryPoolResults(device, occlusion_query_pool, frame, 1, sizeof(occlusion_results), occlusion_results, sizeof(occlusion_results), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if ((res != VK_SUCCESS && res != VK_NOT_READY) || occlusion_results[1] == 0) {
+        unavailable_query_results++;
+        return;
+    }
+    query_statistics.samples_passed = occlusion_results[0];
+
+    if (pipeline_statistics_query_pool != VK_NULL_HANDLE) {
+        uint64_t statistics_results[5];
+        res = vkGetQueryPoolResults(device, pipeline_statistics_query_pool, frame, 1, sizeof(statistics_results), statistics_results, sizeof(statistics_results), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if ((res != VK_SUCCESS && res != VK_NOT_READY) || statistics_results[4] == 0) {
+            unavailable_query_results++;
+            return;
+        }
+        query_statistics.vertex_invocations = statistics_results[0];
+        query_statistics.clipping_invocations = statistics_results[1];
+        query_statistics.clipping_primitives = statistics_results[2];
+        query_statistics.fragment_invocations = statistics_results[3];
+    }
+
+    // fragments shaded per pixel of the render area of all outputs, and primitives surviving clipping per second of scene time
+    uint64_t render_pixels = 0;
+    for (auto& output : outputs) {
+        render_pixels += static_cast<uint64_t>(output.render_extent.width) * output.render_extent.height;
+    }
+    query_statistics.overdraw_ratio = static_cast<double>(pipeline_statistics_query_pool != VK_NULL_HANDLE ? query_statistics.fragment_invocations : query_statistics.samples_passed) / render_pixels;
+    double scene_seconds = (gpu_scene_msec > 0.0 ? gpu_scene_msec : gpu_frame_msec) / 1000.0;
+    query_statistics.primitives_per_second = scene_seconds > 0.0 ? query_statistics.clipping_primitives / scene_seconds : 0.0;
+}
+
+// only the first output is captured
+void VulkanTriangle::create_frame_capture() {
+    if (options.capture_ring_size == 0) { return; }
+    const VkSwapchainCreateInfoKHR& swapchain_create_info = outputs[0].swapchain_create_info;
+    if (!(swapchain_create_info.imageUsage & VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+        std::cerr << "Frame capture disabled: swapchain images do not support transfer source usage" << std::endl;
+        return;
+    }
+    frame_capture = std::make_unique<FrameCapture>(device, physical_device_memory_properties, *memory_tracker, queue_family_index, options.capture_ring_size, options.capture_format, "capture_");
+    frame_capture->resize(swapchain_create_info.imageExtent, swapchain_create_info.imageFormat);
+}
+
+// created after the scene pipelines, so the registry keeps the scene render pass for the formats both passes share
+void VulkanTriangle::create_perf_hud() {
+    if (!options.hud) { return; }
+    perf_hud = std::make_unique<PerfHud>(device, physical_device_memory_properties, *memory_tracker, *pipeline_registry, render_target_format, render_target_layout,
+        frames_in_flight, options.hud_budget_msec, "shader//spirv_hud.vert", "shader//spirv_hud.frag");
+}
+
+// acquires every output, records and submits the commands ending in the swapchain images and presents them all at once;
+// with post-processing only the blit of the post-processed frame is left to record, the scene was submitted earlier
+bool VulkanTriangle::submit_and_present(uint32_t frame, bool is_post_processed) {
+    // an out of date output is recreated and skipped for this frame, the others are still rendered;
+    // outputs recreated after their post-processed frame was queued have nothing to show yet
+    VkResult res;
+    std::vector<VkSemaphore> wait_semaphores;
+    std::vector<VkSwapchainKHR> present_swapchains;
+    std::vector<uint32_t> present_image_indices;
+    std::vector<Output*> present_outputs;
+    {
+        TRACE_SCOPE("acquire");
+        for (auto& output : outputs) {
+            output.is_acquired = false;
+            if (is_post_processed && output.render_targets[frame].rendered_extent.width == 0) { continue; }
+            res = vkAcquireNextImageKHR(device, output.swapchain, UINT64_MAX, output.acquire_semaphores[frame], VK_NULL_HANDLE, &output.image_index);
+            output.is_acquired = res == VK_SUCCESS || res == VK_SUBOPTIMAL_KHR;
+            if (res == VK_ERROR_OUT_OF_DATE_KHR) {
+                on_window_resize(output);
+                continue;
+            }
+            else if (!output.is_acquired) {
+                throw ACQUIRE_NEXT_IMAGE_FAILED;
+            }
+            wait_semaphores.push_back(output.acquire_semaphores[frame]);
+            present_swapchains.push_back(output.swapchain);
+            present_image_indices.push_back(output.image_index);
+            present_outputs.push_back(&output);
+        }
+    }
+    // the post-processed frame is submitted even without outputs to wait on its semaphore and signal the fence
+    if (present_outputs.empty() && !is_post_processed) { return false; }
+    if (is_post_processed) {
+        wait_semaphores.push_back(post_finished_semaphores[frame]);
+    }
+
+    vkResetFences(device, 1, &frame_fences[frame]);
+    VkCommandBuffer command_buffer;
+    {
+        TRACE_SCOPE("record");
+        if (is_post_processed) {
+            command_buffer = present_command_buffers[frame];
+            VkCommandBufferBeginInfo command_buffer_begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr };
+            vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+            record_blit(command_buffer, frame);
+            vkEndCommandBuffer(command_buffer);
+        }
+        else {
+            command_buffer = command_buffers[frame];
+            record_command_buffer(frame);
+        }
+    }
+
+    // the capture copy is submitted after the frame with its own fence, completion is polled on later frames
+    VkCommandBuffer capture_command_buffer = VK_NULL_HANDLE;
+    VkFence capture_fence = VK_NULL_HANDLE;
+    if (frame_capture) {
+        frame_capture->poll();
+        bool capture_key_is_pressed = glfwGetKey(outputs[0].window, GLFW_KEY_F12) == GLFW_PRESS;
+        bool is_capture_frame = (capture_key_is_pressed && !capture_key_was_pressed) ||
+            (options.capture_interval && rendered_frames % options.capture_interval == 0);
+        capture_key_was_pressed = capture_key_is_pressed;
+        if (is_capture_frame && outputs[0].is_acquired) {
+            capture_command_buffer = frame_capture->record(outputs[0].swapchain_images[outputs[0].image_index], VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, rendered_frames, &capture_fence);
+        }
+    }
+
+    // waiting at the transfer stage lets the scene render before the swapchain image is available
+    {
+        TRACE_SCOPE("submit");
+        std::vector<VkPipelineStageFlags> pipeline_stage_flags(wait_semaphores.size(), VK_PIPELINE_STAGE_TRANSFER_BIT);
+        VkSubmitInfo submit_info = {
+            VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            nullptr,
+            static_cast<uint32_t>(wait_semaphores.size()),
+            wait_semaphores.data(),
+            pipeline_stage_flags.data(),
             1,
-            &swapchain,
-            &image_index
+            &command_buffer,
+            capture_command_buffer == VK_NULL_HANDLE && !present_outputs.empty() ? 1u : 0u,
+            &render_finished_semaphores[frame]
         };
+        vkQueueSubmit(queue, 1, &submit_info, frame_fences[frame]);
+        if (capture_command_buffer != VK_NULL_HANDLE) {
+            VkSubmitInfo capture_submit_info = {
+                VK_STRUCTURE_TYPE_SUBMIT_INFO,
+                nullptr,
+                0,
+                nullptr,
+                nullptr,
+                1,
+                &capture_command_buffer,
+                1,
+                &render_finished_semaphores[frame]
+            };
+            vkQueueSubmit(queue, 1, &capture_submit_info, capture_fence);
+        }
+    }
+
+    if (present_outputs.empty()) { return true; }
+
+    // a single present for all swapchains, the per swapchain results tell which outputs need to be recreated
+    std::vector<VkResult> present_results(present_swapchains.size(), VK_SUCCESS);
+    VkPresentInfoKHR present_info = {
+        VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
+        nullptr,
+        1,
+        &render_finished_semaphores[frame],
+        static_cast<uint32_t>(present_swapchains.size()),
+        present_swapchains.data(),
+        present_image_indices.data(),
+        present_results.data()
+    };
+    {
+        TRACE_SCOPE("present");
         res = vkQueuePresentKHR(queue, &present_info);
-        if (res == VK_SUBOPTIMAL_KHR || res == VK_ERROR_OUT_OF_DATE_KHR) {
-            on_window_resize();
+    }
+    if (!is_first_frame_presented) {
+        is_first_frame_presented = true;
+        std::cout << "Time to first frame msec: " << std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup_begin).count() << std::endl;
+    }
+    for (size_t i = 0; i < present_outputs.size(); i++) {
+        if (present_results[i] == VK_SUBOPTIMAL_KHR || present_results[i] == VK_ERROR_OUT_OF_DATE_KHR) {
+            on_window_resize(*present_outputs[i]);
         }
-        else if (res != VK_SUCCESS) {
+        else if (present_results[i] != VK_SUCCESS) {
             throw QUEUE_PRESENT_FAILED;
         }
-        glfwPollEvents();
+    }
+    if (res != VK_SUCCESS && res != VK_SUBOPTIMAL_KHR && res != VK_ERROR_OUT_OF_DATE_KHR) {
+        throw QUEUE_PRESENT_FAILED;
+    }
+    return true;
+}
+
+bool VulkanTriangle::is_any_window_closed() {
+    for (auto& output : outputs) {
+        if (glfwWindowShouldClose(output.window)) { return true; }
+    }
+    return false;
+}
+
+void VulkanTriangle::frame_loop() {
+    last_frame_begin = std::chrono::steady_clock::now();
+    while (!is_any_window_closed()) {
+        rendered_frames++;
+        modulus_result = rendered_frames % 1000;
+        if (modulus_result == 0) {
+            t1 = std::chrono::steady_clock::now();
+        }
+
+        TRACE_SCOPE("frame");
+        uint32_t frame = rendered_frames % frames_in_flight;
+        auto frame_begin = std::chrono::steady_clock::now();
+        cpu_frame_msec = std::chrono::duration<double, std::milli>(frame_begin - last_frame_begin).count();
+        last_frame_begin = frame_begin;
+        {
+            TRACE_SCOPE("wait frame fence");
+            vkWaitForFences(device, 1, &frame_fences[frame], VK_TRUE, UINT64_MAX);
+        }
+        cpu_wait_msec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frame_begin).count();
+        read_gpu_frame_time(frame);
+        read_query_statistics(frame);
+        if (options.mesh_reload_interval != 0 && rendered_frames % options.mesh_reload_interval == 0) { reload_meshes(); }
+
+        if (scene) {
+            // the camera turns around in the middle of the scene, so most objects are outside the frustum at any time
+            float angle = static_cast<float>(glfwGetTime() * 0.2f);
+            glm::mat4 view = glm::lookAt(camera_position, camera_position + glm::vec3(std::sin(angle), 0.0f, std::cos(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+            float aspect = static_cast<float>(outputs[0].window_size.width) / std::max(1u, outputs[0].window_size.height);
+            mv_matrix = glm::perspective(camera_fov, aspect, 0.1f, scene->get_radius() * 2.0f) * view;
+            TRACE_SCOPE("cull");
+            scene->update(static_cast<float>(glfwGetTime()));
+            scene->cull(mv_matrix);
+            total_cull_msec += scene->get_cull_msec() + scene->get_refit_msec();
+        }
+        else {
+            mv_matrix = glm::rotate(static_cast<float>(glfwGetTime() * 0.2f), glm::vec3(0.0f, 0.0f, 1.0f));
+        }
+        memcpy(static_cast<uint8_t*>(host_data_pointer) + uniform_region_size * frame, glm::value_ptr(mv_matrix), sizeof(mv_matrix));
+        VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, host_memory,uniform_region_size * frame,uniform_region_size };
+        vkFlushMappedMemoryRanges(device, 1, &mapped_memory_range);
+
+        if (post_process) {
+            // this frame's scene and post-processing are queued first, the previous frame is presented after them
+            uint32_t previous_frame = (frame + frames_in_flight - 1) % frames_in_flight;
+            submit_post_process(frame);
+            if (is_post_pending[previous_frame]) { submit_and_present(previous_frame, true); }
+            is_post_pending[frame] = true;
+            glfwPollEvents();
+        }
+        else if (submit_and_present(frame, false)) {
+            glfwPollEvents();
+        }
+        else {
+            // nothing was acquired, e.g. every window is minimized: the events still have to be pumped for the windows
+            // to be restored or closed, waiting on them briefly instead of spinning on acquire
+            glfwWaitEventsTimeout(0.1);
+        }
+
+        if (rendered_frames % 128 == 0) {
+            memory_tracker->update_budget();
+        }
+        bool memory_key_is_pressed = glfwGetKey(outputs[0].window, GLFW_KEY_F11) == GLFW_PRESS;
+        if (memory_key_is_pressed && !memory_key_was_pressed) {
+            std::string snapshot_path = "memory_snapshot_" + std::to_string(rendered_frames) + ".json";
+            memory_tracker->dump_json(snapshot_path);
+            std::cout << "Memory snapshot written to " << snapshot_path << std::endl;
+        }
+        memory_key_was_pressed = memory_key_is_pressed;
+        bool hud_key_is_pressed = glfwGetKey(outputs[0].window, GLFW_KEY_F10) == GLFW_PRESS;
+        if (hud_key_is_pressed && !hud_key_was_pressed) { is_hud_visible = !is_hud_visible; }
+        hud_key_was_pressed = hud_key_is_pressed;
 
         if (modulus_result == 0) {
             t2 = std::chrono::steady_clock::now();
             time_span = std::chrono::duration_cast<std::chrono::duration<double>>(t2 - t1);
             std::cout << "Msec/frame: " << time_span.count()*1000 << std::endl;
+            // frame cost against the total presented area, compare runs with different --windows counts for scaling
+            uint64_t output_pixels = 0;
+            for (auto& output : outputs) {
+                output_pixels += static_cast<uint64_t>(output.swapchain_create_info.imageExtent.width) * output.swapchain_create_info.imageExtent.height;
+            }
+            std::cout << "Outputs: " << outputs.size() << ", output pixels: " << output_pixels << ", nsec/output pixel: CPU " << time_span.count() * 1e9 / output_pixels;
+            if (timestamp_query_pool != VK_NULL_HANDLE) { std::cout << ", GPU " << gpu_frame_msec * 1e6 / output_pixels; }
+            std::cout << std::endl;
+            if (timestamp_query_pool != VK_NULL_HANDLE) {
+                std::cout << "GPU msec/frame: " << gpu_frame_msec << ", render size: " << outputs[0].render_extent.width << "x" << outputs[0].render_extent.height;
+                if (dynamic_resolution) { std::cout << " (scale " << dynamic_resolution->get_scale() << ", " << dynamic_resolution->get_changes() << " changes)"; }
+                std::cout << std::endl;
+            }
+            std::cout << "Samples passed: " << query_statistics.samples_passed << ", overdraw: " << query_statistics.overdraw_ratio;
+            if (pipeline_statistics_query_pool != VK_NULL_HANDLE) {
+                std::cout << ", vertex invocations: " << query_statistics.vertex_invocations << ", clipping primitives: " << query_statistics.clipping_invocations
+                    << " in / " << query_statistics.clipping_primitives << " out, fragment invocations: " << query_statistics.fragment_invocations
+                    << ", Mprimitives/s: " << query_statistics.primitives_per_second / 1e6;
+            }
+            std::cout << " (" << unavailable_query_results << " results not ready)" << std::endl;
+            if (post_process && timestamp_query_pool != VK_NULL_HANDLE && compute_timestamp_valid_bits != 0) {
+                std::cout << "Post-process GPU msec: " << gpu_post_msec << " on " << (compute_queue_family_index != queue_family_index ? "the async compute queue" : "the graphics queue")
+                    << ", overlapped with the next frame's scene: " << (total_post_msec > 0.0 ? 100.0 * total_post_overlap_msec / total_post_msec : 0.0) << "%" << std::endl;
+            }
+            if (particle_animation && timestamp_query_pool != VK_NULL_HANDLE) {
+                std::cout << "Particles: " << particle_animation->get_element_count() << " elements, GPU update msec: " << gpu_animation_msec
+                    << ", Gelements/s: " << (gpu_animation_msec > 0.0 ? particle_animation->get_element_count() / (gpu_animation_msec * 1e6) : 0.0) << std::endl;
+            }
+            if (scene) {
+                std::cout << "Scene: " << scene->get_object_count() << " objects, " << scene->get_draw_list().size() << " visible, cull msec: " << scene->get_cull_msec()
+                    << " on " << scene->get_worker_count() + 1 << " threads, refit msec: " << scene->get_refit_msec() << " (" << scene->get_refitted_nodes() << " nodes)"
+                    << ", average cull + refit msec/frame: " << total_cull_msec / 1000.0 << std::endl;
+                total_cull_msec = 0.0;
+            }
+            if (!particle_animation) {
+                std::cout << "LOD triangles submitted: " << total_lod_triangles / 1000 << " per frame, without LOD: " << total_full_triangles / 1000 << " ("
+                    << (total_full_triangles > 0 ? 100.0 * total_lod_triangles / total_full_triangles : 100.0) << "%), instances per LOD:";
+                std::vector<uint32_t> lod_instance_counts(mesh_lod->get_lods().size(), 0);
+                for (uint32_t batch = 0; batch < batch_instance_counts.size(); batch++) {
+                    lod_instance_counts[batch % lod_instance_counts.size()] += batch_instance_counts[batch];
+                }
+                for (uint32_t count : lod_instance_counts) {
+                    std::cout << " " << count;
+                }
+                std::cout << std::endl;
+                total_lod_triangles = 0;
+                total_full_triangles = 0;
+                geometry_pool->report(std::cout);
+            }
+            std::cout << "Per frame: " << total_bind_calls / 1000.0 << " bind calls, " << total_draw_calls / 1000.0 << " draw calls, " << total_draws / 1000.0 << " draws"
+                << (is_multi_draw_indirect_supported ? "" : " (no multiDrawIndirect, indirect commands drawn one by one)") << std::endl;
+            total_bind_calls = 0;
+            total_draw_calls = 0;
+            total_draws = 0;
+            texture->report(std::cout);
+            pipeline_registry->report(std::cout, 1000);
+            if (frame_capture) { frame_capture->report(std::cout); }
+            if (perf_hud) { perf_hud->report(std::cout); }
+            memory_tracker->report(std::cout);
         }
     }
 }
 
-void VulkanTriangle::on_window_resize() {
+void VulkanTriangle::on_window_resize(Output& output) {
+    TRACE_SCOPE("on_window_resize");
     vkDeviceWaitIdle(device);
 
     int width, height;
-    glfwGetWindowSize(window, &width, &height);
-    window_size = { static_cast<uint32_t>(width),static_cast<uint32_t>(height)};
-    create_surface();
-    old_swapchain = swapchain;
-    create_swapchain();
-    create_renderpass();
-    create_framebuffers();
-    create_pipeline();
-    vkResetCommandPool(device,command_pool,0);
-    record_command_buffers();
-}
-
-VulkanTriangle::VulkanTriangle() {
-    create_instance();
+    glfwGetWindowSize(output.window, &width, &height);
+    output.window_size = { static_cast<uint32_t>(width),static_cast<uint32_t>(height)};
+    output.old_swapchain = output.swapchain;
+    create_swapchain(output);
+    vkDestroySwapchainKHR(device, output.old_swapchain, nullptr);
+    output.old_swapchain = VK_NULL_HANDLE;
+    if (frame_capture && &output == &outputs[0]) { frame_capture->resize(output.swapchain_create_info.imageExtent, output.swapchain_create_info.imageFormat); }
+    // the pipeline uses dynamic viewport/scissor, only the render target depends on the swapchain size
+    destroy_render_target(output);
+    create_render_target(output);
+    create_dynamic_resolution();
+}
+
+// startup is a dependency graph: file I/O and mesh import overlap instance, window and device creation, buffers and
+// descriptors overlap the swapchains, and the steps using the command pool or the queue are chained one after the other
+VulkanTriangle::VulkanTriangle(const Options& options) : options(options) {
+    startup_begin = std::chrono::steady_clock::now();
+    trace::set_enabled(!options.trace_path.empty());
+    trace::set_thread_name("main");
+    TRACE_SCOPE("startup");
+
+    TaskGraph startup;
+    auto load_shaders_task = startup.add("load_shaders", [this] { load_shaders(); });
+    auto load_pipeline_cache_task = startup.add("load_pipeline_cache", [this] { load_pipeline_cache(); });
+    auto import_mesh_task = startup.add("import_mesh", [this] { import_mesh(); });
+    // GLFW must be initialized and its windows created on the main thread
+    auto instance_task = startup.add("create_instance", [this] { create_instance(); }, {}, true);
+    auto window_task = startup.add("create_window", [this] { create_window(); }, { instance_task }, true);
+    std::vector<TaskGraph::Task> device_dependencies = { startup.add("create_surface", [this] { create_surface(); }, { window_task }) };
 #ifndef NDEBUG
-    setup_debug_callback();
+    device_dependencies.push_back(startup.add("setup_debug_callback", [this] { setup_debug_callback(); }, { instance_task }));
 #endif
-    create_window();
-    create_surface();
-    create_logical_device();
-    create_swapchain();
-    create_command_pool();
-    allocate_command_buffers();
-    create_host_buffers();
-    create_device_buffers();
-    create_descriptor_pool();
-    allocate_descriptor_sets();
-    create_renderpass();
-    create_framebuffers();
-    create_pipeline();
-    upload_input_data();
-    record_command_buffers();
-    create_semaphores();
+    auto device_task = startup.add("create_logical_device", [this] { create_logical_device(); }, device_dependencies);
+
+    // create_window sizes outputs to the window count, the per-output steps only index into it
+    std::vector<TaskGraph::Task> swapchain_tasks;
+    for (uint32_t i = 0; i < options.window_count; i++) {
+        swapchain_tasks.push_back(startup.add("swapchain", [this, i] { create_swapchain(outputs[i]); }, { device_task }));
+    }
+    auto command_pool_task = startup.add("create_command_pool", [this] { create_command_pool(); }, { device_task });
+    auto command_buffers_task = startup.add("allocate_command_buffers", [this] { allocate_command_buffers(); }, { command_pool_task });
+    startup.add("create_host_buffers", [this] { create_host_buffers(); }, { device_task });
+    auto device_buffers_task = startup.add("create_device_buffers", [this] { create_device_buffers(); }, { device_task });
+    auto geometry_pool_task = startup.add("create_geometry_pool", [this] { create_geometry_pool(); }, { device_task, import_mesh_task });
+    auto descriptor_pool_task = startup.add("create_descriptor_pool", [this] { create_descriptor_pool(); }, { device_task });
+    auto texture_task = startup.add("create_texture", [this] { create_texture(); }, { device_task });
+    auto renderpass_task = startup.add("create_renderpass", [this] { create_renderpass(); }, { swapchain_tasks[0] });
+    std::vector<TaskGraph::Task> render_target_tasks;
+    for (uint32_t i = 0; i < options.window_count; i++) {
+        render_target_tasks.push_back(startup.add("render_target", [this, i] { create_render_target(outputs[i]); }, { renderpass_task, swapchain_tasks[i] }));
+    }
+    auto pipeline_cache_task = startup.add("create_pipeline_cache", [this] { create_pipeline_cache(); }, { device_task, load_pipeline_cache_task });
+    auto pipeline_registry_task = startup.add("create_pipeline_registry", [this] { create_pipeline_registry(); }, { pipeline_cache_task });
+    startup.add("allocate_descriptor_sets", [this] { allocate_descriptor_sets(); }, { descriptor_pool_task, device_buffers_task, texture_task, pipeline_registry_task });
+    auto pipeline_task = startup.add("create_pipeline", [this] { create_pipeline(); }, { renderpass_task, pipeline_registry_task, load_shaders_task, import_mesh_task });
+    startup.add("create_indirect_buffer", [this] { create_indirect_buffer(); }, { pipeline_task });
+    auto upload_task = startup.add("upload_input_data", [this] { upload_input_data(); }, { geometry_pool_task, command_buffers_task });
+    auto query_pools_task = startup.add("create_query_pools", [this] { create_query_pools(); }, { device_task });
+    auto calibrate_task = startup.add("calibrate_gpu_clock", [this] { calibrate_gpu_clock(); }, { query_pools_task, upload_task });
+    auto benchmark_task = startup.add("benchmark_particle_animation", [this] { benchmark_particle_animation(); }, { calibrate_task });
+    auto particle_task = startup.add("create_particle_animation", [this] { create_particle_animation(); }, { device_task });
+    startup.add("create_dynamic_resolution", [this] { create_dynamic_resolution(); }, render_target_tasks);
+    auto scene_task = startup.add("create_scene", [this] { create_scene(); }, { particle_task, import_mesh_task });
+    startup.add("create_instance_buffer", [this] { create_instance_buffer(); }, { scene_task });
+    auto post_process_task = startup.add("create_post_process", [this] { create_post_process(); }, { benchmark_task, window_task });
+    startup.add("create_semaphores", [this] { create_semaphores(); }, { post_process_task });
+    startup.add("create_frame_capture", [this] { create_frame_capture(); }, { swapchain_tasks[0] });
+    startup.add("create_perf_hud", [this] { create_perf_hud(); }, { pipeline_task });
+
+    startup.run(options.parallel_startup ? std::max(1u, std::thread::hardware_concurrency()) - 1 : 0);
+    startup.report(std::cout);
 }
 
 void VulkanTriangle::start_main_loop() {
@@ -908,38 +2344,175 @@ void VulkanTriangle::start_main_loop() {
 
 VulkanTriangle::~VulkanTriangle() {
     vkDeviceWaitIdle(device);
-    vkDestroyPipeline(device, pipeline, nullptr);
-    for (int i = 0; i < framebuffers.size(); i++) {
-        vkDestroyFramebuffer(device, framebuffers[i], nullptr);
-        vkDestroyImageView(device, swapchain_images_views[i], nullptr);
+    if (!options.memory_json_path.empty()) { memory_tracker->dump_json(options.memory_json_path); }
+    if (frame_capture) {
+        frame_capture->wait_idle();
+        frame_capture->report(std::cout);
+        frame_capture.reset();
+    }
+    particle_animation.reset();
+    post_process.reset();
+    scene.reset();
+    texture.reset();
+    geometry_pool.reset();
+    perf_hud.reset();
+    save_pipeline_cache();
+    vkDestroyPipelineCache(device, pipeline_cache, nullptr);
+    pipeline_registry.reset();
+    for (auto& output : outputs) {
+        destroy_render_target(output);
     }
     vkDestroyRenderPass(device, render_pass, nullptr);
-    vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
     vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
-    for (int i = 0; i < semaphores.size(); i++) {
-        vkDestroySemaphore(device, semaphores[i], nullptr);
+    for (auto& output : outputs) {
+        for (int i = 0; i < output.acquire_semaphores.size(); i++) {
+            vkDestroySemaphore(device, output.acquire_semaphores[i], nullptr);
+        }
+    }
+    for (int i = 0; i < render_finished_semaphores.size(); i++) {
+        vkDestroySemaphore(device, render_finished_semaphores[i], nullptr);
+    }
+    for (int i = 0; i < scene_finished_semaphores.size(); i++) {
+        vkDestroySemaphore(device, scene_finished_semaphores[i], nullptr);
+        vkDestroySemaphore(device, post_finished_semaphores[i], nullptr);
     }
+    for (int i = 0; i < frame_fences.size(); i++) {
+        vkDestroyFence(device, frame_fences[i], nullptr);
+    }
+    if (timestamp_query_pool != VK_NULL_HANDLE) { vkDestroyQueryPool(device, timestamp_query_pool, nullptr); }
+    if (pipeline_statistics_query_pool != VK_NULL_HANDLE) { vkDestroyQueryPool(device, pipeline_statistics_query_pool, nullptr); }
+    vkDestroyQueryPool(device, occlusion_query_pool, nullptr);
     vkUnmapMemory(device, host_memory);
-    vkDestroyBuffer(device, host_vertex_buffer, nullptr);
     vkDestroyBuffer(device, host_m_matrix_buffer, nullptr);
-    vkFreeMemory(device, host_memory, nullptr);
-    vkDestroyBuffer(device, device_vertex_buffer, nullptr);
+    memory_tracker->free(device, host_memory);
     vkDestroyBuffer(device, device_m_matrix_buffer, nullptr);
-    vkFreeMemory(device, device_memory, nullptr);
+    memory_tracker->free(device, device_memory);
+    vkDestroyBuffer(device, instance_buffer, nullptr);
+    memory_tracker->free(device, instance_memory);
+    vkDestroyBuffer(device, indirect_buffer, nullptr);
+    memory_tracker->free(device, indirect_memory);
     vkFreeCommandBuffers(device, command_pool, command_buffers.size(), command_buffers.data());
+    if (!present_command_buffers.empty()) { vkFreeCommandBuffers(device, command_pool, present_command_buffers.size(), present_command_buffers.data()); }
     vkDestroyCommandPool(device, command_pool, nullptr);
-    vkDestroySwapchainKHR(device, swapchain, nullptr);
+    for (auto& output : outputs) {
+        vkDestroySwapchainKHR(device, output.swapchain, nullptr);
+    }
+    memory_tracker.reset();
     vkDestroyDevice(device, nullptr);
-    vkDestroySurfaceKHR(instance, surface, nullptr);
-    glfwDestroyWindow(window);
+    for (auto& output : outputs) {
+        vkDestroySurfaceKHR(instance, output.surface, nullptr);
+        glfwDestroyWindow(output.window);
+    }
 #ifndef NDEBUG
     vkDestroyDebugReportCallbackEXT(instance, debug_report_callback, nullptr);
+    debug_message_sink.reset();
 #endif
     vkDestroyInstance(instance, nullptr);
+
+    if (trace::is_enabled()) {
+        if (trace::write_chrome_json(options.trace_path)) { std::cout << "Trace written to " << options.trace_path << std::endl; }
+        else { std::cerr << "Could not write trace to " << options.trace_path << std::endl; }
+    }
 }
 
-int main() {
-    VulkanTriangle vk_triangle;
+int main(int argc, char* argv[]) {
+    VulkanTriangle::Options options;
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--capture" && i + 1 < argc) {
+            options.capture_interval = std::stoul(argv[++i]);
+        }
+        else if (argument == "--capture-format" && i + 1 < argc) {
+            options.capture_format = std::string(argv[++i]) == "raw" ? FrameCapture::RAW : FrameCapture::PNG;
+        }
+        else if (argument == "--capture-ring" && i + 1 < argc) {
+            options.capture_ring_size = std::stoul(argv[++i]);
+        }
+        else if (argument == "--memory-json" && i + 1 < argc) {
+            options.memory_json_path = argv[++i];
+        }
+        else if (argument == "--trace" && i + 1 < argc) {
+            options.trace_path = argv[++i];
+        }
+        else if (argument == "--no-dynamic-resolution") {
+            options.dynamic_resolution = false;
+        }
+        else if (argument == "--target-gpu-msec" && i + 1 < argc) {
+            options.target_gpu_msec = std::stof(argv[++i]);
+        }
+        else if (argument == "--render-scale" && i + 2 < argc) {
+            options.min_render_scale = std::stof(argv[++i]);
+            options.max_render_scale = std::stof(argv[++i]);
+            // the render target is allocated at the swapchain size, so the scale cannot go above 1
+            if (!(options.min_render_scale > 0.0f && options.min_render_scale <= options.max_render_scale && options.max_render_scale <= 1.0f)) {
+                std::cerr << "Usage: --render-scale <min> <max>, with 0 < min <= max <= 1" << std::endl;
+                return 1;
+            }
+        }
+        else if (argument == "--particles" && i + 1 < argc) {
+            options.particle_count = std::stoul(argv[++i]);
+        }
+        else if (argument == "--particle-benchmark") {
+            options.particle_benchmark = true;
+        }
+        else if (argument == "--post-process" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            options.post_process = mode == "blur" ? PostProcess::BLUR : (mode == "tonemap" ? PostProcess::TONEMAP : PostProcess::NONE);
+        }
+        else if (argument == "--scene" && i + 1 < argc) {
+            options.scene_object_count = std::stoul(argv[++i]);
+        }
+        else if (argument == "--cull-threads" && i + 1 < argc) {
+            options.cull_thread_count = std::stoul(argv[++i]);
+        }
+        else if (argument == "--mesh-subdivisions" && i + 1 < argc) {
+            options.mesh_subdivisions = std::stoul(argv[++i]);
+        }
+        else if (argument == "--lod-error-pixels" && i + 1 < argc) {
+            options.lod_error_pixels = std::stof(argv[++i]);
+        }
+        else if (argument == "--serial-startup") {
+            options.parallel_startup = false;
+        }
+        else if (argument == "--pipeline-cache" && i + 1 < argc) {
+            options.pipeline_cache_path = argv[++i];
+        }
+        else if (argument == "--texture" && i + 1 < argc) {
+            options.texture_path = argv[++i];
+        }
+        else if (argument == "--texture-budget-mib" && i + 1 < argc) {
+            options.texture_budget_mib = std::stoul(argv[++i]);
+        }
+        else if (argument == "--texture-upload-kib" && i + 1 < argc) {
+            options.texture_upload_kib = std::max(1ul, std::stoul(argv[++i]));
+        }
+        else if (argument == "--materials" && i + 1 < argc) {
+            options.material_count = std::max(1ul, std::stoul(argv[++i]));
+        }
+        else if (argument == "--meshes" && i + 1 < argc) {
+            options.mesh_count = std::max(1ul, std::stoul(argv[++i]));
+        }
+        else if (argument == "--mesh-reload-interval" && i + 1 < argc) {
+            options.mesh_reload_interval = std::stoul(argv[++i]);
+        }
+        else if (argument == "--stream-capture" && i + 1 < argc) {
+            options.stream_capture_path = argv[++i];
+        }
+        else if (argument == "--stream-capture-frame" && i + 1 < argc) {
+            options.stream_capture_frame = std::stoul(argv[++i]);
+        }
+        else if (argument == "--windows" && i + 1 < argc) {
+            options.window_count = std::max(1ul, std::stoul(argv[++i]));
+        }
+        else if (argument == "--hud") {
+            options.hud = true;
+        }
+        else if (argument == "--hud-budget-msec" && i + 1 < argc) {
+            options.hud_budget_msec = std::stof(argv[++i]);
+        }
+    }
+
+    VulkanTriangle vk_triangle(options);
     vk_triangle.start_main_loop();
     return 0;
-}
\ No newline at end of file
+}
\ No newline at end of file
@@ -0,0 +1,278 @@
+#include "command_stream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+
+using namespace command_stream;
+
+template<typename T>
+uint32_t CommandStreamWriter::get_id(T handle) {
+    auto found = handle_ids.emplace((uint64_t)handle, static_cast<uint32_t>(is_id_added.size()));
+    if (found.second) { is_id_added.push_back(false); }
+    return found.first->second;
+}
+
+void CommandStreamWriter::begin_record(std::vector<char>& records, RecordType type) {
+    append(records, static_cast<uint32_t>(type));
+    append(records, uint32_t(0));
+    record_begin = records.size();
+}
+
+template<typename T>
+void CommandStreamWriter::append(std::vector<char>& records, const T& value) {
+    append_bytes(records, &value, sizeof(T));
+}
+
+void CommandStreamWriter::append_bytes(std::vector<char>& records, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    records.insert(records.end(), bytes, bytes + size);
+}
+
+// patches the payload size in front of the record
+void CommandStreamWriter::end_record(std::vector<char>& records) {
+    uint32_t size = static_cast<uint32_t>(records.size() - record_begin);
+    std::memcpy(records.data() + record_begin - sizeof(uint32_t), &size, sizeof(size));
+}
+
+void CommandStreamWriter::add_buffer(VkBuffer buffer, bool is_device_local, VkBufferUsageFlags usage, const void* data, VkDeviceSize size) {
+    uint32_t id = get_id(buffer);
+    is_id_added[id] = true;
+    begin_record(resources, BUFFER);
+    append(resources, id);
+    append(resources, static_cast<uint32_t>(is_device_local));
+    append(resources, usage);
+    append(resources, static_cast<uint64_t>(size));
+    append_bytes(resources, data, size);
+    end_record(resources);
+}
+
+void CommandStreamWriter::add_image(VkImageView image_view, VkFormat format, VkExtent2D extent, const std::vector<std::vector<char>>& levels) {
+    uint32_t id = get_id(image_view);
+    is_id_added[id] = true;
+    begin_record(resources, IMAGE);
+    append(resources, id);
+    append(resources, static_cast<uint32_t>(format));
+    append(resources, extent.width);
+    append(resources, extent.height);
+    append(resources, static_cast<uint32_t>(levels.size()));
+    for (const auto& level : levels) {
+        append(resources, static_cast<uint64_t>(level.size()));
+        append_bytes(resources, level.data(), level.size());
+    }
+    end_record(resources);
+}
+
+void CommandStreamWriter::add_target(VkFramebuffer framebuffer, VkFormat format, VkExtent2D extent) {
+    uint32_t id = get_id(framebuffer);
+    is_id_added[id] = true;
+    begin_record(resources, TARGET);
+    append(resources, id);
+    append(resources, static_cast<uint32_t>(format));
+    append(resources, extent.width);
+    append(resources, extent.height);
+    end_record(resources);
+}
+
+void CommandStreamWriter::add_shader(uint32_t shader, const std::vector<char>& code) {
+    if (std::find(added_shaders.begin(), added_shaders.end(), shader) != added_shaders.end()) { return; }
+    added_shaders.push_back(shader);
+    begin_record(resources, SHADER);
+    append(resources, shader);
+    append_bytes(resources, code.data(), code.size());
+    end_record(resources);
+}
+
+void CommandStreamWriter::add_layout(uint32_t layout, const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+    if (std::find(added_layouts.begin(), added_layouts.end(), layout) != added_layouts.end()) { return; }
+    added_layouts.push_back(layout);
+    begin_record(resources, LAYOUT);
+    append(resources, layout);
+    append(resources, static_cast<uint32_t>(bindings.size()));
+    for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+        append(resources, binding.binding);
+        append(resources, static_cast<uint32_t>(binding.descriptorType));
+        append(resources, binding.descriptorCount);
+        append(resources, binding.stageFlags);
+    }
+    end_record(resources);
+}
+
+// the state is stored as it is, its render pass id is replaced by the attachment format on replay
+void CommandStreamWriter::add_pipeline(VkPipeline pipeline, const PipelineRegistry::State& state, VkFormat target_format) {
+    uint32_t id = get_id(pipeline);
+    is_id_added[id] = true;
+    begin_record(resources, PIPELINE);
+    append(resources, id);
+    append(resources, static_cast<uint32_t>(target_format));
+    append(resources, state);
+    end_record(resources);
+}
+
+void CommandStreamWriter::add_descriptor_set(VkDescriptorSet descriptor_set, uint32_t layout, const std::vector<DescriptorWrite>& writes) {
+    uint32_t id = get_id(descriptor_set);
+    is_id_added[id] = true;
+    begin_record(resources, DESCRIPTOR_SET);
+    append(resources, id);
+    append(resources, layout);
+    append(resources, static_cast<uint32_t>(writes.size()));
+    for (const DescriptorWrite& write : writes) {
+        append(resources, write.binding);
+        append(resources, static_cast<uint32_t>(write.type));
+        append(resources, write.image_view != VK_NULL_HANDLE ? get_id(write.image_view) : get_id(write.buffer));
+        append(resources, static_cast<uint64_t>(write.offset));
+        append(resources, static_cast<uint64_t>(write.range));
+    }
+    end_record(resources);
+}
+
+void CommandStreamWriter::copy_buffer(VkBuffer source, VkBuffer destination, const VkBufferCopy& region) {
+    begin_record(commands, COPY_BUFFER);
+    append(commands, get_id(source));
+    append(commands, get_id(destination));
+    append(commands, static_cast<uint64_t>(region.srcOffset));
+    append(commands, static_cast<uint64_t>(region.dstOffset));
+    append(commands, static_cast<uint64_t>(region.size));
+    end_record(commands);
+    command_count++;
+}
+
+void CommandStreamWriter::pipeline_barrier(VkPipelineStageFlags source_stages, VkPipelineStageFlags destination_stages, const VkMemoryBarrier& memory_barrier) {
+    begin_record(commands, PIPELINE_BARRIER);
+    append(commands, source_stages);
+    append(commands, destination_stages);
+    append(commands, memory_barrier.srcAccessMask);
+    append(commands, memory_barrier.dstAccessMask);
+    end_record(commands);
+    command_count++;
+}
+
+void CommandStreamWriter::bind_descriptor_set(uint32_t layout, VkDescriptorSet descriptor_set) {
+    begin_record(commands, BIND_DESCRIPTOR_SET);
+    append(commands, layout);
+    append(commands, get_id(descriptor_set));
+    end_record(commands);
+    command_count++;
+}
+
+void CommandStreamWriter::bind_pipeline(VkPipeline pipeline) {
+    begin_record(commands, BIND_PIPELINE);
+    append(commands, get_id(pipeline));
+    end_record(commands);
+    command_count++;
+}
+
+void CommandStreamWriter::bind_vertex_buffer(uint32_t binding, VkBuffer buffer, VkDeviceSize offset) {
+    begin_record(commands, BIND_VERTEX_BUFFER);
+    append(commands, binding);
+    append(commands, get_id(buffer));
+    append(commands, static_cast<uint64_t>(offset));
+    end_record(commands);
+    command_count++;
+}
+
+void CommandStreamWriter::bind_index_buffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType index_type) {
+    begin_record(commands, BIND_INDEX_BUFFER);
+    append(commands, get_id(buffer));
+    append(commands, static_cast<uint64_t>(offset));
+    append(commands, static_cast<uint32_t>(index_type));
+    end_record(commands);
+    command_count++;
+}
+
+// viewport and scissor cover the extent, as when recording the scene
+void CommandStreamWriter::begin_render_pass(VkFramebuffer framebuffer, VkExtent2D extent, const VkClearValue& clear_value) {
+    begin_record(commands, BEGIN_RENDER_PASS);
+    append(commands, get_id(framebuffer));
+    append(commands, extent.width);
+    append(commands, extent.height);
+    append(commands, clear_value.color.float32);
+    end_record(commands);
+    command_count++;
+}
+
+void CommandStreamWriter::draw(uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance) {
+    begin_record(commands, DRAW);
+    append(commands, vertex_count);
+    append(commands, instance_count);
+    append(commands, first_vertex);
+    append(commands, first_instance);
+    end_record(commands);
+    command_count++;
+}
+
+void CommandStreamWriter::draw_indexed(uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance) {
+    begin_record(commands, DRAW_INDEXED);
+    append(commands, index_count);
+    append(commands, instance_count);
+    append(commands, first_index);
+    append(commands, vertex_offset);
+    append(commands, first_instance);
+    end_record(commands);
+    command_count++;
+}
+
+void CommandStreamWriter::draw_indexed_indirect(VkBuffer buffer, VkDeviceSize offset, uint32_t draw_count, uint32_t stride) {
+    begin_record(commands, DRAW_INDEXED_INDIRECT);
+    append(commands, get_id(buffer));
+    append(commands, static_cast<uint64_t>(offset));
+    append(commands, draw_count);
+    append(commands, stride);
+    end_record(commands);
+    command_count++;
+}
+
+void CommandStreamWriter::end_render_pass() {
+    begin_record(commands, END_RENDER_PASS);
+    end_record(commands);
+    command_count++;
+}
+
+size_t CommandStreamWriter::write(const std::string& path) const {
+    if (std::find(is_id_added.begin(), is_id_added.end(), false) != is_id_added.end()) { throw STREAM_RESOURCE_MISSING; }
+    std::ofstream file(path, std::ios::out | std::ios::binary);
+    uint32_t header[2] = { magic, version };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file.write(resources.data(), resources.size());
+    file.write(commands.data(), commands.size());
+    if (!file) { throw STREAM_FILE_WRITE_FAILED; }
+    return sizeof(header) + resources.size() + commands.size();
+}
+
+CommandStreamReader::CommandStreamReader(const std::string& path) {
+    std::ifstream file(path, std::ios::in | std::ios::binary);
+    if (!file) { throw STREAM_FILE_READ_FAILED; }
+    data.resize(std::filesystem::file_size(path));
+    file.read(data.data(), data.size());
+    uint32_t header[2];
+    if (data.size() < sizeof(header)) { throw STREAM_FILE_READ_FAILED; }
+    std::memcpy(header, data.data(), sizeof(header));
+    if (header[0] != magic || header[1] != version) { throw STREAM_FILE_READ_FAILED; }
+    record_end = sizeof(header);
+    position = record_end;
+}
+
+bool CommandStreamReader::next() {
+    position = record_end;
+    if (position == data.size()) { return false; }
+    record_end = data.size();
+    uint32_t record_type = read<uint32_t>();
+    uint32_t size = read<uint32_t>();
+    if (size > data.size() - position) { throw STREAM_FILE_READ_FAILED; }
+    type = static_cast<RecordType>(record_type);
+    record_end = position + size;
+    return true;
+}
+
+void CommandStreamReader::read_bytes(void* destination, size_t size) {
+    if (size > record_end - position) { throw STREAM_FILE_READ_FAILED; }
+    std::memcpy(destination, data.data() + position, size);
+    position += size;
+}
+
+std::vector<char> CommandStreamReader::read_bytes(size_t size) {
+    std::vector<char> bytes(size);
+    read_bytes(bytes.data(), size);
+    return bytes;
+}
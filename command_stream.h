@@ -0,0 +1,128 @@
+#pragma once
+#include "volk.h"
+#include "pipeline_registry.h"
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Binary capture of one frame of VulkanTriangle: the buffers, images and render targets the frame uses with their
+// contents, its shaders, layouts, pipelines and descriptor set, and the commands of its scene render passes.
+// replay.cpp re-executes it without GLFW or a swapchain. The file is a header followed by records, each a type,
+// a payload size and the payload, little-endian; resources come before the commands and are referred to by ids.
+namespace command_stream {
+    constexpr uint32_t magic = 0x53435456;
+    constexpr uint32_t version = 2;
+
+    typedef enum RecordType {
+        // resources: id first
+        BUFFER = 1,
+        IMAGE = 2,
+        TARGET = 3,
+        SHADER = 4,
+        LAYOUT = 5,
+        PIPELINE = 6,
+        DESCRIPTOR_SET = 7,
+        // commands, in recording order
+        COPY_BUFFER = 16,
+        PIPELINE_BARRIER = 17,
+        BIND_DESCRIPTOR_SET = 18,
+        BIND_PIPELINE = 19,
+        BIND_VERTEX_BUFFER = 20,
+        BIND_INDEX_BUFFER = 21,
+        BEGIN_RENDER_PASS = 22,
+        DRAW = 23,
+        DRAW_INDEXED = 24,
+        END_RENDER_PASS = 25,
+        DRAW_INDEXED_INDIRECT = 26
+    } RecordType;
+
+    typedef enum Errors {
+        STREAM_FILE_WRITE_FAILED = -1,
+        STREAM_FILE_READ_FAILED = -2,
+        STREAM_RESOURCE_MISSING = -3
+    } Errors;
+}
+
+// Handles are turned into ids the first time they are seen, by a resource or a command, so resources can be
+// added after the commands that use them, once the frame has written their contents
+class CommandStreamWriter {
+public:
+    typedef struct DescriptorWrite {
+        uint32_t binding;
+        VkDescriptorType type;
+        VkBuffer buffer;
+        VkDeviceSize offset;
+        VkDeviceSize range;
+        VkImageView image_view;
+    } DescriptorWrite;
+
+    void add_buffer(VkBuffer buffer, bool is_device_local, VkBufferUsageFlags usage, const void* data, VkDeviceSize size);
+    void add_image(VkImageView image_view, VkFormat format, VkExtent2D extent, const std::vector<std::vector<char>>& levels);
+    void add_target(VkFramebuffer framebuffer, VkFormat format, VkExtent2D extent);
+    // shaders and layouts keep their PipelineRegistry ids, which is what the pipeline states refer to
+    void add_shader(uint32_t shader, const std::vector<char>& code);
+    void add_layout(uint32_t layout, const std::vector<VkDescriptorSetLayoutBinding>& bindings);
+    void add_pipeline(VkPipeline pipeline, const PipelineRegistry::State& state, VkFormat target_format);
+    void add_descriptor_set(VkDescriptorSet descriptor_set, uint32_t layout, const std::vector<DescriptorWrite>& writes);
+
+    void copy_buffer(VkBuffer source, VkBuffer destination, const VkBufferCopy& region);
+    void pipeline_barrier(VkPipelineStageFlags source_stages, VkPipelineStageFlags destination_stages, const VkMemoryBarrier& memory_barrier);
+    void bind_descriptor_set(uint32_t layout, VkDescriptorSet descriptor_set);
+    void bind_pipeline(VkPipeline pipeline);
+    void bind_vertex_buffer(uint32_t binding, VkBuffer buffer, VkDeviceSize offset);
+    void bind_index_buffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType index_type);
+    void begin_render_pass(VkFramebuffer framebuffer, VkExtent2D extent, const VkClearValue& clear_value);
+    void draw(uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex, uint32_t first_instance);
+    void draw_indexed(uint32_t index_count, uint32_t instance_count, uint32_t first_index, int32_t vertex_offset, uint32_t first_instance);
+    void draw_indexed_indirect(VkBuffer buffer, VkDeviceSize offset, uint32_t draw_count, uint32_t stride);
+    void end_render_pass();
+
+    uint32_t get_command_count() const { return command_count; }
+    // returns the size of the file
+    size_t write(const std::string& path) const;
+
+private:
+    template<typename T>
+    uint32_t get_id(T handle);
+    void begin_record(std::vector<char>& records, command_stream::RecordType type);
+    template<typename T>
+    void append(std::vector<char>& records, const T& value);
+    void append_bytes(std::vector<char>& records, const void* data, size_t size);
+    void end_record(std::vector<char>& records);
+
+    std::unordered_map<uint64_t, uint32_t> handle_ids;
+    std::vector<bool> is_id_added;
+    std::vector<uint32_t> added_shaders;
+    std::vector<uint32_t> added_layouts;
+    std::vector<char> resources;
+    std::vector<char> commands;
+    size_t record_begin = 0;
+    uint32_t command_count = 0;
+};
+
+// Walks the records of a capture; read() fails when a payload is shorter than what is read from it
+class CommandStreamReader {
+public:
+    CommandStreamReader(const std::string& path);
+
+    bool next();
+    command_stream::RecordType get_type() const { return type; }
+    size_t get_remaining_size() const { return record_end - position; }
+    size_t get_size() const { return data.size(); }
+    template<typename T>
+    T read() {
+        T value;
+        read_bytes(&value, sizeof(T));
+        return value;
+    }
+    void read_bytes(void* destination, size_t size);
+    std::vector<char> read_bytes(size_t size);
+
+private:
+    std::vector<char> data;
+    size_t record_end;
+    size_t position;
+    command_stream::RecordType type;
+};
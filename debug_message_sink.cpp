@@ -0,0 +1,125 @@
+#include "debug_message_sink.h"
+
+#include <cstring>
+
+namespace {
+    constexpr auto drain_interval = std::chrono::milliseconds(5);
+    constexpr auto rate_window = std::chrono::seconds(1);
+}
+
+DebugMessageSink::DebugMessageSink(uint32_t max_messages_per_code_per_second, std::ostream& stream) :
+    cells(new Cell[capacity]),
+    max_messages_per_code_per_second(max_messages_per_code_per_second),
+    stream(stream) {
+    for (size_t i = 0; i < capacity; i++) {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    drain_thread = std::thread(&DebugMessageSink::drain_loop, this);
+}
+
+DebugMessageSink::~DebugMessageSink() {
+    stop_thread = true;
+    drain_thread.join();
+    report(stream);
+}
+
+// bounded multi-producer queue, the driver may call back from any thread; when full the message is counted and dropped
+bool DebugMessageSink::push(VkDebugReportFlagsEXT flags, int32_t code, const char* layer_prefix, const char* message) {
+    size_t position = enqueue_position.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true) {
+        cell = &cells[position & (capacity - 1)];
+        size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+        if (difference == 0) {
+            if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) { break; }
+        }
+        else if (difference < 0) {
+            dropped_messages.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        else {
+            position = enqueue_position.load(std::memory_order_relaxed);
+        }
+    }
+
+    cell->message.flags = flags;
+    cell->message.code = code;
+    strncpy(cell->message.layer_prefix, layer_prefix ? layer_prefix : "", sizeof(cell->message.layer_prefix) - 1);
+    cell->message.layer_prefix[sizeof(cell->message.layer_prefix) - 1] = '\0';
+    strncpy(cell->message.text, message ? message : "", sizeof(cell->message.text) - 1);
+    cell->message.text[sizeof(cell->message.text) - 1] = '\0';
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool DebugMessageSink::pop(Message& message) {
+    Cell* cell = &cells[dequeue_position & (capacity - 1)];
+    if (cell->sequence.load(std::memory_order_acquire) != dequeue_position + 1) { return false; }
+    message = cell->message;
+    cell->sequence.store(dequeue_position + capacity, std::memory_order_release);
+    dequeue_position++;
+    return true;
+}
+
+void DebugMessageSink::drain_loop() {
+    Message message;
+    while (true) {
+        bool is_stopping = stop_thread;
+        bool has_printed = false;
+        auto now = std::chrono::steady_clock::now();
+        while (pop(message)) {
+            handle(message, now);
+            has_printed = true;
+        }
+        flush_suppressed(now, is_stopping);
+        if (has_printed) { stream.flush(); }
+        if (is_stopping) { return; }
+        std::this_thread::sleep_for(drain_interval);
+    }
+}
+
+void DebugMessageSink::handle(const Message& message, std::chrono::steady_clock::time_point now) {
+    CodeCounters& counters = code_counters[message.code];
+    counters.received++;
+    counters.is_error |= (message.flags & VK_DEBUG_REPORT_ERROR_BIT_EXT) != 0;
+    if (now - counters.window_start >= rate_window) {
+        flush_suppressed(now, false);
+        counters.window_start = now;
+        counters.printed_in_window = 0;
+    }
+    if (counters.printed_in_window >= max_messages_per_code_per_second) {
+        counters.suppressed++;
+        counters.suppressed_in_window++;
+        return;
+    }
+    counters.printed_in_window++;
+    counters.printed++;
+    stream << ((message.flags & VK_DEBUG_REPORT_ERROR_BIT_EXT) ? "ERROR: [" : "WARNING: [") << message.layer_prefix << "] Code " << message.code << " : " << message.text << '\n';
+}
+
+void DebugMessageSink::flush_suppressed(std::chrono::steady_clock::time_point now, bool force) {
+    for (auto& code_counter : code_counters) {
+        CodeCounters& counters = code_counter.second;
+        if (counters.suppressed_in_window == 0 || (!force && now - counters.window_start < rate_window)) { continue; }
+        stream << (counters.is_error ? "ERROR" : "WARNING") << ": Code " << code_counter.first << " repeated " << counters.suppressed_in_window << " more times" << '\n';
+        counters.suppressed_in_window = 0;
+    }
+}
+
+// only called once the drain thread has stopped
+void DebugMessageSink::report(std::ostream& stream) {
+    uint64_t received = 0, printed = 0, suppressed = 0;
+    for (auto& code_counter : code_counters) {
+        received += code_counter.second.received;
+        printed += code_counter.second.printed;
+        suppressed += code_counter.second.suppressed;
+    }
+    if (received == 0 && dropped_messages == 0) { return; }
+    // dropped messages never reached the drain thread, so their codes are unknown and only the total is reported
+    stream << "Validation messages: " << received << " received, " << printed << " printed, " << suppressed << " suppressed, " << dropped_messages << " dropped in total" << std::endl;
+    for (auto& code_counter : code_counters) {
+        const CodeCounters& counters = code_counter.second;
+        stream << "  Code " << code_counter.first << ": " << counters.received << " received, " << counters.printed << " printed, " << counters.suppressed << " suppressed" << std::endl;
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <map>
+#include <memory>
+
+// Receives validation messages from vulkan_helper::debug_callback without blocking the driver thread:
+// messages are copied into a lock-free ring buffer and a background thread prints them,
+// deduplicated by message code and rate limited per code.
+class DebugMessageSink {
+public:
+    DebugMessageSink(uint32_t max_messages_per_code_per_second = 5, std::ostream& stream = std::cerr);
+    ~DebugMessageSink();
+
+    bool push(VkDebugReportFlagsEXT flags, int32_t code, const char* layer_prefix, const char* message);
+    void report(std::ostream& stream);
+
+private:
+    struct Message {
+        VkDebugReportFlagsEXT flags;
+        int32_t code;
+        char layer_prefix[32];
+        char text[1024];
+    };
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Message message;
+    };
+
+    struct CodeCounters {
+        uint64_t received = 0;
+        uint64_t printed = 0;
+        uint64_t suppressed = 0;
+        uint64_t suppressed_in_window = 0;
+        uint32_t printed_in_window = 0;
+        std::chrono::steady_clock::time_point window_start;
+        bool is_error = false;
+    };
+
+    bool pop(Message& message);
+    void drain_loop();
+    void handle(const Message& message, std::chrono::steady_clock::time_point now);
+    void flush_suppressed(std::chrono::steady_clock::time_point now, bool force);
+
+    static constexpr size_t capacity = 1024;
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<size_t> enqueue_position = 0;
+    alignas(64) size_t dequeue_position = 0;
+
+    uint32_t max_messages_per_code_per_second;
+    std::ostream& stream;
+    std::atomic<uint64_t> dropped_messages = 0;
+    std::atomic<bool> stop_thread = false;
+    std::thread drain_thread;
+    std::map<int32_t, CodeCounters> code_counters;
+};
@@ -0,0 +1,44 @@
+#include "dynamic_resolution.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace {
+    constexpr double smoothing_factor = 0.1;
+    constexpr float scale_step = 1.0f / 32.0f;
+    constexpr float dead_band = 0.05f;
+    constexpr uint32_t frames_between_changes = 8;
+}
+
+DynamicResolution::DynamicResolution(float target_msec, float min_scale, float max_scale) :
+    target_msec(target_msec),
+    min_scale(min_scale),
+    max_scale(max_scale),
+    scale(max_scale) {
+    // validated by the caller, std::clamp in update() needs min <= max
+    assert(min_scale > 0.0f && min_scale <= max_scale && max_scale <= 1.0f);
+}
+
+float DynamicResolution::update(double gpu_msec) {
+    smoothed_msec = smoothed_msec == 0.0 ? gpu_msec : smoothed_msec + smoothing_factor * (gpu_msec - smoothed_msec);
+    if (++frames_since_change < frames_between_changes || smoothed_msec <= 0.0) { return scale; }
+
+    double ratio = target_msec / smoothed_msec;
+    if (std::abs(ratio - 1.0) < dead_band) { return scale; }
+
+    // damp the correction and snap to fixed steps, growing more cautiously than shrinking
+    float desired_scale = scale * static_cast<float>(std::sqrt(ratio));
+    desired_scale = ratio > 1.0 ? scale + (desired_scale - scale) * 0.5f : desired_scale;
+    desired_scale = std::round(desired_scale / scale_step) * scale_step;
+    desired_scale = std::clamp(desired_scale, min_scale, max_scale);
+
+    if (desired_scale != scale) {
+        // predict the cost at the new scale so frames still in flight at the old one do not cause overshoot
+        smoothed_msec *= (desired_scale * desired_scale) / (scale * scale);
+        scale = desired_scale;
+        frames_since_change = 0;
+        changes++;
+    }
+    return scale;
+}
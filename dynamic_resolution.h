@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+
+// Chooses the render scale that keeps the measured GPU frame time close to a target.
+// Pixel cost is assumed to grow with the square of the scale, measurements are smoothed
+// and small corrections are ignored so the resolution does not change every frame.
+class DynamicResolution {
+public:
+    DynamicResolution(float target_msec, float min_scale, float max_scale);
+
+    float update(double gpu_msec);
+    float get_scale() const { return scale; }
+    double get_smoothed_msec() const { return smoothed_msec; }
+    uint32_t get_changes() const { return changes; }
+
+private:
+    float target_msec;
+    float min_scale;
+    float max_scale;
+    float scale;
+    double smoothed_msec = 0.0;
+    uint32_t frames_since_change = 0;
+    uint32_t changes = 0;
+};
@@ -0,0 +1,350 @@
+#include "frame_capture.h"
+#include "vulkan_helper.h"
+#include "trace.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+
+namespace {
+    uint32_t crc32_table[256];
+
+    void init_crc32_table() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            }
+            crc32_table[i] = c;
+        }
+    }
+
+    uint32_t crc32(uint32_t crc, const uint8_t* data, size_t size) {
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++) {
+            crc = crc32_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return ~crc;
+    }
+
+    void push_u32_be(std::vector<uint8_t>& out, uint32_t value) {
+        out.push_back(value >> 24);
+        out.push_back(value >> 16);
+        out.push_back(value >> 8);
+        out.push_back(value);
+    }
+
+    void write_png_chunk(std::ofstream& file, const char* type, const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> chunk;
+        chunk.reserve(data.size() + 12);
+        push_u32_be(chunk, static_cast<uint32_t>(data.size()));
+        chunk.insert(chunk.end(), type, type + 4);
+        chunk.insert(chunk.end(), data.begin(), data.end());
+        push_u32_be(chunk, crc32(0, chunk.data() + 4, data.size() + 4));
+        file.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+    }
+
+    // PNG with stored (uncompressed) deflate blocks: encoding cost stays close to a memcpy,
+    // which is what lets the worker keep up with captures at full frame rate
+    void write_png(const std::string& path, uint32_t width, uint32_t height, const uint8_t* rgba, bool swap_red_blue) {
+        std::vector<uint8_t> raw;
+        raw.reserve((width * 3 + 1) * height);
+        for (uint32_t y = 0; y < height; y++) {
+            raw.push_back(0);
+            const uint8_t* row = rgba + static_cast<size_t>(y) * width * 4;
+            for (uint32_t x = 0; x < width; x++) {
+                raw.push_back(row[x * 4 + (swap_red_blue ? 2 : 0)]);
+                raw.push_back(row[x * 4 + 1]);
+                raw.push_back(row[x * 4 + (swap_red_blue ? 0 : 2)]);
+            }
+        }
+
+        std::vector<uint8_t> zlib = { 0x78, 0x01 };
+        zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+        uint32_t a = 1, b = 0;
+        size_t offset = 0;
+        do {
+            size_t block_size = std::min<size_t>(raw.size() - offset, 65535);
+            zlib.push_back(offset + block_size == raw.size() ? 1 : 0);
+            zlib.push_back(block_size & 0xFF);
+            zlib.push_back(block_size >> 8);
+            zlib.push_back(~block_size & 0xFF);
+            zlib.push_back((~block_size >> 8) & 0xFF);
+            zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + block_size);
+            for (size_t i = offset; i < offset + block_size; i++) {
+                a = (a + raw[i]) % 65521;
+                b = (b + a) % 65521;
+            }
+            offset += block_size;
+        } while (offset < raw.size());
+        push_u32_be(zlib, (b << 16) | a);
+
+        std::vector<uint8_t> header;
+        push_u32_be(header, width);
+        push_u32_be(header, height);
+        header.insert(header.end(), { 8, 2, 0, 0, 0 });
+
+        std::ofstream file(path, std::ios::out | std::ios::binary);
+        const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+        file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+        write_png_chunk(file, "IHDR", header);
+        write_png_chunk(file, "IDAT", zlib);
+        write_png_chunk(file, "IEND", {});
+    }
+}
+
+FrameCapture::FrameCapture(VkDevice device, const VkPhysicalDeviceMemoryProperties& physical_device_memory_properties, MemoryTracker& memory_tracker, uint32_t queue_family_index, uint32_t ring_size, Format format, std::string output_prefix) :
+    device(device),
+    physical_device_memory_properties(physical_device_memory_properties),
+    memory_tracker(memory_tracker),
+    format(format),
+    output_prefix(output_prefix),
+    slots(ring_size) {
+    init_crc32_table();
+
+    VkCommandPoolCreateInfo command_pool_create_info = {
+        VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        nullptr,
+        VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        queue_family_index
+    };
+    if (vkCreateCommandPool(device, &command_pool_create_info, nullptr, &command_pool)) { throw READBACK_COMMAND_POOL_CREATION_FAILED; }
+
+    VkFenceCreateInfo fence_create_info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,nullptr,0 };
+    for (auto& slot : slots) {
+        VkCommandBufferAllocateInfo command_buffer_allocate_info = {
+            VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+            nullptr,
+            command_pool,
+            VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+            1
+        };
+        vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &slot.command_buffer);
+        vkCreateFence(device, &fence_create_info, nullptr, &slot.fence);
+    }
+
+    start_time = std::chrono::steady_clock::now();
+    worker = std::thread(&FrameCapture::worker_loop, this);
+}
+
+FrameCapture::~FrameCapture() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stop_worker = true;
+    }
+    queue_condition.notify_one();
+    worker.join();
+
+    destroy_readback_buffers();
+    for (auto& slot : slots) {
+        vkDestroyFence(device, slot.fence, nullptr);
+    }
+    vkDestroyCommandPool(device, command_pool, nullptr);
+}
+
+void FrameCapture::resize(VkExtent2D extent, VkFormat format) {
+    wait_idle();
+    destroy_readback_buffers();
+    this->extent = extent;
+    image_format = format;
+    image_size = static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+    create_readback_buffers();
+}
+
+void FrameCapture::create_readback_buffers() {
+    for (auto& slot : slots) {
+        VkBufferCreateInfo buffer_create_info = {
+            VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            nullptr,
+            0,
+            image_size,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_SHARING_MODE_EXCLUSIVE,
+            0,
+            nullptr
+        };
+        if (vkCreateBuffer(device, &buffer_create_info, nullptr, &slot.buffer) != VK_SUCCESS) { throw READBACK_BUFFER_CREATION_FAILED; }
+
+        VkMemoryRequirements memory_requirements;
+        vkGetBufferMemoryRequirements(device, slot.buffer, &memory_requirements);
+
+        // cached memory makes the worker's reads fast, fall back to any host visible type
+        uint32_t memory_index = vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, static_cast<VkMemoryPropertyFlagBits>(VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT));
+        if (memory_index == VK_MAX_MEMORY_TYPES) {
+            memory_index = vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        }
+        is_memory_coherent = physical_device_memory_properties.memoryTypes[memory_index].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+        VkMemoryAllocateInfo memory_allocate_info = {
+            VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            nullptr,
+            memory_requirements.size,
+            memory_index
+        };
+        if (memory_tracker.allocate(device, memory_allocate_info, image_size, "capture_readback", &slot.memory) != VK_SUCCESS) { throw READBACK_MEMORY_ALLOCATION_FAILED; }
+        vkBindBufferMemory(device, slot.buffer, slot.memory, 0);
+        vkMapMemory(device, slot.memory, 0, VK_WHOLE_SIZE, 0, &slot.data_pointer);
+    }
+}
+
+void FrameCapture::destroy_readback_buffers() {
+    for (auto& slot : slots) {
+        if (slot.buffer == VK_NULL_HANDLE) { continue; }
+        vkUnmapMemory(device, slot.memory);
+        vkDestroyBuffer(device, slot.buffer, nullptr);
+        memory_tracker.free(device, slot.memory);
+        slot.buffer = VK_NULL_HANDLE;
+        slot.memory = VK_NULL_HANDLE;
+        slot.data_pointer = nullptr;
+    }
+}
+
+VkCommandBuffer FrameCapture::record(VkImage image, VkImageLayout image_layout, uint64_t frame_number, VkFence* fence) {
+    Slot& slot = slots[next_slot];
+    if (slot.state != SLOT_FREE) {
+        dropped_frames++;
+        return VK_NULL_HANDLE;
+    }
+    next_slot = (next_slot + 1) % slots.size();
+
+    VkCommandBufferBeginInfo command_buffer_begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr };
+    vkBeginCommandBuffer(slot.command_buffer, &command_buffer_begin_info);
+
+    VkImageMemoryBarrier image_memory_barrier = {
+        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        nullptr,
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_ACCESS_TRANSFER_READ_BIT,
+        image_layout,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        image,
+        { VK_IMAGE_ASPECT_COLOR_BIT,0,1,0,1 }
+    };
+    vkCmdPipelineBarrier(slot.command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+
+    VkBufferImageCopy buffer_image_copy = {
+        0,
+        0,
+        0,
+        { VK_IMAGE_ASPECT_COLOR_BIT,0,0,1 },
+        { 0,0,0 },
+        { extent.width,extent.height,1 }
+    };
+    vkCmdCopyImageToBuffer(slot.command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, slot.buffer, 1, &buffer_image_copy);
+
+    image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    image_memory_barrier.dstAccessMask = 0;
+    image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    image_memory_barrier.newLayout = image_layout;
+    VkBufferMemoryBarrier buffer_memory_barrier = {
+        VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        nullptr,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_ACCESS_HOST_READ_BIT,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        slot.buffer,
+        0,
+        VK_WHOLE_SIZE
+    };
+    vkCmdPipelineBarrier(slot.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 1, &buffer_memory_barrier, 1, &image_memory_barrier);
+    vkEndCommandBuffer(slot.command_buffer);
+
+    slot.frame_number = frame_number;
+    slot.state = SLOT_GPU_PENDING;
+    captured_frames++;
+    *fence = slot.fence;
+    return slot.command_buffer;
+}
+
+void FrameCapture::poll() {
+    for (uint32_t i = 0; i < slots.size(); i++) {
+        if (slots[i].state != SLOT_GPU_PENDING || vkGetFenceStatus(device, slots[i].fence) != VK_SUCCESS) { continue; }
+        vkResetFences(device, 1, &slots[i].fence);
+        slots[i].state = SLOT_ENCODING;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            encode_queue.push_back(i);
+        }
+        queue_condition.notify_one();
+    }
+}
+
+void FrameCapture::wait_idle() {
+    for (auto& slot : slots) {
+        if (slot.state == SLOT_GPU_PENDING) {
+            vkWaitForFences(device, 1, &slot.fence, VK_TRUE, UINT64_MAX);
+        }
+    }
+    poll();
+    std::unique_lock<std::mutex> lock(queue_mutex);
+    idle_condition.wait(lock, [this] {
+        for (auto& slot : slots) {
+            if (slot.state != SLOT_FREE) { return false; }
+        }
+        return true;
+    });
+}
+
+void FrameCapture::worker_loop() {
+    trace::set_thread_name("capture worker");
+    while (true) {
+        uint32_t slot_index;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_condition.wait(lock, [this] { return stop_worker || !encode_queue.empty(); });
+            if (encode_queue.empty()) { return; }
+            slot_index = encode_queue.front();
+            encode_queue.pop_front();
+        }
+
+        auto t1 = std::chrono::steady_clock::now();
+        encode(slots[slot_index]);
+        auto t2 = std::chrono::steady_clock::now();
+        encode_nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t1).count();
+        encoded_frames++;
+        encoded_bytes += image_size;
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex);
+            slots[slot_index].state = SLOT_FREE;
+        }
+        idle_condition.notify_all();
+    }
+}
+
+void FrameCapture::encode(Slot& slot) {
+    TRACE_SCOPE("capture encode");
+    if (!is_memory_coherent) {
+        VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, slot.memory,0,VK_WHOLE_SIZE };
+        vkInvalidateMappedMemoryRanges(device, 1, &mapped_memory_range);
+    }
+
+    bool is_bgra = image_format == VK_FORMAT_B8G8R8A8_UNORM || image_format == VK_FORMAT_B8G8R8A8_SRGB;
+    bool is_rgba = image_format == VK_FORMAT_R8G8B8A8_UNORM || image_format == VK_FORMAT_R8G8B8A8_SRGB;
+
+    std::ostringstream path;
+    path << output_prefix << std::setw(6) << std::setfill('0') << slot.frame_number;
+    if (format == PNG && (is_bgra || is_rgba)) {
+        path << ".png";
+        write_png(path.str(), extent.width, extent.height, static_cast<const uint8_t*>(slot.data_pointer), is_bgra);
+    }
+    else {
+        path << "_" << extent.width << "x" << extent.height << "_" << image_format << ".raw";
+        std::ofstream file(path.str(), std::ios::out | std::ios::binary);
+        file.write(static_cast<const char*>(slot.data_pointer), image_size);
+    }
+}
+
+void FrameCapture::report(std::ostream& stream) {
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start_time;
+    uint64_t frames = encoded_frames;
+    double encode_msec = frames ? encode_nanoseconds / 1e6 / frames : 0.0;
+    stream << "Capture: " << captured_frames << " submitted, " << frames << " encoded, " << dropped_frames << " dropped, "
+        << frames / elapsed.count() << " frames/s, "
+        << encoded_bytes / elapsed.count() / (1024.0 * 1024.0) << " MB/s, "
+        << encode_msec << " msec/encode" << std::endl;
+}
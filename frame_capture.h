@@ -0,0 +1,88 @@
+#pragma once
+#include "volk.h"
+#include "memory_tracker.h"
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <deque>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+// Copies selected swapchain images into a ring of host-visible readback buffers.
+// Completion is polled through fences from the render loop, encoding is done by a worker thread.
+class FrameCapture {
+public:
+    typedef enum Format {
+        RAW,
+        PNG
+    } Format;
+
+    FrameCapture(VkDevice device, const VkPhysicalDeviceMemoryProperties& physical_device_memory_properties, MemoryTracker& memory_tracker, uint32_t queue_family_index, uint32_t ring_size, Format format, std::string output_prefix);
+    ~FrameCapture();
+
+    void resize(VkExtent2D extent, VkFormat format);
+    VkCommandBuffer record(VkImage image, VkImageLayout image_layout, uint64_t frame_number, VkFence* fence);
+    void poll();
+    void wait_idle();
+    void report(std::ostream& stream);
+
+    typedef enum Errors {
+        READBACK_COMMAND_POOL_CREATION_FAILED = -1,
+        READBACK_BUFFER_CREATION_FAILED = -2,
+        READBACK_MEMORY_ALLOCATION_FAILED = -3
+    } Errors;
+
+private:
+    typedef enum SlotState {
+        SLOT_FREE,
+        SLOT_GPU_PENDING,
+        SLOT_ENCODING
+    } SlotState;
+
+    struct Slot {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        void* data_pointer = nullptr;
+        VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        uint64_t frame_number = 0;
+        std::atomic<SlotState> state = SLOT_FREE;
+    };
+
+    void create_readback_buffers();
+    void destroy_readback_buffers();
+    void worker_loop();
+    void encode(Slot& slot);
+
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties physical_device_memory_properties;
+    MemoryTracker& memory_tracker;
+    VkCommandPool command_pool;
+    Format format;
+    std::string output_prefix;
+
+    VkExtent2D extent = { 0,0 };
+    VkFormat image_format = VK_FORMAT_UNDEFINED;
+    VkDeviceSize image_size = 0;
+    bool is_memory_coherent = false;
+    std::vector<Slot> slots;
+    uint32_t next_slot = 0;
+
+    std::thread worker;
+    std::mutex queue_mutex;
+    std::condition_variable queue_condition;
+    std::condition_variable idle_condition;
+    std::deque<uint32_t> encode_queue;
+    bool stop_worker = false;
+
+    std::chrono::steady_clock::time_point start_time;
+    uint64_t captured_frames = 0;
+    uint64_t dropped_frames = 0;
+    std::atomic<uint64_t> encoded_frames = 0;
+    std::atomic<uint64_t> encoded_bytes = 0;
+    std::atomic<uint64_t> encode_nanoseconds = 0;
+};
@@ -0,0 +1,284 @@
+#include "geometry_pool.h"
+#include "vulkan_helper.h"
+
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+
+GeometryPool::GeometryPool(VkDevice device, const VkPhysicalDeviceMemoryProperties& physical_device_memory_properties, MemoryTracker& memory_tracker,
+    uint32_t vertex_stride, uint32_t vertex_capacity, uint32_t index_capacity, uint32_t frames_in_flight) :
+    device(device),
+    physical_device_memory_properties(physical_device_memory_properties),
+    memory_tracker(memory_tracker),
+    vertex_stride(vertex_stride),
+    vertex_capacity(vertex_capacity),
+    index_capacity(index_capacity),
+    frames_in_flight(frames_in_flight) {
+    // moved meshes are copied out and back in, so the pool buffers are transfer sources as well
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    vertex_buffer = create_buffer(static_cast<VkDeviceSize>(vertex_capacity) * vertex_stride, usage | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "geometry_pool", &vertex_memory);
+    index_buffer = create_buffer(static_cast<VkDeviceSize>(index_capacity) * sizeof(uint32_t), usage | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "geometry_pool", &index_memory);
+    free_vertices.push_back({ 0, vertex_capacity });
+    free_indices.push_back({ 0, index_capacity });
+}
+
+GeometryPool::~GeometryPool() {
+    for (RetiredBuffer& retired_buffer : retired_buffers) {
+        vkDestroyBuffer(device, retired_buffer.buffer, nullptr);
+        memory_tracker.free(device, retired_buffer.memory);
+    }
+    vkDestroyBuffer(device, index_buffer, nullptr);
+    memory_tracker.free(device, index_memory);
+    vkDestroyBuffer(device, vertex_buffer, nullptr);
+    memory_tracker.free(device, vertex_memory);
+}
+
+VkBuffer GeometryPool::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlagBits memory_properties, const std::string& tag, VkDeviceMemory* memory) {
+    VkBufferCreateInfo buffer_create_info = {
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        nullptr,
+        0,
+        size,
+        usage,
+        VK_SHARING_MODE_EXCLUSIVE,
+        0,
+        nullptr
+    };
+    VkBuffer buffer;
+    if (vkCreateBuffer(device, &buffer_create_info, nullptr, &buffer) != VK_SUCCESS) { throw GEOMETRY_POOL_BUFFER_CREATION_FAILED; }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memory_requirements);
+    VkMemoryAllocateInfo memory_allocate_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        nullptr,
+        memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, memory_properties)
+    };
+    if (memory_tracker.allocate(device, memory_allocate_info, size, tag, memory) != VK_SUCCESS) { throw GEOMETRY_POOL_MEMORY_ALLOCATION_FAILED; }
+    vkBindBufferMemory(device, buffer, *memory, 0);
+    return buffer;
+}
+
+bool GeometryPool::allocate(std::vector<Range>& free_ranges, uint32_t count, uint32_t* offset) {
+    for (size_t i = 0; i < free_ranges.size(); i++) {
+        if (free_ranges[i].count < count) { continue; }
+        *offset = free_ranges[i].offset;
+        free_ranges[i].offset += count;
+        free_ranges[i].count -= count;
+        if (free_ranges[i].count == 0) { free_ranges.erase(free_ranges.begin() + i); }
+        return true;
+    }
+    return false;
+}
+
+void GeometryPool::release(std::vector<Range>& free_ranges, Range range) {
+    auto next = std::lower_bound(free_ranges.begin(), free_ranges.end(), range, [](const Range& a, const Range& b) { return a.offset < b.offset; });
+    if (next != free_ranges.end() && range.offset + range.count == next->offset) {
+        range.count += next->count;
+        next = free_ranges.erase(next);
+    }
+    if (next != free_ranges.begin() && std::prev(next)->offset + std::prev(next)->count == range.offset) {
+        std::prev(next)->count += range.count;
+        return;
+    }
+    free_ranges.insert(next, range);
+}
+
+uint32_t GeometryPool::get_free_count(const std::vector<Range>& free_ranges) {
+    uint32_t count = 0;
+    for (const Range& range : free_ranges) {
+        count += range.count;
+    }
+    return count;
+}
+
+// a mesh that fits the free space but no single hole in it gets the pool compacted right away
+uint32_t GeometryPool::add_mesh(const void* vertices, uint32_t vertex_count, const std::vector<uint32_t>& indices) {
+    uint32_t index_count = static_cast<uint32_t>(indices.size());
+    if (get_free_count(free_vertices) < vertex_count || get_free_count(free_indices) < index_count) { throw GEOMETRY_POOL_FULL; }
+    uint32_t first_vertex;
+    uint32_t first_index;
+    if (!allocate(free_vertices, vertex_count, &first_vertex) || !allocate(free_indices, index_count, &first_index)) {
+        compact();
+        allocate(free_vertices, vertex_count, &first_vertex);
+        allocate(free_indices, index_count, &first_index);
+    }
+
+    uint32_t mesh = 0;
+    while (mesh < entries.size() && entries[mesh].is_live) { mesh++; }
+    if (mesh == entries.size()) { entries.emplace_back(); }
+    Entry& entry = entries[mesh];
+    entry.mesh = { first_vertex, vertex_count, first_index, index_count };
+    entry.is_live = true;
+    entry.is_uploaded = false;
+    const char* vertex_bytes = static_cast<const char*>(vertices);
+    entry.vertex_data.assign(vertex_bytes, vertex_bytes + static_cast<size_t>(vertex_count) * vertex_stride);
+    entry.indices = indices;
+    return mesh;
+}
+
+void GeometryPool::remove_mesh(uint32_t mesh) {
+    Entry& entry = entries[mesh];
+    release(free_vertices, { entry.mesh.first_vertex, entry.mesh.vertex_count });
+    release(free_indices, { entry.mesh.first_index, entry.mesh.index_count });
+    entry.is_live = false;
+    entry.vertex_data.clear();
+    entry.vertex_data.shrink_to_fit();
+    entry.indices.clear();
+    entry.indices.shrink_to_fit();
+    is_compaction_pending = true;
+}
+
+// live meshes keep their order and are packed from the start of the buffers, only new offsets are assigned here
+void GeometryPool::compact() {
+    std::vector<uint32_t> live_meshes;
+    for (uint32_t mesh = 0; mesh < entries.size(); mesh++) {
+        if (entries[mesh].is_live) { live_meshes.push_back(mesh); }
+    }
+    std::sort(live_meshes.begin(), live_meshes.end(), [this](uint32_t a, uint32_t b) { return entries[a].mesh.first_vertex < entries[b].mesh.first_vertex; });
+    uint32_t vertex_count = 0;
+    for (uint32_t mesh : live_meshes) {
+        entries[mesh].mesh.first_vertex = vertex_count;
+        vertex_count += entries[mesh].mesh.vertex_count;
+    }
+    std::sort(live_meshes.begin(), live_meshes.end(), [this](uint32_t a, uint32_t b) { return entries[a].mesh.first_index < entries[b].mesh.first_index; });
+    uint32_t index_count = 0;
+    for (uint32_t mesh : live_meshes) {
+        entries[mesh].mesh.first_index = index_count;
+        index_count += entries[mesh].mesh.index_count;
+    }
+
+    free_vertices.clear();
+    free_indices.clear();
+    if (vertex_count < vertex_capacity) { free_vertices.push_back({ vertex_count, vertex_capacity - vertex_count }); }
+    if (index_count < index_capacity) { free_indices.push_back({ index_count, index_capacity - index_count }); }
+    is_compaction_pending = false;
+    compactions++;
+}
+
+// moved meshes go through a scratch buffer, so their old and new ranges may overlap. The first barrier makes the
+// copies wait for earlier frames still drawing from the ranges that are overwritten, and for earlier updates
+void GeometryPool::record_updates(VkCommandBuffer command_buffer) {
+    for (auto retired_buffer = retired_buffers.begin(); retired_buffer != retired_buffers.end();) {
+        if (--retired_buffer->frames_left > 0) {
+            retired_buffer++;
+            continue;
+        }
+        vkDestroyBuffer(device, retired_buffer->buffer, nullptr);
+        memory_tracker.free(device, retired_buffer->memory);
+        retired_buffer = retired_buffers.erase(retired_buffer);
+    }
+    if (is_compaction_pending) { compact(); }
+
+    std::vector<VkBufferCopy> vertex_copies_out;
+    std::vector<VkBufferCopy> vertex_copies_in;
+    std::vector<VkBufferCopy> index_copies_out;
+    std::vector<VkBufferCopy> index_copies_in;
+    std::vector<VkBufferCopy> vertex_uploads;
+    std::vector<VkBufferCopy> index_uploads;
+    VkDeviceSize scratch_size = 0;
+    VkDeviceSize staging_size = 0;
+    for (const Entry& entry : entries) {
+        if (!entry.is_live) { continue; }
+        VkDeviceSize vertex_size = static_cast<VkDeviceSize>(entry.mesh.vertex_count) * vertex_stride;
+        VkDeviceSize index_size = static_cast<VkDeviceSize>(entry.mesh.index_count) * sizeof(uint32_t);
+        if (!entry.is_uploaded) {
+            vertex_uploads.push_back({ staging_size, static_cast<VkDeviceSize>(entry.mesh.first_vertex) * vertex_stride, vertex_size });
+            staging_size += vertex_size;
+            index_uploads.push_back({ staging_size, static_cast<VkDeviceSize>(entry.mesh.first_index) * sizeof(uint32_t), index_size });
+            staging_size += index_size;
+            continue;
+        }
+        if (entry.resident_first_vertex != entry.mesh.first_vertex) {
+            vertex_copies_out.push_back({ static_cast<VkDeviceSize>(entry.resident_first_vertex) * vertex_stride, scratch_size, vertex_size });
+            vertex_copies_in.push_back({ scratch_size, static_cast<VkDeviceSize>(entry.mesh.first_vertex) * vertex_stride, vertex_size });
+            scratch_size += vertex_size;
+        }
+        if (entry.resident_first_index != entry.mesh.first_index) {
+            index_copies_out.push_back({ static_cast<VkDeviceSize>(entry.resident_first_index) * sizeof(uint32_t), scratch_size, index_size });
+            index_copies_in.push_back({ scratch_size, static_cast<VkDeviceSize>(entry.mesh.first_index) * sizeof(uint32_t), index_size });
+            scratch_size += index_size;
+        }
+    }
+    if (scratch_size == 0 && staging_size == 0) { return; }
+
+    VkMemoryBarrier memory_barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT };
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+    if (scratch_size > 0) {
+        VkDeviceMemory scratch_memory;
+        VkBuffer scratch_buffer = create_buffer(scratch_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "geometry_pool_scratch", &scratch_memory);
+        if (!vertex_copies_out.empty()) { vkCmdCopyBuffer(command_buffer, vertex_buffer, scratch_buffer, static_cast<uint32_t>(vertex_copies_out.size()), vertex_copies_out.data()); }
+        if (!index_copies_out.empty()) { vkCmdCopyBuffer(command_buffer, index_buffer, scratch_buffer, static_cast<uint32_t>(index_copies_out.size()), index_copies_out.data()); }
+        memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+        if (!vertex_copies_in.empty()) { vkCmdCopyBuffer(command_buffer, scratch_buffer, vertex_buffer, static_cast<uint32_t>(vertex_copies_in.size()), vertex_copies_in.data()); }
+        if (!index_copies_in.empty()) { vkCmdCopyBuffer(command_buffer, scratch_buffer, index_buffer, static_cast<uint32_t>(index_copies_in.size()), index_copies_in.data()); }
+        retired_buffers.push_back({ scratch_buffer, scratch_memory, frames_in_flight });
+        moved_bytes += scratch_size;
+    }
+
+    if (staging_size > 0) {
+        VkDeviceMemory staging_memory;
+        VkBuffer staging_buffer = create_buffer(staging_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, "geometry_pool_staging", &staging_memory);
+        void* staging_data_pointer;
+        vkMapMemory(device, staging_memory, 0, VK_WHOLE_SIZE, 0, &staging_data_pointer);
+        size_t upload = 0;
+        for (const Entry& entry : entries) {
+            if (!entry.is_live || entry.is_uploaded) { continue; }
+            std::memcpy(static_cast<char*>(staging_data_pointer) + vertex_uploads[upload].srcOffset, entry.vertex_data.data(), entry.vertex_data.size());
+            std::memcpy(static_cast<char*>(staging_data_pointer) + index_uploads[upload].srcOffset, entry.indices.data(), entry.indices.size() * sizeof(uint32_t));
+            upload++;
+        }
+        VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, staging_memory, 0, VK_WHOLE_SIZE };
+        vkFlushMappedMemoryRanges(device, 1, &mapped_memory_range);
+        vkUnmapMemory(device, staging_memory);
+        vkCmdCopyBuffer(command_buffer, staging_buffer, vertex_buffer, static_cast<uint32_t>(vertex_uploads.size()), vertex_uploads.data());
+        vkCmdCopyBuffer(command_buffer, staging_buffer, index_buffer, static_cast<uint32_t>(index_uploads.size()), index_uploads.data());
+        retired_buffers.push_back({ staging_buffer, staging_memory, frames_in_flight });
+        uploaded_bytes += staging_size;
+    }
+
+    memory_barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+    for (Entry& entry : entries) {
+        if (!entry.is_live) { continue; }
+        entry.resident_first_vertex = entry.mesh.first_vertex;
+        entry.resident_first_index = entry.mesh.first_index;
+        entry.is_uploaded = true;
+    }
+}
+
+std::vector<char> GeometryPool::get_vertex_data() const {
+    std::vector<char> data;
+    for (const Entry& entry : entries) {
+        if (!entry.is_live) { continue; }
+        size_t offset = static_cast<size_t>(entry.mesh.first_vertex) * vertex_stride;
+        data.resize(std::max(data.size(), offset + entry.vertex_data.size()));
+        std::memcpy(data.data() + offset, entry.vertex_data.data(), entry.vertex_data.size());
+    }
+    return data;
+}
+
+std::vector<char> GeometryPool::get_index_data() const {
+    std::vector<char> data;
+    for (const Entry& entry : entries) {
+        if (!entry.is_live) { continue; }
+        size_t offset = static_cast<size_t>(entry.mesh.first_index) * sizeof(uint32_t);
+        size_t size = entry.indices.size() * sizeof(uint32_t);
+        data.resize(std::max(data.size(), offset + size));
+        std::memcpy(data.data() + offset, entry.indices.data(), size);
+    }
+    return data;
+}
+
+void GeometryPool::report(std::ostream& stream) {
+    uint32_t live_meshes = 0;
+    for (const Entry& entry : entries) {
+        if (entry.is_live) { live_meshes++; }
+    }
+    stream << "Geometry pool: " << live_meshes << " meshes, vertices " << vertex_capacity - get_free_count(free_vertices) << "/" << vertex_capacity << " in "
+        << free_vertices.size() << " free ranges, indices " << index_capacity - get_free_count(free_indices) << "/" << index_capacity << " in " << free_indices.size()
+        << " free ranges, " << compactions << " compactions, moved: " << moved_bytes / 1024.0 << " KiB, uploaded: " << uploaded_bytes / 1024.0 << " KiB" << std::endl;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include "volk.h"
+#include "memory_tracker.h"
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// One device-local vertex buffer and one index buffer that every mesh is suballocated from, so all meshes are
+// drawn with the same two binds and differ only in the vertex offset and first index of their draws.
+// Ranges are handed out first-fit; removing a mesh leaves a hole that the next record_updates() closes by moving
+// the meshes behind it down, so the live meshes stay packed at the start of the buffers. Added meshes are copied
+// in by the same call. A copy of every mesh is kept on the CPU, for uploads after a compaction and for captures.
+class GeometryPool {
+public:
+    struct Mesh {
+        uint32_t first_vertex;
+        uint32_t vertex_count;
+        uint32_t first_index;
+        uint32_t index_count;
+    };
+
+    GeometryPool(VkDevice device, const VkPhysicalDeviceMemoryProperties& physical_device_memory_properties, MemoryTracker& memory_tracker,
+        uint32_t vertex_stride, uint32_t vertex_capacity, uint32_t index_capacity, uint32_t frames_in_flight);
+    ~GeometryPool();
+
+    // indices are relative to the mesh's first vertex
+    uint32_t add_mesh(const void* vertices, uint32_t vertex_count, const std::vector<uint32_t>& indices);
+    void remove_mesh(uint32_t mesh);
+    const Mesh& get_mesh(uint32_t mesh) const { return entries[mesh].mesh; }
+
+    // moves and uploads are recorded before anything in the command buffer reads the pool, the offsets returned
+    // by get_mesh() are where the data is from then on
+    void record_updates(VkCommandBuffer command_buffer);
+    VkBuffer get_vertex_buffer() const { return vertex_buffer; }
+    VkBuffer get_index_buffer() const { return index_buffer; }
+    // the used part of the buffers as of the last record_updates()
+    std::vector<char> get_vertex_data() const;
+    std::vector<char> get_index_data() const;
+    void report(std::ostream& stream);
+
+    typedef enum Errors {
+        GEOMETRY_POOL_BUFFER_CREATION_FAILED = -1,
+        GEOMETRY_POOL_MEMORY_ALLOCATION_FAILED = -2,
+        GEOMETRY_POOL_FULL = -3
+    } Errors;
+
+private:
+    struct Range {
+        uint32_t offset;
+        uint32_t count;
+    };
+
+    struct Entry {
+        Mesh mesh;
+        uint32_t resident_first_vertex;
+        uint32_t resident_first_index;
+        bool is_live;
+        bool is_uploaded;
+        std::vector<char> vertex_data;
+        std::vector<uint32_t> indices;
+    };
+
+    // buffers of a recorded update, destroyed once the frames that used them are done
+    struct RetiredBuffer {
+        VkBuffer buffer;
+        VkDeviceMemory memory;
+        uint32_t frames_left;
+    };
+
+    static bool allocate(std::vector<Range>& free_ranges, uint32_t count, uint32_t* offset);
+    static void release(std::vector<Range>& free_ranges, Range range);
+    static uint32_t get_free_count(const std::vector<Range>& free_ranges);
+    void compact();
+    VkBuffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlagBits memory_properties, const std::string& tag, VkDeviceMemory* memory);
+
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties physical_device_memory_properties;
+    MemoryTracker& memory_tracker;
+    uint32_t vertex_stride;
+    uint32_t vertex_capacity;
+    uint32_t index_capacity;
+    uint32_t frames_in_flight;
+
+    VkBuffer vertex_buffer;
+    VkDeviceMemory vertex_memory;
+    VkBuffer index_buffer;
+    VkDeviceMemory index_memory;
+    std::vector<RetiredBuffer> retired_buffers;
+
+    // sorted by offset and coalesced
+    std::vector<Range> free_vertices;
+    std::vector<Range> free_indices;
+    std::vector<Entry> entries;
+    bool is_compaction_pending = false;
+
+    uint32_t compactions = 0;
+    VkDeviceSize moved_bytes = 0;
+    VkDeviceSize uploaded_bytes = 0;
+};
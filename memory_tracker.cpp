@@ -0,0 +1,185 @@
+#include "memory_tracker.h"
+
+#include <fstream>
+#include <algorithm>
+#include <iterator>
+
+void MemoryTracker::Usage::add(VkDeviceSize allocation_size, VkDeviceSize used_size) {
+    allocated += allocation_size;
+    used += used_size;
+    peak = std::max(peak, allocated);
+    allocations++;
+}
+
+void MemoryTracker::Usage::remove(VkDeviceSize allocation_size, VkDeviceSize used_size) {
+    allocated -= allocation_size;
+    used -= used_size;
+    allocations--;
+}
+
+// bytes allocated but not bound to any resource (alignment padding, unused tails) over the allocated bytes
+double MemoryTracker::Usage::fragmentation() const {
+    return allocated ? 1.0 - static_cast<double>(used) / allocated : 0.0;
+}
+
+MemoryTracker::MemoryTracker(VkPhysicalDevice physical_device, bool is_budget_extension_enabled, float warning_threshold) :
+    physical_device(physical_device),
+    is_budget_extension_enabled(is_budget_extension_enabled && vkGetPhysicalDeviceMemoryProperties2KHR != nullptr),
+    warning_threshold(warning_threshold) {
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+    update_budget();
+}
+
+VkResult MemoryTracker::allocate(VkDevice device, const VkMemoryAllocateInfo& memory_allocate_info, VkDeviceSize used_size, const std::string& tag, VkDeviceMemory* memory) {
+    if (memory_allocate_info.memoryTypeIndex >= memory_properties.memoryTypeCount) {
+        std::lock_guard<std::mutex> lock(mutex);
+        failed_allocations++;
+        std::cerr << "ERROR: no suitable memory type for " << tag << " (" << memory_allocate_info.allocationSize << " bytes)" << std::endl;
+        return VK_ERROR_OUT_OF_DEVICE_MEMORY;
+    }
+    uint32_t heap_index = memory_properties.memoryTypes[memory_allocate_info.memoryTypeIndex].heapIndex;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        check_budget(heap_index, memory_allocate_info.allocationSize);
+    }
+
+    VkResult result = vkAllocateMemory(device, &memory_allocate_info, nullptr, memory);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (result != VK_SUCCESS) {
+        failed_allocations++;
+        std::cerr << "ERROR: allocation of " << memory_allocate_info.allocationSize << " bytes for " << tag << " failed in heap " << heap_index
+            << " (" << heap_usage[heap_index].allocated << " bytes tracked, budget " << get_budget(heap_index) << ")" << std::endl;
+        return result;
+    }
+    allocations[*memory] = { memory_allocate_info.allocationSize, used_size, memory_allocate_info.memoryTypeIndex, tag };
+    heap_usage[heap_index].add(memory_allocate_info.allocationSize, used_size);
+    type_usage[memory_allocate_info.memoryTypeIndex].add(memory_allocate_info.allocationSize, used_size);
+    tag_usage[tag].add(memory_allocate_info.allocationSize, used_size);
+    total_usage.add(memory_allocate_info.allocationSize, used_size);
+    return result;
+}
+
+void MemoryTracker::free(VkDevice device, VkDeviceMemory memory) {
+    if (memory == VK_NULL_HANDLE) { return; }
+    vkFreeMemory(device, memory, nullptr);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto allocation = allocations.find(memory);
+    if (allocation == allocations.end()) { return; }
+    const Allocation& info = allocation->second;
+    heap_usage[memory_properties.memoryTypes[info.type_index].heapIndex].remove(info.size, info.used_size);
+    type_usage[info.type_index].remove(info.size, info.used_size);
+    tag_usage[info.tag].remove(info.size, info.used_size);
+    total_usage.remove(info.size, info.used_size);
+    allocations.erase(allocation);
+}
+
+void MemoryTracker::update_budget() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (is_budget_extension_enabled) {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT memory_budget_properties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT, nullptr };
+        VkPhysicalDeviceMemoryProperties2KHR memory_properties_2 = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR, &memory_budget_properties };
+        vkGetPhysicalDeviceMemoryProperties2KHR(physical_device, &memory_properties_2);
+        for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+            heap_budget[i] = memory_budget_properties.heapBudget[i];
+            heap_driver_usage[i] = memory_budget_properties.heapUsage[i];
+        }
+    }
+    else {
+        for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+            heap_budget[i] = memory_properties.memoryHeaps[i].size;
+            heap_driver_usage[i] = heap_usage[i].allocated;
+        }
+    }
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+        check_budget(i, 0);
+    }
+}
+
+void MemoryTracker::get_device_local_usage(VkDeviceSize* allocated, VkDeviceSize* budget) {
+    std::lock_guard<std::mutex> lock(mutex);
+    *allocated = 0;
+    *budget = 0;
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+        if (!(memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) { continue; }
+        *allocated += heap_usage[i].allocated;
+        *budget += get_budget(i);
+    }
+}
+
+VkDeviceSize MemoryTracker::get_budget(uint32_t heap_index) const {
+    return heap_budget[heap_index] ? heap_budget[heap_index] : memory_properties.memoryHeaps[heap_index].size;
+}
+
+void MemoryTracker::check_budget(uint32_t heap_index, VkDeviceSize incoming_size) {
+    VkDeviceSize usage = std::max(heap_driver_usage[heap_index], heap_usage[heap_index].allocated) + incoming_size;
+    VkDeviceSize budget = get_budget(heap_index);
+    // both warnings are printed once when the heap crosses the line, and again only after it has dropped back under it
+    if (usage > budget) {
+        if (!is_heap_over_budget[heap_index]) {
+            std::cerr << "WARNING: memory heap " << heap_index << " over budget: " << usage << " of " << budget << " bytes" << std::endl;
+        }
+        is_heap_over_budget[heap_index] = true;
+        is_heap_over_threshold[heap_index] = true;
+        return;
+    }
+    is_heap_over_budget[heap_index] = false;
+    if (usage > budget * warning_threshold) {
+        if (!is_heap_over_threshold[heap_index]) {
+            std::cerr << "WARNING: memory heap " << heap_index << " at " << 100.0 * usage / budget << "% of its budget (" << budget << " bytes)" << std::endl;
+        }
+        is_heap_over_threshold[heap_index] = true;
+        return;
+    }
+    is_heap_over_threshold[heap_index] = false;
+}
+
+void MemoryTracker::report(std::ostream& stream) {
+    std::lock_guard<std::mutex> lock(mutex);
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+        if (heap_usage[i].peak == 0) { continue; }
+        stream << "Heap " << i << ": " << heap_usage[i].allocated / 1024 << " KB in " << heap_usage[i].allocations << " allocations, peak "
+            << heap_usage[i].peak / 1024 << " KB, budget " << get_budget(i) / (1024 * 1024) << " MB, fragmentation " << heap_usage[i].fragmentation() * 100.0 << "%" << std::endl;
+    }
+}
+
+void MemoryTracker::write_json(std::ostream& stream) {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto write_usage = [&stream](const Usage& usage) {
+        stream << "\"allocated\": " << usage.allocated << ", \"used\": " << usage.used << ", \"peak\": " << usage.peak
+            << ", \"allocations\": " << usage.allocations << ", \"fragmentation\": " << usage.fragmentation();
+    };
+
+    stream << "{\n  \"budget_extension\": " << (is_budget_extension_enabled ? "true" : "false") << ",\n";
+    stream << "  \"failed_allocations\": " << failed_allocations << ",\n";
+    stream << "  \"total\": { ";
+    write_usage(total_usage);
+    stream << " },\n  \"heaps\": [\n";
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+        stream << "    { \"index\": " << i << ", \"size\": " << memory_properties.memoryHeaps[i].size
+            << ", \"device_local\": " << ((memory_properties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) ? "true" : "false")
+            << ", \"budget\": " << get_budget(i) << ", \"driver_usage\": " << heap_driver_usage[i] << ", ";
+        write_usage(heap_usage[i]);
+        stream << " }" << (i + 1 < memory_properties.memoryHeapCount ? "," : "") << "\n";
+    }
+    stream << "  ],\n  \"types\": [\n";
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        stream << "    { \"index\": " << i << ", \"heap\": " << memory_properties.memoryTypes[i].heapIndex
+            << ", \"property_flags\": " << memory_properties.memoryTypes[i].propertyFlags << ", ";
+        write_usage(type_usage[i]);
+        stream << " }" << (i + 1 < memory_properties.memoryTypeCount ? "," : "") << "\n";
+    }
+    stream << "  ],\n  \"tags\": {\n";
+    for (auto it = tag_usage.begin(); it != tag_usage.end(); ++it) {
+        stream << "    \"" << it->first << "\": { ";
+        write_usage(it->second);
+        stream << " }" << (std::next(it) != tag_usage.end() ? "," : "") << "\n";
+    }
+    stream << "  }\n}\n";
+}
+
+void MemoryTracker::dump_json(const std::string& path) {
+    std::ofstream file(path, std::ios::out);
+    write_json(file);
+}
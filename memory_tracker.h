@@ -0,0 +1,65 @@
+#pragma once
+#include "volk.h"
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <mutex>
+
+// Every vkAllocateMemory/vkFreeMemory of the program goes through here, so usage can be reported
+// per heap, memory type and tag. With VK_EXT_memory_budget the driver's budget and usage are
+// queried as well, otherwise the heap size is used as the budget.
+class MemoryTracker {
+public:
+    MemoryTracker(VkPhysicalDevice physical_device, bool is_budget_extension_enabled, float warning_threshold = 0.9f);
+
+    VkResult allocate(VkDevice device, const VkMemoryAllocateInfo& memory_allocate_info, VkDeviceSize used_size, const std::string& tag, VkDeviceMemory* memory);
+    void free(VkDevice device, VkDeviceMemory memory);
+    void update_budget();
+    // summed over the device-local heaps, for displays that poll it every frame
+    void get_device_local_usage(VkDeviceSize* allocated, VkDeviceSize* budget);
+
+    void report(std::ostream& stream);
+    void write_json(std::ostream& stream);
+    void dump_json(const std::string& path);
+
+private:
+    struct Usage {
+        VkDeviceSize allocated = 0;
+        VkDeviceSize used = 0;
+        VkDeviceSize peak = 0;
+        uint32_t allocations = 0;
+
+        void add(VkDeviceSize allocation_size, VkDeviceSize used_size);
+        void remove(VkDeviceSize allocation_size, VkDeviceSize used_size);
+        double fragmentation() const;
+    };
+
+    struct Allocation {
+        VkDeviceSize size;
+        VkDeviceSize used_size;
+        uint32_t type_index;
+        std::string tag;
+    };
+
+    VkDeviceSize get_budget(uint32_t heap_index) const;
+    void check_budget(uint32_t heap_index, VkDeviceSize incoming_size);
+
+    VkPhysicalDevice physical_device;
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    bool is_budget_extension_enabled;
+    float warning_threshold;
+
+    std::mutex mutex;
+    std::unordered_map<VkDeviceMemory, Allocation> allocations;
+    Usage heap_usage[VK_MAX_MEMORY_HEAPS];
+    Usage type_usage[VK_MAX_MEMORY_TYPES];
+    std::map<std::string, Usage> tag_usage;
+    Usage total_usage;
+    VkDeviceSize heap_budget[VK_MAX_MEMORY_HEAPS] = {};
+    VkDeviceSize heap_driver_usage[VK_MAX_MEMORY_HEAPS] = {};
+    bool is_heap_over_threshold[VK_MAX_MEMORY_HEAPS] = {};
+    bool is_heap_over_budget[VK_MAX_MEMORY_HEAPS] = {};
+    uint32_t failed_allocations = 0;
+};
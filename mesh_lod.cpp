@@ -0,0 +1,127 @@
+#include "mesh_lod.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <set>
+#include <unordered_map>
+
+namespace {
+    constexpr uint32_t cell_coordinate_bits = 21;
+
+    uint64_t get_cell_key(const glm::vec3& position, const glm::vec3& origin, float cell_size) {
+        glm::vec3 cell = glm::floor((position - origin) / cell_size);
+        uint64_t mask = (1ull << cell_coordinate_bits) - 1;
+        return ((static_cast<uint64_t>(cell.x) & mask) << (2 * cell_coordinate_bits)) | ((static_cast<uint64_t>(cell.y) & mask) << cell_coordinate_bits) | (static_cast<uint64_t>(cell.z) & mask);
+    }
+}
+
+MeshLod::MeshLod(const std::vector<glm::vec3>& vertex_data, const std::vector<uint32_t>& indices, uint32_t max_lods) :
+    indices(indices) {
+    uint32_t vertex_count = static_cast<uint32_t>(vertex_data.size() / 2);
+    lods.push_back({ 0, static_cast<uint32_t>(indices.size()), 0.0f });
+    if (vertex_count == 0) { return; }
+
+    bounds_min = vertex_data[0];
+    bounds_max = vertex_data[0];
+    for (uint32_t i = 1; i < vertex_count; i++) {
+        bounds_min = glm::min(bounds_min, vertex_data[2 * i]);
+        bounds_max = glm::max(bounds_max, vertex_data[2 * i]);
+    }
+    glm::vec3 extent = bounds_max - bounds_min;
+    float max_extent = std::max(extent.x, std::max(extent.y, extent.z));
+    if (max_extent <= 0.0f) { return; }
+
+    // start around the spacing of the vertices, assuming they cover a surface
+    float cell_size = max_extent / std::max(1.0f, std::sqrt(static_cast<float>(vertex_count)));
+    while (lods.size() < max_lods && cell_size <= max_extent * 2.0f) {
+        if (!simplify(vertex_data, vertex_count, cell_size)) { break; }
+        cell_size *= 2.0f;
+    }
+}
+
+bool MeshLod::simplify(const std::vector<glm::vec3>& vertex_data, uint32_t vertex_count, float cell_size) {
+    struct Cell {
+        glm::vec3 sum = glm::vec3(0.0f);
+        uint32_t count = 0;
+        uint32_t representative = UINT32_MAX;
+        float representative_distance = 0.0f;
+    };
+    std::unordered_map<uint64_t, Cell> cells;
+    std::vector<uint64_t> vertex_cells(vertex_count);
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        vertex_cells[i] = get_cell_key(vertex_data[2 * i], bounds_min, cell_size);
+        Cell& cell = cells[vertex_cells[i]];
+        cell.sum += vertex_data[2 * i];
+        cell.count++;
+    }
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        Cell& cell = cells[vertex_cells[i]];
+        float distance = glm::length(vertex_data[2 * i] - cell.sum / static_cast<float>(cell.count));
+        if (cell.representative == UINT32_MAX || distance < cell.representative_distance) {
+            cell.representative = i;
+            cell.representative_distance = distance;
+        }
+    }
+
+    float error = 0.0f;
+    std::vector<uint32_t> remap(vertex_count);
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        remap[i] = cells[vertex_cells[i]].representative;
+        error = std::max(error, glm::length(vertex_data[2 * i] - vertex_data[2 * remap[i]]));
+    }
+
+    // triangles collapsed by the clustering are dropped, as are duplicates of the same three vertices
+    std::vector<uint32_t> lod_indices;
+    std::set<std::array<uint32_t, 3>> triangles;
+    for (uint32_t i = 0; i + 2 < lods[0].index_count; i += 3) {
+        uint32_t a = remap[indices[i]], b = remap[indices[i + 1]], c = remap[indices[i + 2]];
+        if (a == b || b == c || a == c) { continue; }
+        std::array<uint32_t, 3> triangle = { a, b, c };
+        std::sort(triangle.begin(), triangle.end());
+        if (!triangles.insert(triangle).second) { continue; }
+        lod_indices.insert(lod_indices.end(), { a, b, c });
+    }
+    if (lod_indices.empty()) { return false; }
+    if (lod_indices.size() > (1.0f - min_reduction) * lods.back().index_count) { return true; }
+
+    lods.push_back({ static_cast<uint32_t>(indices.size()), static_cast<uint32_t>(lod_indices.size()), error });
+    indices.insert(indices.end(), lod_indices.begin(), lod_indices.end());
+    return true;
+}
+
+// coarsest level whose error, projected with pixels_per_unit, stays within the allowed pixels
+uint32_t MeshLod::select_lod(float pixels_per_unit, float max_error_pixels) const {
+    uint32_t selected = 0;
+    for (uint32_t i = 1; i < lods.size(); i++) {
+        if (lods[i].error * pixels_per_unit > max_error_pixels) { break; }
+        selected = i;
+    }
+    return selected;
+}
+
+// replaces a single XYZ - RGB triangle by subdivisions^2 triangles over a barycentric grid
+void MeshLod::subdivide_triangle(std::vector<glm::vec3>& vertex_data, std::vector<uint32_t>& indices, uint32_t subdivisions) {
+    glm::vec3 corners[3][2] = { { vertex_data[0], vertex_data[1] }, { vertex_data[2], vertex_data[3] }, { vertex_data[4], vertex_data[5] } };
+    vertex_data.clear();
+    indices.clear();
+    subdivisions = std::max(1u, subdivisions);
+    float step = 1.0f / subdivisions;
+    for (uint32_t row = 0; row <= subdivisions; row++) {
+        for (uint32_t column = 0; column <= subdivisions - row; column++) {
+            float u = column * step, v = row * step, w = 1.0f - u - v;
+            vertex_data.push_back(corners[0][0] * w + corners[1][0] * u + corners[2][0] * v);
+            vertex_data.push_back(corners[0][1] * w + corners[1][1] * u + corners[2][1] * v);
+        }
+    }
+    // rows shrink by one vertex each, row r starts after r rows of (subdivisions + 1 - i) vertices
+    auto vertex_index = [subdivisions](uint32_t row, uint32_t column) { return row * (subdivisions + 1) - row * (row - 1) / 2 + column; };
+    for (uint32_t row = 0; row < subdivisions; row++) {
+        for (uint32_t column = 0; column < subdivisions - row; column++) {
+            indices.insert(indices.end(), { vertex_index(row, column), vertex_index(row, column + 1), vertex_index(row + 1, column) });
+            if (column + 1 < subdivisions - row) {
+                indices.insert(indices.end(), { vertex_index(row, column + 1), vertex_index(row + 1, column + 1), vertex_index(row + 1, column) });
+            }
+        }
+    }
+}
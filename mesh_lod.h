@@ -0,0 +1,38 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+
+// Builds a chain of simplified index buffers over one XYZ - RGB vertex array at import time.
+// Each level clusters vertices on a grid twice as coarse as the previous one and snaps them to the vertex
+// closest to their cluster's average, so every level reuses the original vertices and only the indices differ.
+// All levels are stored back to back in one index array; error is the largest distance a vertex moved.
+class MeshLod {
+public:
+    struct Lod {
+        uint32_t first_index;
+        uint32_t index_count;
+        float error;
+    };
+
+    MeshLod(const std::vector<glm::vec3>& vertex_data, const std::vector<uint32_t>& indices, uint32_t max_lods = 8);
+
+    static void subdivide_triangle(std::vector<glm::vec3>& vertex_data, std::vector<uint32_t>& indices, uint32_t subdivisions);
+
+    uint32_t select_lod(float pixels_per_unit, float max_error_pixels) const;
+    const std::vector<uint32_t>& get_indices() const { return indices; }
+    const std::vector<Lod>& get_lods() const { return lods; }
+    uint32_t get_triangle_count(uint32_t lod) const { return lods[lod].index_count / 3; }
+
+    // a level is only kept when it removes at least this fraction of the previous level's triangles
+    static constexpr float min_reduction = 0.1f;
+
+private:
+    bool simplify(const std::vector<glm::vec3>& vertex_data, uint32_t vertex_count, float cell_size);
+
+    glm::vec3 bounds_min;
+    glm::vec3 bounds_max;
+    std::vector<uint32_t> indices;
+    std::vector<Lod> lods;
+};
@@ -0,0 +1,188 @@
+#include "particle_animation.h"
+#include "vulkan_helper.h"
+
+#include <fstream>
+#include <filesystem>
+#include <vector>
+#include <cmath>
+
+ParticleAnimation::ParticleAnimation(VkDevice device, const VkPhysicalDeviceMemoryProperties& physical_device_memory_properties, MemoryTracker& memory_tracker, uint32_t element_count, const std::string& shader_path) :
+    device(device),
+    physical_device_memory_properties(physical_device_memory_properties),
+    memory_tracker(memory_tracker),
+    // whole triangles only
+    element_count(std::max(3u, element_count - element_count % 3)) {
+    // keep the covered area roughly constant whatever the particle count
+    particle_size = std::max(0.002f, 0.5f / std::sqrt(static_cast<float>(this->element_count / 3)));
+
+    // large counts are spread over a second dispatch dimension to stay within maxComputeWorkGroupCount[0]
+    uint32_t workgroups = (this->element_count + workgroup_size - 1) / workgroup_size;
+    workgroups_x = std::min(workgroups, max_workgroups_x);
+    workgroups_y = (workgroups + workgroups_x - 1) / workgroups_x;
+
+    create_buffer();
+    create_descriptor_set();
+    create_pipeline(shader_path);
+}
+
+ParticleAnimation::~ParticleAnimation() {
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+    vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
+    vkDestroyBuffer(device, buffer, nullptr);
+    memory_tracker.free(device, memory);
+}
+
+void ParticleAnimation::create_buffer() {
+    VkDeviceSize buffer_size = static_cast<VkDeviceSize>(element_count) * 6 * sizeof(float);
+    VkBufferCreateInfo buffer_create_info = {
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        nullptr,
+        0,
+        buffer_size,
+        VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        0,
+        nullptr
+    };
+    if (vkCreateBuffer(device, &buffer_create_info, nullptr, &buffer) != VK_SUCCESS) { throw PARTICLE_BUFFER_CREATION_FAILED; }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memory_requirements);
+    VkMemoryAllocateInfo memory_allocate_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        nullptr,
+        memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+    };
+    if (memory_tracker.allocate(device, memory_allocate_info, buffer_size, "particles", &memory) != VK_SUCCESS) { throw PARTICLE_MEMORY_ALLOCATION_FAILED; }
+    vkBindBufferMemory(device, buffer, memory, 0);
+}
+
+void ParticleAnimation::create_descriptor_set() {
+    VkDescriptorPoolSize descriptor_pool_size = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1 };
+    VkDescriptorPoolCreateInfo descriptor_pool_create_info = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        nullptr,
+        0,
+        1,
+        1,
+        &descriptor_pool_size
+    };
+    vkCreateDescriptorPool(device, &descriptor_pool_create_info, nullptr, &descriptor_pool);
+
+    VkDescriptorSetLayoutBinding descriptor_set_layout_binding = {
+        0,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        1,
+        VK_SHADER_STAGE_COMPUTE_BIT,
+        nullptr
+    };
+    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        nullptr,
+        0,
+        1,
+        &descriptor_set_layout_binding
+    };
+    vkCreateDescriptorSetLayout(device, &descriptor_set_layout_create_info, nullptr, &descriptor_set_layout);
+
+    VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        nullptr,
+        descriptor_pool,
+        1,
+        &descriptor_set_layout
+    };
+    vkAllocateDescriptorSets(device, &descriptor_set_allocate_info, &descriptor_set);
+
+    VkDescriptorBufferInfo descriptor_buffer_info = { buffer, 0, VK_WHOLE_SIZE };
+    VkWriteDescriptorSet write_descriptor_set = {
+        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        nullptr,
+        descriptor_set,
+        0,
+        0,
+        1,
+        VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+        nullptr,
+        &descriptor_buffer_info,
+        nullptr
+    };
+    vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
+}
+
+void ParticleAnimation::create_pipeline(const std::string& shader_path) {
+    std::ifstream shader_file(shader_path, std::ios::in | std::ios::binary);
+    std::vector<char> shader_contents(std::filesystem::file_size(shader_path));
+    shader_file.read(shader_contents.data(), shader_contents.size());
+    VkShaderModuleCreateInfo shader_module_create_info = {
+        VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        nullptr,
+        0,
+        shader_contents.size(),
+        reinterpret_cast<uint32_t*>(shader_contents.data())
+    };
+    VkShaderModule compute_shader_module;
+    if (vkCreateShaderModule(device, &shader_module_create_info, nullptr, &compute_shader_module)) { throw PARTICLE_SHADER_MODULE_CREATION_FAILED; }
+
+    VkPushConstantRange push_constant_range = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants) };
+    VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        nullptr,
+        0,
+        1,
+        &descriptor_set_layout,
+        1,
+        &push_constant_range
+    };
+    vkCreatePipelineLayout(device, &pipeline_layout_create_info, nullptr, &pipeline_layout);
+
+    VkComputePipelineCreateInfo compute_pipeline_create_info = {
+        VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        nullptr,
+        0,
+        {
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            nullptr,
+            0,
+            VK_SHADER_STAGE_COMPUTE_BIT,
+            compute_shader_module,
+            "main",
+            nullptr
+        },
+        pipeline_layout,
+        VK_NULL_HANDLE,
+        -1
+    };
+    VkResult res = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, nullptr, &pipeline);
+    vkDestroyShaderModule(device, compute_shader_module, nullptr);
+    if (res != VK_SUCCESS) { throw PARTICLE_PIPELINE_CREATION_FAILED; }
+}
+
+void ParticleAnimation::record(VkCommandBuffer command_buffer, float time) {
+    // the previous frame's vertex fetch (and a previous update) must be finished before the buffer is rewritten
+    VkBufferMemoryBarrier buffer_memory_barrier = {
+        VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        nullptr,
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_ACCESS_SHADER_WRITE_BIT,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        buffer,
+        0,
+        VK_WHOLE_SIZE
+    };
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 1, &buffer_memory_barrier, 0, nullptr);
+
+    PushConstants push_constants = { element_count, time, particle_size };
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+    vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+    vkCmdDispatch(command_buffer, workgroups_x, workgroups_y, 1);
+
+    buffer_memory_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    buffer_memory_barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 0, nullptr, 1, &buffer_memory_barrier, 0, nullptr);
+}
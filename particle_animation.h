@@ -0,0 +1,55 @@
+#pragma once
+#include "volk.h"
+#include "memory_tracker.h"
+
+#include <string>
+
+// Animates a set of XYZ - RGB elements with a compute shader directly in a device-local buffer that the
+// graphics pipeline binds as its vertex buffer, every three consecutive elements form one particle triangle.
+// The data never goes through the CPU: record() adds the dispatch and the compute -> vertex input barrier.
+class ParticleAnimation {
+public:
+    ParticleAnimation(VkDevice device, const VkPhysicalDeviceMemoryProperties& physical_device_memory_properties, MemoryTracker& memory_tracker, uint32_t element_count, const std::string& shader_path);
+    ~ParticleAnimation();
+
+    void record(VkCommandBuffer command_buffer, float time);
+    VkBuffer get_vertex_buffer() const { return buffer; }
+    uint32_t get_element_count() const { return element_count; }
+
+    typedef enum Errors {
+        PARTICLE_BUFFER_CREATION_FAILED = -1,
+        PARTICLE_MEMORY_ALLOCATION_FAILED = -2,
+        PARTICLE_SHADER_MODULE_CREATION_FAILED = -3,
+        PARTICLE_PIPELINE_CREATION_FAILED = -4
+    } Errors;
+
+    static constexpr uint32_t workgroup_size = 256;
+    static constexpr uint32_t max_workgroups_x = 65535;
+
+private:
+    struct PushConstants {
+        uint32_t element_count;
+        float time;
+        float particle_size;
+    };
+
+    void create_buffer();
+    void create_descriptor_set();
+    void create_pipeline(const std::string& shader_path);
+
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties physical_device_memory_properties;
+    MemoryTracker& memory_tracker;
+    uint32_t element_count;
+    float particle_size;
+
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSetLayout descriptor_set_layout;
+    VkDescriptorSet descriptor_set;
+    VkPipelineLayout pipeline_layout;
+    VkPipeline pipeline;
+    uint32_t workgroups_x;
+    uint32_t workgroups_y;
+};
@@ -0,0 +1,608 @@
+#include "perf_hud.h"
+#include "vulkan_helper.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+
+namespace {
+    // 16x4 cells of 6x8 texels, each holding a 5x7 glyph in its top left corner
+    constexpr uint32_t atlas_columns = 16;
+    constexpr uint32_t atlas_width = 96;
+    constexpr uint32_t atlas_height = 32;
+    constexpr uint32_t cell_width = 6;
+    constexpr uint32_t cell_height = 8;
+    constexpr uint32_t glyph_width = 5;
+    constexpr uint32_t glyph_height = 7;
+
+    // in window pixels, a font pixel is drawn 2x2 so glyphs are 12x16 cells on screen
+    constexpr float glyph_scale = 2.0f;
+    constexpr float line_height = 18.0f;
+    constexpr float margin = 8.0f;
+    constexpr float padding = 6.0f;
+    constexpr float bar_width = 2.0f;
+    constexpr float graph_height = 48.0f;
+    constexpr float graph_max_msec = 100.0f / 3.0f;
+    constexpr float graph_line_msec = 50.0f / 3.0f;
+
+    // the averages need this many frames to follow a change, so the budget is not checked more often
+    constexpr uint64_t adjust_frames = 60;
+    constexpr double average_weight = 0.05;
+
+    // R8G8B8A8 read from a little-endian uint32_t, alpha in the top byte
+    constexpr uint32_t white = 0xFFFFFFFF;
+    constexpr uint32_t gray = 0xFFA0A0A0;
+    constexpr uint32_t green = 0xFF40D040;
+    constexpr uint32_t yellow = 0xFF40D0E0;
+    constexpr uint32_t red = 0xFF4040E0;
+    constexpr uint32_t panel = 0xB0000000;
+    constexpr uint32_t graph_background = 0x80303030;
+    constexpr uint32_t graph_line = 0x80A0A0A0;
+
+    // rows of 5 bits, the most significant on the left, for ASCII 32 to 95; lowercase is drawn as uppercase
+    const uint8_t font[64][glyph_height] = {
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+        { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // !
+        { 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00, 0x00 }, // "
+        { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A }, // #
+        { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 }, // $
+        { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+        { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D }, // &
+        { 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 }, // '
+        { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+        { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+        { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 }, // *
+        { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, // +
+        { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }, // ,
+        { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // -
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // .
+        { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+        { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // 0
+        { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 1
+        { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // 2
+        { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // 3
+        { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // 4
+        { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // 5
+        { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // 6
+        { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+        { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // 8
+        { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // 9
+        { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // :
+        { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 }, // ;
+        { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // <
+        { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }, // =
+        { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // >
+        { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ?
+        { 0x0E, 0x11, 0x17, 0x15, 0x17, 0x10, 0x0E }, // @
+        { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // A
+        { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // B
+        { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // C
+        { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // D
+        { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // E
+        { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // F
+        { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // G
+        { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // H
+        { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // I
+        { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // J
+        { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+        { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // L
+        { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+        { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+        { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // O
+        { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // P
+        { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // Q
+        { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // R
+        { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // S
+        { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+        { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // U
+        { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // V
+        { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // W
+        { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // X
+        { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 }, // Y
+        { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // Z
+        { 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E }, // [
+        { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 }, // backslash
+        { 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E }, // ]
+        { 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00 }, // ^
+        { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F }  // _
+    };
+}
+
+PerfHud::PerfHud(VkDevice device, const VkPhysicalDeviceMemoryProperties& physical_device_memory_properties, MemoryTracker& memory_tracker, PipelineRegistry& pipeline_registry,
+    VkFormat target_format, VkImageLayout target_layout, uint32_t frames_in_flight, float budget_msec, const std::string& vertex_shader_path, const std::string& fragment_shader_path) :
+    device(device),
+    physical_device_memory_properties(physical_device_memory_properties),
+    memory_tracker(memory_tracker),
+    pipeline_registry(pipeline_registry),
+    frames_in_flight(frames_in_flight),
+    budget_msec(budget_msec) {
+    create_atlas();
+    create_render_pass(target_format, target_layout);
+    create_descriptor_set();
+    create_pipeline(target_format, vertex_shader_path, fragment_shader_path);
+
+    vertex_region_size = (sizeof(Vertex) * 6 * max_quads + 255) & ~static_cast<VkDeviceSize>(255);
+    vertex_buffer = create_buffer(vertex_region_size * frames_in_flight, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, "perf_hud", &vertex_memory);
+    vkMapMemory(device, vertex_memory, 0, VK_WHOLE_SIZE, 0, &vertex_data_pointer);
+    region_vertex_counts.resize(frames_in_flight, 0);
+    vertices.reserve(6 * max_quads);
+}
+
+PerfHud::~PerfHud() {
+    vkUnmapMemory(device, vertex_memory);
+    vkDestroyBuffer(device, vertex_buffer, nullptr);
+    memory_tracker.free(device, vertex_memory);
+    if (staging_buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, staging_buffer, nullptr);
+        memory_tracker.free(device, staging_memory);
+    }
+    vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+    vkDestroyRenderPass(device, render_pass, nullptr);
+    vkDestroySampler(device, sampler, nullptr);
+    vkDestroyImageView(device, atlas_view, nullptr);
+    vkDestroyImage(device, atlas_image, nullptr);
+    memory_tracker.free(device, atlas_memory);
+}
+
+VkBuffer PerfHud::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, const std::string& tag, VkDeviceMemory* memory) {
+    VkBufferCreateInfo buffer_create_info = {
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        nullptr,
+        0,
+        size,
+        usage,
+        VK_SHARING_MODE_EXCLUSIVE,
+        0,
+        nullptr
+    };
+    VkBuffer buffer;
+    if (vkCreateBuffer(device, &buffer_create_info, nullptr, &buffer) != VK_SUCCESS) { throw HUD_BUFFER_CREATION_FAILED; }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memory_requirements);
+    VkMemoryAllocateInfo memory_allocate_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        nullptr,
+        memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    };
+    if (memory_tracker.allocate(device, memory_allocate_info, size, tag, memory) != VK_SUCCESS) { throw HUD_MEMORY_ALLOCATION_FAILED; }
+    vkBindBufferMemory(device, buffer, *memory, 0);
+    return buffer;
+}
+
+// glyph i of the font goes to cell (i % 16, i / 16); the last texel of the atlas, outside every glyph, is set so
+// panels and graphs can sample it as a solid color
+void PerfHud::create_atlas() {
+    VkImageCreateInfo image_create_info = {
+        VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        nullptr,
+        0,
+        VK_IMAGE_TYPE_2D,
+        VK_FORMAT_R8_UNORM,
+        { atlas_width, atlas_height, 1 },
+        1,
+        1,
+        VK_SAMPLE_COUNT_1_BIT,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        0,
+        nullptr,
+        VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    if (vkCreateImage(device, &image_create_info, nullptr, &atlas_image) != VK_SUCCESS) { throw HUD_IMAGE_CREATION_FAILED; }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetImageMemoryRequirements(device, atlas_image, &memory_requirements);
+    VkMemoryAllocateInfo memory_allocate_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        nullptr,
+        memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+    };
+    if (memory_tracker.allocate(device, memory_allocate_info, atlas_width * atlas_height, "perf_hud", &atlas_memory) != VK_SUCCESS) { throw HUD_MEMORY_ALLOCATION_FAILED; }
+    vkBindImageMemory(device, atlas_image, atlas_memory, 0);
+
+    VkImageViewCreateInfo image_view_create_info = {
+        VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        nullptr,
+        0,
+        atlas_image,
+        VK_IMAGE_VIEW_TYPE_2D,
+        VK_FORMAT_R8_UNORM,
+        { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY },
+        { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+    };
+    vkCreateImageView(device, &image_view_create_info, nullptr, &atlas_view);
+
+    // glyphs are drawn at whole multiples of their size, so nearest filtering keeps them sharp
+    VkSamplerCreateInfo sampler_create_info = {
+        VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        nullptr,
+        0,
+        VK_FILTER_NEAREST,
+        VK_FILTER_NEAREST,
+        VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        0.0f,
+        VK_FALSE,
+        1.0f,
+        VK_FALSE,
+        VK_COMPARE_OP_ALWAYS,
+        0.0f,
+        0.0f,
+        VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK,
+        VK_FALSE
+    };
+    vkCreateSampler(device, &sampler_create_info, nullptr, &sampler);
+
+    std::vector<uint8_t> texels(atlas_width * atlas_height, 0);
+    for (uint32_t glyph = 0; glyph < 64; glyph++) {
+        uint32_t cell_x = (glyph % atlas_columns) * cell_width;
+        uint32_t cell_y = (glyph / atlas_columns) * cell_height;
+        for (uint32_t y = 0; y < glyph_height; y++) {
+            for (uint32_t x = 0; x < glyph_width; x++) {
+                if (font[glyph][y] & (0x10 >> x)) { texels[(cell_y + y) * atlas_width + cell_x + x] = 255; }
+            }
+        }
+    }
+    texels.back() = 255;
+
+    staging_buffer = create_buffer(texels.size(), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, "perf_hud_staging", &staging_memory);
+    void* staging_data_pointer;
+    vkMapMemory(device, staging_memory, 0, VK_WHOLE_SIZE, 0, &staging_data_pointer);
+    std::memcpy(staging_data_pointer, texels.data(), texels.size());
+    VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, staging_memory, 0, VK_WHOLE_SIZE };
+    vkFlushMappedMemoryRanges(device, 1, &mapped_memory_range);
+    vkUnmapMemory(device, staging_memory);
+}
+
+// the scene pass has already cleared and drawn the target, so it is loaded and left in the layout the scene pass
+// left it in; with the same attachment format the two passes are compatible and the HUD begins its pass on the
+// render target's framebuffer
+void PerfHud::create_render_pass(VkFormat target_format, VkImageLayout target_layout) {
+    VkAttachmentDescription attachment_description = {
+        0,
+        target_format,
+        VK_SAMPLE_COUNT_1_BIT,
+        VK_ATTACHMENT_LOAD_OP_LOAD,
+        VK_ATTACHMENT_STORE_OP_STORE,
+        VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        target_layout,
+        target_layout
+    };
+
+    VkAttachmentReference attachment_reference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+    VkSubpassDescription subpass_description = {
+        0,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        0,
+        nullptr,
+        1,
+        &attachment_reference,
+        nullptr,
+        nullptr,
+        0,
+        nullptr
+    };
+
+    // blending waits for the scene's draws and for the scene pass's final layout transition, which is only ordered
+    // before the transfer stage of its outgoing dependency; the blit after it waits as it did for the scene pass
+    VkSubpassDependency subpass_dependencies[2] = {
+        {
+            VK_SUBPASS_EXTERNAL,
+            0,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            0
+        },
+        {
+            0,
+            VK_SUBPASS_EXTERNAL,
+            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            VK_ACCESS_TRANSFER_READ_BIT,
+            0
+        }
+    };
+
+    VkRenderPassCreateInfo render_pass_create_info = {
+        VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        nullptr,
+        0,
+        1,
+        &attachment_description,
+        1,
+        &subpass_description,
+        2,
+        subpass_dependencies
+    };
+    if (vkCreateRenderPass(device, &render_pass_create_info, nullptr, &render_pass) != VK_SUCCESS) { throw HUD_RENDER_PASS_CREATION_FAILED; }
+}
+
+void PerfHud::create_descriptor_set() {
+    std::vector<VkDescriptorSetLayoutBinding> bindings = {
+        { 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_FRAGMENT_BIT, nullptr }
+    };
+    layout = pipeline_registry.add_layout({ bindings });
+
+    VkDescriptorPoolSize descriptor_pool_size = { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 };
+    VkDescriptorPoolCreateInfo descriptor_pool_create_info = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        nullptr,
+        0,
+        1,
+        1,
+        &descriptor_pool_size
+    };
+    vkCreateDescriptorPool(device, &descriptor_pool_create_info, nullptr, &descriptor_pool);
+
+    VkDescriptorSetLayout descriptor_set_layout = pipeline_registry.get_descriptor_set_layout(layout, 0);
+    VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        nullptr,
+        descriptor_pool,
+        1,
+        &descriptor_set_layout
+    };
+    vkAllocateDescriptorSets(device, &descriptor_set_allocate_info, &descriptor_set);
+
+    VkDescriptorImageInfo descriptor_image_info = { sampler, atlas_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL };
+    VkWriteDescriptorSet write_descriptor_set = {
+        VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        nullptr,
+        descriptor_set,
+        0,
+        0,
+        1,
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+        &descriptor_image_info,
+        nullptr,
+        nullptr
+    };
+    vkUpdateDescriptorSets(device, 1, &write_descriptor_set, 0, nullptr);
+}
+
+void PerfHud::create_pipeline(VkFormat target_format, const std::string& vertex_shader_path, const std::string& fragment_shader_path) {
+    auto read_shader = [](const std::string& path) {
+        std::ifstream shader_file(path, std::ios::in | std::ios::binary);
+        std::vector<char> shader_contents(std::filesystem::file_size(path));
+        shader_file.read(shader_contents.data(), shader_contents.size());
+        return shader_contents;
+    };
+
+    // alpha blended over the scene, the target's alpha is kept
+    PipelineRegistry::State state;
+    state.vertex_shader = pipeline_registry.add_shader(read_shader(vertex_shader_path));
+    state.fragment_shader = pipeline_registry.add_shader(read_shader(fragment_shader_path));
+    state.layout = layout;
+    state.render_pass = pipeline_registry.add_render_pass(render_pass, { target_format }, VK_SAMPLE_COUNT_1_BIT);
+    state.vertex_binding_count = 1;
+    state.vertex_bindings[0] = { 0, sizeof(Vertex), VK_VERTEX_INPUT_RATE_VERTEX };
+    state.vertex_attribute_count = 3;
+    state.vertex_attributes[0] = { 0, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, x) };
+    state.vertex_attributes[1] = { 1, 0, VK_FORMAT_R32G32_SFLOAT, offsetof(Vertex, u) };
+    state.vertex_attributes[2] = { 2, 0, VK_FORMAT_R8G8B8A8_UNORM, offsetof(Vertex, color) };
+    state.blend_enable = VK_TRUE;
+    state.src_color_blend_factor = VK_BLEND_FACTOR_SRC_ALPHA;
+    state.dst_color_blend_factor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    state.src_alpha_blend_factor = VK_BLEND_FACTOR_ZERO;
+    state.dst_alpha_blend_factor = VK_BLEND_FACTOR_ONE;
+    pipeline = pipeline_registry.get(state);
+}
+
+void PerfHud::update(uint32_t frame, const Counters& counters, VkExtent2D window_extent) {
+    auto update_begin = std::chrono::steady_clock::now();
+    cpu_history[history_cursor] = static_cast<float>(counters.cpu_frame_msec);
+    gpu_history[history_cursor] = static_cast<float>(counters.gpu_frame_msec);
+    history_cursor = (history_cursor + 1) % history_size;
+    gpu_msec += (counters.gpu_hud_msec - gpu_msec) * average_weight;
+
+    bool is_resized = window_extent.width != layout_extent.width || window_extent.height != layout_extent.height;
+    if (builds == 0 || is_resized || ++frames_since_build >= update_interval) {
+        build(counters, window_extent);
+        frames_since_build = 0;
+        dirty_regions = (1u << frames_in_flight) - 1;
+        builds++;
+        if (updates - last_adjust_update >= adjust_frames) {
+            adjust_to_budget();
+            last_adjust_update = updates;
+        }
+    }
+    // between builds each region is written once, after that the frames draw what their region already holds;
+    // frames without an update() leave their region stale until their next one
+    if (dirty_regions & (1u << frame)) {
+        std::memcpy(static_cast<uint8_t*>(vertex_data_pointer) + vertex_region_size * frame, vertices.data(), vertices.size() * sizeof(Vertex));
+        VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, vertex_memory, vertex_region_size * frame, vertex_region_size };
+        vkFlushMappedMemoryRanges(device, 1, &mapped_memory_range);
+        region_vertex_counts[frame] = static_cast<uint32_t>(vertices.size());
+        dirty_regions &= ~(1u << frame);
+    }
+
+    double update_msec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - update_begin).count();
+    cpu_msec += (update_msec - cpu_msec) * average_weight;
+    updates++;
+}
+
+// the graphs are most of the quads, so they are the first to go when the pass itself is the larger cost;
+// a longer interval only saves CPU time
+void PerfHud::adjust_to_budget() {
+    double cost_msec = cpu_msec + gpu_msec;
+    if (cost_msec > budget_msec) {
+        over_budget_adjustments++;
+        if (is_graph_shown && (gpu_msec > cpu_msec || update_interval == max_update_interval)) { is_graph_shown = false; }
+        else if (update_interval < max_update_interval) { update_interval *= 2; }
+    }
+    else if (cost_msec < budget_msec * 0.25) {
+        if (!is_graph_shown) { is_graph_shown = true; }
+        else if (update_interval > 1) { update_interval /= 2; }
+    }
+}
+
+void PerfHud::build(const Counters& counters, VkExtent2D window_extent) {
+    layout_extent = window_extent;
+    vertices.clear();
+
+    const uint32_t max_lines = 6;
+    char lines[max_lines][96];
+    snprintf(lines[0], sizeof(lines[0]), "FRAME CPU %6.2f  GPU %6.2f MS  SCALE %.2f", counters.cpu_frame_msec, counters.gpu_frame_msec, counters.render_scale);
+    snprintf(lines[1], sizeof(lines[1]), "CPU WAIT %.2f  CULL %.2f  RECORD %.2f", counters.cpu_wait_msec, counters.cpu_cull_msec, counters.cpu_record_msec);
+    snprintf(lines[2], sizeof(lines[2]), "GPU ANIM %.2f  SCENE %.2f  POST %.2f", counters.gpu_animation_msec, counters.gpu_scene_msec, counters.gpu_post_msec);
+    snprintf(lines[3], sizeof(lines[3]), "%llu DRAWS  %llu CALLS  %llu BINDS  %.1fK TRIS", static_cast<unsigned long long>(counters.draws),
+        static_cast<unsigned long long>(counters.draw_calls), static_cast<unsigned long long>(counters.bind_calls), counters.triangles / 1000.0);
+    snprintf(lines[4], sizeof(lines[4]), "VRAM %.1f / %.0f MIB", counters.device_memory_allocated / (1024.0 * 1024.0), counters.device_memory_budget / (1024.0 * 1024.0));
+    snprintf(lines[5], sizeof(lines[5]), "HUD %.3f MS OF %.2f, EVERY %u FRAMES", cpu_msec + gpu_msec, budget_msec, update_interval);
+
+    float cpu_max_msec = *std::max_element(cpu_history, cpu_history + history_size);
+    float gpu_max_msec = *std::max_element(gpu_history, gpu_history + history_size);
+    char cpu_label[48];
+    char gpu_label[48];
+    snprintf(cpu_label, sizeof(cpu_label), "CPU FRAME MS, MAX %.1f", cpu_max_msec);
+    snprintf(gpu_label, sizeof(gpu_label), "GPU FRAME MS, MAX %.1f", gpu_max_msec);
+
+    // the panel is sized to the longest line and drawn first, under everything else
+    size_t columns = 0;
+    for (uint32_t i = 0; i < max_lines; i++) {
+        columns = std::max(columns, std::strlen(lines[i]));
+    }
+    float panel_width = std::max(columns * cell_width * glyph_scale, is_graph_shown ? history_size * bar_width : 0.0f) + 2.0f * padding;
+    float panel_height = max_lines * line_height + (is_graph_shown ? 2.0f * (line_height + graph_height + padding) : 0.0f) + 2.0f * padding;
+    add_rectangle(margin, margin, margin + panel_width, margin + panel_height, panel);
+
+    float x = margin + padding;
+    float y = margin + padding;
+    for (uint32_t i = 0; i < max_lines; i++) {
+        add_text(x, y, lines[i], i == max_lines - 1 ? gray : white);
+        y += line_height;
+    }
+    if (is_graph_shown) {
+        y += padding;
+        add_graph(x, y, cpu_label, cpu_history);
+        y += line_height + graph_height + padding;
+        add_graph(x, y, gpu_label, gpu_history);
+    }
+}
+
+// (x0, y0) is the top left corner in window pixels
+void PerfHud::add_quad(float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1, uint32_t color) {
+    if (vertices.size() + 6 > 6 * max_quads) {
+        dropped_quads++;
+        return;
+    }
+    float scale_x = 2.0f / layout_extent.width;
+    float scale_y = 2.0f / layout_extent.height;
+    Vertex top_left = { x0 * scale_x - 1.0f, y0 * scale_y - 1.0f, u0, v0, color };
+    Vertex top_right = { x1 * scale_x - 1.0f, y0 * scale_y - 1.0f, u1, v0, color };
+    Vertex bottom_right = { x1 * scale_x - 1.0f, y1 * scale_y - 1.0f, u1, v1, color };
+    Vertex bottom_left = { x0 * scale_x - 1.0f, y1 * scale_y - 1.0f, u0, v1, color };
+    vertices.insert(vertices.end(), { top_left, top_right, bottom_right, top_left, bottom_right, bottom_left });
+}
+
+void PerfHud::add_rectangle(float x0, float y0, float x1, float y1, uint32_t color) {
+    float u = (atlas_width - 0.5f) / atlas_width;
+    float v = (atlas_height - 0.5f) / atlas_height;
+    add_quad(x0, y0, x1, y1, u, v, u, v, color);
+}
+
+void PerfHud::add_text(float x, float y, const char* text, uint32_t color) {
+    for (const char* c = text; *c != '\0'; c++, x += cell_width * glyph_scale) {
+        int character = std::toupper(static_cast<unsigned char>(*c));
+        if (character <= ' ' || character > '_') { continue; }
+        uint32_t glyph = character - ' ';
+        float u = static_cast<float>((glyph % atlas_columns) * cell_width) / atlas_width;
+        float v = static_cast<float>((glyph / atlas_columns) * cell_height) / atlas_height;
+        add_quad(x, y, x + glyph_width * glyph_scale, y + glyph_height * glyph_scale,
+            u, v, u + static_cast<float>(glyph_width) / atlas_width, v + static_cast<float>(glyph_height) / atlas_height, color);
+    }
+}
+
+// one bar per sample, the oldest on the left, scaled to 33.3 msec with a line at 16.7
+void PerfHud::add_graph(float x, float y, const char* label, const float* history) {
+    add_text(x, y, label, gray);
+    y += line_height;
+    add_rectangle(x, y, x + history_size * bar_width, y + graph_height, graph_background);
+    for (uint32_t i = 0; i < history_size; i++) {
+        float msec = history[(history_cursor + i) % history_size];
+        float height = std::min(msec / graph_max_msec, 1.0f) * graph_height;
+        if (height <= 0.0f) { continue; }
+        uint32_t color = msec <= graph_line_msec ? green : (msec <= graph_max_msec ? yellow : red);
+        add_rectangle(x + i * bar_width, y + graph_height - height, x + (i + 1) * bar_width, y + graph_height, color);
+    }
+    float line_y = y + graph_height * (1.0f - graph_line_msec / graph_max_msec);
+    add_rectangle(x, line_y, x + history_size * bar_width, line_y + 1.0f, graph_line);
+}
+
+void PerfHud::record(VkCommandBuffer command_buffer, uint32_t frame, VkFramebuffer framebuffer, VkExtent2D extent) {
+    if (!is_atlas_uploaded) {
+        VkImageMemoryBarrier image_memory_barrier = {
+            VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            nullptr,
+            0,
+            VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            atlas_image,
+            { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+        };
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+        VkBufferImageCopy buffer_image_copy = { 0, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 }, { 0, 0, 0 }, { atlas_width, atlas_height, 1 } };
+        vkCmdCopyBufferToImage(command_buffer, staging_buffer, atlas_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_image_copy);
+        image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+        is_atlas_uploaded = true;
+        staging_frames_left = frames_in_flight;
+    }
+    else if (staging_frames_left > 0 && --staging_frames_left == 0) {
+        // the frame that copied from it has been waited for by now
+        vkDestroyBuffer(device, staging_buffer, nullptr);
+        memory_tracker.free(device, staging_memory);
+        staging_buffer = VK_NULL_HANDLE;
+        staging_memory = VK_NULL_HANDLE;
+    }
+
+    VkRenderPassBeginInfo render_pass_begin_info = {
+        VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        nullptr,
+        render_pass,
+        framebuffer,
+        { { 0, 0 }, extent },
+        0,
+        nullptr
+    };
+    vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+    VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f };
+    VkRect2D scissor = { { 0, 0 }, extent };
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+    pipeline_registry.bind(command_buffer, pipeline);
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_registry.get_pipeline_layout(layout), 0, 1, &descriptor_set, 0, nullptr);
+    VkDeviceSize offset = vertex_region_size * frame;
+    vkCmdBindVertexBuffers(command_buffer, 0, 1, &vertex_buffer, &offset);
+    vkCmdDraw(command_buffer, region_vertex_counts[frame], 1, 0, 0);
+    vkCmdEndRenderPass(command_buffer);
+}
+
+void PerfHud::report(std::ostream& stream) {
+    stream << "HUD: " << cpu_msec << " msec CPU and " << gpu_msec << " msec GPU per frame, budget " << budget_msec
+        << " msec, rebuilt every " << update_interval << " frames" << (is_graph_shown ? "" : " without graphs") << ", "
+        << over_budget_adjustments << " adjustments over budget";
+    if (dropped_quads > 0) { stream << ", " << dropped_quads << " quads dropped"; }
+    stream << std::endl;
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include "volk.h"
+#include "memory_tracker.h"
+#include "pipeline_registry.h"
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Overlay of the live frame counters: frame time graphs, CPU and GPU stage times, device memory and draw counts.
+// It is drawn into the render target in a render pass of its own that loads what the scene left there. Text uses a
+// 5x7 bitmap font baked into a small R8 atlas, graphs and panels sample a solid texel of the same atlas, so the whole
+// overlay is one vertex format and a single non-indexed draw from one region per frame in flight of a host-visible buffer.
+// The HUD measures itself: update() is timed on the CPU and the caller passes back the GPU time of the pass. When the
+// two exceed the budget the text is rebuilt less often, then the graphs are left out; both come back once the cost
+// drops well below it.
+class PerfHud {
+public:
+    // filled by the caller every frame, msec of stages that did not run are 0
+    struct Counters {
+        double cpu_frame_msec;
+        double cpu_wait_msec;
+        double cpu_cull_msec;
+        double cpu_record_msec;
+        double gpu_frame_msec;
+        double gpu_animation_msec;
+        double gpu_scene_msec;
+        double gpu_post_msec;
+        double gpu_hud_msec;
+        float render_scale;
+        uint64_t bind_calls;
+        uint64_t draw_calls;
+        uint64_t draws;
+        uint64_t triangles;
+        VkDeviceSize device_memory_allocated;
+        VkDeviceSize device_memory_budget;
+    };
+
+    // target_layout is the layout the scene pass leaves the render target in, the HUD pass keeps it
+    PerfHud(VkDevice device, const VkPhysicalDeviceMemoryProperties& physical_device_memory_properties, MemoryTracker& memory_tracker, PipelineRegistry& pipeline_registry,
+        VkFormat target_format, VkImageLayout target_layout, uint32_t frames_in_flight, float budget_msec, const std::string& vertex_shader_path, const std::string& fragment_shader_path);
+    ~PerfHud();
+
+    // quads are laid out in pixels of window_extent, the size the render target is shown at
+    void update(uint32_t frame, const Counters& counters, VkExtent2D window_extent);
+    // framebuffer of the render target the scene pass drew to, extent is the part of it that was rendered
+    void record(VkCommandBuffer command_buffer, uint32_t frame, VkFramebuffer framebuffer, VkExtent2D extent);
+    void report(std::ostream& stream);
+
+    typedef enum Errors {
+        HUD_IMAGE_CREATION_FAILED = -1,
+        HUD_BUFFER_CREATION_FAILED = -2,
+        HUD_MEMORY_ALLOCATION_FAILED = -3,
+        HUD_RENDER_PASS_CREATION_FAILED = -4
+    } Errors;
+
+private:
+    struct Vertex {
+        float x;
+        float y;
+        float u;
+        float v;
+        uint32_t color;
+    };
+
+    static constexpr uint32_t history_size = 128;
+    static constexpr uint32_t max_quads = 2048;
+    static constexpr uint32_t max_update_interval = 32;
+
+    VkBuffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, const std::string& tag, VkDeviceMemory* memory);
+    void create_atlas();
+    void create_render_pass(VkFormat target_format, VkImageLayout target_layout);
+    void create_descriptor_set();
+    void create_pipeline(VkFormat target_format, const std::string& vertex_shader_path, const std::string& fragment_shader_path);
+    void build(const Counters& counters, VkExtent2D window_extent);
+    void adjust_to_budget();
+    void add_quad(float x0, float y0, float x1, float y1, float u0, float v0, float u1, float v1, uint32_t color);
+    void add_rectangle(float x0, float y0, float x1, float y1, uint32_t color);
+    void add_text(float x, float y, const char* text, uint32_t color);
+    void add_graph(float x, float y, const char* label, const float* history);
+
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties physical_device_memory_properties;
+    MemoryTracker& memory_tracker;
+    PipelineRegistry& pipeline_registry;
+    uint32_t frames_in_flight;
+    float budget_msec;
+
+    VkImage atlas_image;
+    VkDeviceMemory atlas_memory;
+    VkImageView atlas_view;
+    VkSampler sampler;
+    // copied into the atlas by the first record(), freed once that frame is done
+    VkBuffer staging_buffer = VK_NULL_HANDLE;
+    VkDeviceMemory staging_memory = VK_NULL_HANDLE;
+    uint32_t staging_frames_left = 0;
+    bool is_atlas_uploaded = false;
+
+    VkRenderPass render_pass;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSet descriptor_set;
+    uint32_t layout;
+    uint32_t pipeline;
+
+    VkBuffer vertex_buffer;
+    VkDeviceMemory vertex_memory;
+    void* vertex_data_pointer;
+    VkDeviceSize vertex_region_size;
+    std::vector<uint32_t> region_vertex_counts;
+    // bit per region that still holds vertices older than the last build
+    uint32_t dirty_regions = 0;
+
+    // vertices of the last build, in normalized device coordinates of a layout_extent sized window
+    std::vector<Vertex> vertices;
+    VkExtent2D layout_extent = { 1, 1 };
+    float cpu_history[history_size] = {};
+    float gpu_history[history_size] = {};
+    uint32_t history_cursor = 0;
+
+    uint32_t update_interval = 1;
+    uint32_t frames_since_build = 0;
+    bool is_graph_shown = true;
+    // moving averages of the HUD's own cost per frame
+    double cpu_msec = 0.0;
+    double gpu_msec = 0.0;
+    uint64_t updates = 0;
+    uint64_t builds = 0;
+    uint64_t last_adjust_update = 0;
+    uint64_t over_budget_adjustments = 0;
+    uint64_t dropped_quads = 0;
+};
@@ -0,0 +1,349 @@
+#include "pipeline_registry.h"
+
+#include <chrono>
+#include <cstring>
+
+static_assert(sizeof(PipelineRegistry::State) % sizeof(uint32_t) == 0 && sizeof(PipelineRegistry::State) == (18 + 3 * PipelineRegistry::max_vertex_bindings + 4 * PipelineRegistry::max_vertex_attributes) * sizeof(uint32_t),
+    "PipelineRegistry::State is compared and hashed as bytes, it must not contain padding");
+
+bool PipelineRegistry::State::operator==(const State& other) const {
+    return std::memcmp(this, &other, sizeof(State)) == 0;
+}
+
+// FNV-1a over the words of the state
+size_t PipelineRegistry::StateHash::operator()(const State& state) const {
+    uint32_t words[sizeof(State) / sizeof(uint32_t)];
+    std::memcpy(words, &state, sizeof(State));
+    uint64_t hash = 14695981039346656037ull;
+    for (uint32_t word : words) {
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    return static_cast<size_t>(hash);
+}
+
+PipelineRegistry::PipelineRegistry(VkDevice device, VkPipelineCache pipeline_cache) :
+    device(device),
+    pipeline_cache(pipeline_cache) {
+}
+
+PipelineRegistry::~PipelineRegistry() {
+    for (Pipeline& pipeline : pipelines) {
+        vkDestroyPipeline(device, pipeline.pipeline, nullptr);
+    }
+    for (Layout& layout : layouts) {
+        vkDestroyPipelineLayout(device, layout.pipeline_layout, nullptr);
+    }
+    for (VkDescriptorSetLayout set_layout : set_layouts) {
+        vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+    }
+    for (VkShaderModule shader : shaders) {
+        vkDestroyShaderModule(device, shader, nullptr);
+    }
+}
+
+uint32_t PipelineRegistry::add_shader(const std::vector<char>& code) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::string key(code.begin(), code.end());
+    auto found = shader_ids.find(key);
+    if (found != shader_ids.end()) { return found->second; }
+
+    VkShaderModuleCreateInfo shader_module_create_info = {
+        VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        nullptr,
+        0,
+        code.size(),
+        reinterpret_cast<const uint32_t*>(code.data())
+    };
+    VkShaderModule shader;
+    if (vkCreateShaderModule(device, &shader_module_create_info, nullptr, &shader)) { throw REGISTRY_SHADER_MODULE_CREATION_FAILED; }
+    shaders.push_back(shader);
+    return shader_ids[key] = static_cast<uint32_t>(shaders.size() - 1);
+}
+
+// identical sets of bindings share a descriptor set layout, identical lists of set layouts and push constants a pipeline layout
+uint32_t PipelineRegistry::add_layout(const std::vector<std::vector<VkDescriptorSetLayoutBinding>>& set_bindings, const std::vector<VkPushConstantRange>& push_constant_ranges) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<uint32_t> layout_key;
+    std::vector<VkDescriptorSetLayout> layout_set_layouts;
+    for (const auto& bindings : set_bindings) {
+        std::vector<uint32_t> set_layout_key;
+        for (const VkDescriptorSetLayoutBinding& binding : bindings) {
+            set_layout_key.insert(set_layout_key.end(), { binding.binding, static_cast<uint32_t>(binding.descriptorType), binding.descriptorCount, binding.stageFlags });
+        }
+        auto found = set_layout_ids.find(set_layout_key);
+        if (found == set_layout_ids.end()) {
+            VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {
+                VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+                nullptr,
+                0,
+                static_cast<uint32_t>(bindings.size()),
+                bindings.data()
+            };
+            VkDescriptorSetLayout set_layout;
+            if (vkCreateDescriptorSetLayout(device, &descriptor_set_layout_create_info, nullptr, &set_layout)) { throw REGISTRY_LAYOUT_CREATION_FAILED; }
+            set_layouts.push_back(set_layout);
+            found = set_layout_ids.emplace(set_layout_key, static_cast<uint32_t>(set_layouts.size() - 1)).first;
+        }
+        layout_key.push_back(found->second);
+        layout_set_layouts.push_back(set_layouts[found->second]);
+    }
+    std::vector<uint32_t> set_layout_list = layout_key;
+    layout_key.push_back(UINT32_MAX);
+    for (const VkPushConstantRange& range : push_constant_ranges) {
+        layout_key.insert(layout_key.end(), { range.stageFlags, range.offset, range.size });
+    }
+    auto found = layout_ids.find(layout_key);
+    if (found != layout_ids.end()) { return found->second; }
+
+    VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        nullptr,
+        0,
+        static_cast<uint32_t>(layout_set_layouts.size()),
+        layout_set_layouts.data(),
+        static_cast<uint32_t>(push_constant_ranges.size()),
+        push_constant_ranges.data()
+    };
+    VkPipelineLayout pipeline_layout;
+    if (vkCreatePipelineLayout(device, &pipeline_layout_create_info, nullptr, &pipeline_layout)) { throw REGISTRY_LAYOUT_CREATION_FAILED; }
+    layouts.push_back({ set_layout_list, pipeline_layout });
+    return layout_ids[layout_key] = static_cast<uint32_t>(layouts.size() - 1);
+}
+
+// pipelines only depend on the formats and sample counts of the attachments, so compatible render passes share them
+uint32_t PipelineRegistry::add_render_pass(VkRenderPass render_pass, const std::vector<VkFormat>& color_formats, VkSampleCountFlagBits samples) {
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<uint32_t> key = { static_cast<uint32_t>(samples) };
+    for (VkFormat format : color_formats) {
+        key.push_back(static_cast<uint32_t>(format));
+    }
+    auto found = render_pass_ids.find(key);
+    if (found != render_pass_ids.end()) { return found->second; }
+    render_passes.push_back(render_pass);
+    return render_pass_ids[key] = static_cast<uint32_t>(render_passes.size() - 1);
+}
+
+uint32_t PipelineRegistry::get(const State& state) {
+    std::lock_guard<std::mutex> lock(mutex);
+    requests++;
+    auto found = pipeline_ids.find(state);
+    if (found != pipeline_ids.end()) {
+        pipelines[found->second].requests++;
+        return found->second;
+    }
+
+    VkPipelineShaderStageCreateInfo pipeline_shaders_stage_create_info[2] = {
+        {
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            nullptr,
+            0,
+            VK_SHADER_STAGE_VERTEX_BIT,
+            shaders[state.vertex_shader],
+            "main",
+            nullptr
+        },
+        {
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            nullptr,
+            0,
+            VK_SHADER_STAGE_FRAGMENT_BIT,
+            shaders[state.fragment_shader],
+            "main",
+            nullptr
+        }
+    };
+
+    VkVertexInputBindingDescription vertex_input_binding_descriptions[max_vertex_bindings];
+    for (uint32_t i = 0; i < state.vertex_binding_count; i++) {
+        const VertexBinding& binding = state.vertex_bindings[i];
+        vertex_input_binding_descriptions[i] = { binding.binding, binding.stride, static_cast<VkVertexInputRate>(binding.input_rate) };
+    }
+    VkVertexInputAttributeDescription vertex_input_attribute_descriptions[max_vertex_attributes];
+    for (uint32_t i = 0; i < state.vertex_attribute_count; i++) {
+        const VertexAttribute& attribute = state.vertex_attributes[i];
+        vertex_input_attribute_descriptions[i] = { attribute.location, attribute.binding, static_cast<VkFormat>(attribute.format), attribute.offset };
+    }
+    VkPipelineVertexInputStateCreateInfo pipeline_vertex_input_state_create_info = {
+        VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        nullptr,
+        0,
+        state.vertex_binding_count,
+        vertex_input_binding_descriptions,
+        state.vertex_attribute_count,
+        vertex_input_attribute_descriptions
+    };
+
+    VkPipelineInputAssemblyStateCreateInfo pipeline_input_assembly_create_info = {
+        VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        nullptr,
+        0,
+        static_cast<VkPrimitiveTopology>(state.topology),
+        VK_FALSE
+    };
+
+    // viewport and scissor are always dynamic
+    VkPipelineViewportStateCreateInfo pipeline_viewport_state_create_info = {
+        VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        nullptr,
+        0,
+        1,
+        nullptr,
+        1,
+        nullptr
+    };
+
+    VkPipelineRasterizationStateCreateInfo pipeline_rasterization_state_create_info = {
+        VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        nullptr,
+        0,
+        VK_FALSE,
+        VK_FALSE,
+        static_cast<VkPolygonMode>(state.polygon_mode),
+        state.cull_mode,
+        static_cast<VkFrontFace>(state.front_face),
+        VK_FALSE,
+        0.0f,
+        0.0f,
+        0.0f,
+        1.0f
+    };
+
+    VkPipelineMultisampleStateCreateInfo pipeline_multisample_state_create_info = {
+        VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        nullptr,
+        0,
+        VK_SAMPLE_COUNT_1_BIT,
+        VK_FALSE,
+        1.0f,
+        nullptr,
+        VK_FALSE,
+        VK_FALSE
+    };
+
+    VkPipelineColorBlendAttachmentState pipeline_color_blend_attachment_state = {
+        state.blend_enable,
+        static_cast<VkBlendFactor>(state.src_color_blend_factor),
+        static_cast<VkBlendFactor>(state.dst_color_blend_factor),
+        static_cast<VkBlendOp>(state.color_blend_op),
+        static_cast<VkBlendFactor>(state.src_alpha_blend_factor),
+        static_cast<VkBlendFactor>(state.dst_alpha_blend_factor),
+        static_cast<VkBlendOp>(state.alpha_blend_op),
+        state.color_write_mask
+    };
+    VkPipelineColorBlendStateCreateInfo pipeline_color_blend_state_create_info = {
+        VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        nullptr,
+        0,
+        VK_FALSE,
+        VK_LOGIC_OP_COPY,
+        1,
+        &pipeline_color_blend_attachment_state,
+        {0.0f,0.0f,0.0f,0.0f}
+    };
+
+    VkDynamicState dynamic_states[] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
+    VkPipelineDynamicStateCreateInfo pipeline_dynamic_state_create_info = {
+        VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        nullptr,
+        0,
+        2,
+        dynamic_states
+    };
+
+    VkGraphicsPipelineCreateInfo graphics_pipeline_create_info = {
+        VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+        nullptr,
+        0,
+        2,
+        pipeline_shaders_stage_create_info,
+        &pipeline_vertex_input_state_create_info,
+        &pipeline_input_assembly_create_info,
+        nullptr,
+        &pipeline_viewport_state_create_info,
+        &pipeline_rasterization_state_create_info,
+        &pipeline_multisample_state_create_info,
+        nullptr,
+        &pipeline_color_blend_state_create_info,
+        &pipeline_dynamic_state_create_info,
+        layouts[state.layout].pipeline_layout,
+        render_passes[state.render_pass],
+        0,
+        VK_NULL_HANDLE,
+        -1
+    };
+    auto begin = std::chrono::steady_clock::now();
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(device, pipeline_cache, 1, &graphics_pipeline_create_info, nullptr, &pipeline)) { throw REGISTRY_PIPELINE_CREATION_FAILED; }
+    double creation_msec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+    pipelines.push_back({ state, pipeline, creation_msec, 1, 0 });
+    return pipeline_ids[state] = static_cast<uint32_t>(pipelines.size() - 1);
+}
+
+VkPipeline PipelineRegistry::get_pipeline(uint32_t pipeline) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pipelines[pipeline].pipeline;
+}
+
+PipelineRegistry::State PipelineRegistry::get_state(uint32_t pipeline) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pipelines[pipeline].state;
+}
+
+VkPipelineLayout PipelineRegistry::get_pipeline_layout(uint32_t layout) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return layouts[layout].pipeline_layout;
+}
+
+VkDescriptorSetLayout PipelineRegistry::get_descriptor_set_layout(uint32_t layout, uint32_t set) {
+    std::lock_guard<std::mutex> lock(mutex);
+    return set_layouts[layouts[layout].set_layouts[set]];
+}
+
+// draws sorted by this key change the layout least often, then the shaders, and bind each pipeline once
+uint64_t PipelineRegistry::get_sort_key(uint32_t pipeline) {
+    std::lock_guard<std::mutex> lock(mutex);
+    const State& state = pipelines[pipeline].state;
+    return (static_cast<uint64_t>(state.layout & 0xffff) << 48) | (static_cast<uint64_t>(state.render_pass & 0xff) << 40) |
+        (static_cast<uint64_t>(state.vertex_shader & 0xfff) << 28) | (static_cast<uint64_t>(state.fragment_shader & 0xfff) << 16) | (pipeline & 0xffff);
+}
+
+void PipelineRegistry::begin_recording() {
+    bound_pipeline = UINT32_MAX;
+}
+
+bool PipelineRegistry::bind(VkCommandBuffer command_buffer, uint32_t pipeline) {
+    if (pipeline == bound_pipeline) {
+        redundant_binds++;
+        return false;
+    }
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines[pipeline].pipeline);
+    pipelines[pipeline].binds++;
+    bound_pipeline = pipeline;
+    binds++;
+    return true;
+}
+
+// bind counts are since the previous report, over the given number of frames
+void PipelineRegistry::report(std::ostream& stream, uint32_t frames) {
+    std::lock_guard<std::mutex> lock(mutex);
+    double creation_msec = 0.0;
+    for (const Pipeline& pipeline : pipelines) {
+        creation_msec += pipeline.creation_msec;
+    }
+    stream << "Pipelines: " << pipelines.size() << " created for " << requests << " requests, " << layouts.size() << " pipeline layouts, " << set_layouts.size()
+        << " descriptor set layouts, " << shaders.size() << " shader modules, creation msec: " << creation_msec;
+    if (frames > 0) {
+        stream << ", binds/frame: " << static_cast<double>(binds) / frames << " (" << static_cast<double>(redundant_binds) / frames << " redundant skipped)";
+    }
+    stream << std::endl;
+    for (uint32_t i = 0; i < pipelines.size(); i++) {
+        Pipeline& pipeline = pipelines[i];
+        stream << "  pipeline " << i << ": creation msec " << pipeline.creation_msec << ", requests " << pipeline.requests;
+        if (frames > 0) { stream << ", binds/frame " << static_cast<double>(pipeline.binds) / frames; }
+        stream << std::endl;
+        pipeline.binds = 0;
+    }
+    binds = 0;
+    redundant_binds = 0;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include "volk.h"
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Owns every graphics pipeline of the program together with the shader modules, descriptor set layouts and pipeline
+// layouts they use. A pipeline is requested with a State, a flat description that only refers to shaders, layouts and
+// render passes by the ids the registry gave them, so identical states hash the same and get the same pipeline.
+// Shaders with the same code, layouts with the same bindings and render passes with the same attachment formats
+// (compatible ones, as far as pipelines are concerned) are deduplicated too.
+// Creation time, requests and binds are counted per pipeline; bind() drops binds of the pipeline already bound,
+// so sorting draws by get_sort_key() keeps vkCmdBindPipeline calls to one per distinct state.
+class PipelineRegistry {
+public:
+    static constexpr uint32_t max_vertex_bindings = 2;
+    static constexpr uint32_t max_vertex_attributes = 4;
+
+    // 32 bit fields only, so a State has no padding and can be hashed and compared as bytes
+    struct VertexBinding {
+        uint32_t binding;
+        uint32_t stride;
+        uint32_t input_rate;
+    };
+    struct VertexAttribute {
+        uint32_t location;
+        uint32_t binding;
+        uint32_t format;
+        uint32_t offset;
+    };
+    struct State {
+        uint32_t vertex_shader = 0;
+        uint32_t fragment_shader = 0;
+        uint32_t layout = 0;
+        uint32_t render_pass = 0;
+        uint32_t vertex_binding_count = 0;
+        VertexBinding vertex_bindings[max_vertex_bindings] = {};
+        uint32_t vertex_attribute_count = 0;
+        VertexAttribute vertex_attributes[max_vertex_attributes] = {};
+        uint32_t topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+        uint32_t polygon_mode = VK_POLYGON_MODE_FILL;
+        uint32_t cull_mode = VK_CULL_MODE_NONE;
+        uint32_t front_face = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+        uint32_t blend_enable = VK_FALSE;
+        uint32_t src_color_blend_factor = VK_BLEND_FACTOR_ONE;
+        uint32_t dst_color_blend_factor = VK_BLEND_FACTOR_ZERO;
+        uint32_t color_blend_op = VK_BLEND_OP_ADD;
+        uint32_t src_alpha_blend_factor = VK_BLEND_FACTOR_ONE;
+        uint32_t dst_alpha_blend_factor = VK_BLEND_FACTOR_ZERO;
+        uint32_t alpha_blend_op = VK_BLEND_OP_ADD;
+        uint32_t color_write_mask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+
+        bool operator==(const State& other) const;
+    };
+
+    PipelineRegistry(VkDevice device, VkPipelineCache pipeline_cache);
+    ~PipelineRegistry();
+
+    uint32_t add_shader(const std::vector<char>& code);
+    uint32_t add_layout(const std::vector<std::vector<VkDescriptorSetLayoutBinding>>& set_bindings, const std::vector<VkPushConstantRange>& push_constant_ranges = {});
+    uint32_t add_render_pass(VkRenderPass render_pass, const std::vector<VkFormat>& color_formats, VkSampleCountFlagBits samples);
+    uint32_t get(const State& state);
+
+    VkPipeline get_pipeline(uint32_t pipeline);
+    State get_state(uint32_t pipeline);
+    VkPipelineLayout get_pipeline_layout(uint32_t layout);
+    VkDescriptorSetLayout get_descriptor_set_layout(uint32_t layout, uint32_t set);
+    uint64_t get_sort_key(uint32_t pipeline);
+
+    // for the recording thread, once the pipelines it binds are created; bind() returns false for a skipped bind
+    void begin_recording();
+    bool bind(VkCommandBuffer command_buffer, uint32_t pipeline);
+
+    void report(std::ostream& stream, uint32_t frames);
+
+    typedef enum Errors {
+        REGISTRY_SHADER_MODULE_CREATION_FAILED = -1,
+        REGISTRY_LAYOUT_CREATION_FAILED = -2,
+        REGISTRY_PIPELINE_CREATION_FAILED = -3
+    } Errors;
+
+private:
+    struct StateHash {
+        size_t operator()(const State& state) const;
+    };
+
+    struct Layout {
+        std::vector<uint32_t> set_layouts;
+        VkPipelineLayout pipeline_layout;
+    };
+
+    struct Pipeline {
+        State state;
+        VkPipeline pipeline;
+        double creation_msec;
+        uint32_t requests;
+        uint64_t binds;
+    };
+
+    VkDevice device;
+    VkPipelineCache pipeline_cache;
+
+    std::mutex mutex;
+    std::vector<VkShaderModule> shaders;
+    std::unordered_map<std::string, uint32_t> shader_ids;
+    std::vector<VkDescriptorSetLayout> set_layouts;
+    std::map<std::vector<uint32_t>, uint32_t> set_layout_ids;
+    std::vector<Layout> layouts;
+    std::map<std::vector<uint32_t>, uint32_t> layout_ids;
+    // the first render pass of each compatibility class is the one pipelines are created with
+    std::vector<VkRenderPass> render_passes;
+    std::map<std::vector<uint32_t>, uint32_t> render_pass_ids;
+    std::vector<Pipeline> pipelines;
+    std::unordered_map<State, uint32_t, StateHash> pipeline_ids;
+    uint32_t requests = 0;
+
+    uint32_t bound_pipeline = UINT32_MAX;
+    uint64_t binds = 0;
+    uint64_t redundant_binds = 0;
+};
@@ -0,0 +1,223 @@
+#include "post_process.h"
+
+#include <fstream>
+#include <filesystem>
+
+namespace {
+    constexpr uint32_t workgroup_size = 8;
+}
+
+PostProcess::PostProcess(VkDevice device, uint32_t queue_family_index, uint32_t frames_in_flight, uint32_t max_targets, Mode mode, const std::string& shader_path) :
+    device(device),
+    frames_in_flight(frames_in_flight),
+    max_targets(max_targets),
+    mode(mode) {
+    VkCommandPoolCreateInfo command_pool_create_info = {
+        VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        nullptr,
+        VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT,
+        queue_family_index
+    };
+    if (vkCreateCommandPool(device, &command_pool_create_info, nullptr, &command_pool)) { throw POST_COMMAND_POOL_CREATION_FAILED; }
+
+    VkCommandBufferAllocateInfo command_buffer_allocate_info = {
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        nullptr,
+        command_pool,
+        VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        frames_in_flight
+    };
+    command_buffers.resize(frames_in_flight);
+    vkAllocateCommandBuffers(device, &command_buffer_allocate_info, command_buffers.data());
+
+    // texelFetch ignores the sampler state, but a combined image sampler still needs one
+    VkSamplerCreateInfo sampler_create_info = {
+        VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        nullptr,
+        0,
+        VK_FILTER_NEAREST,
+        VK_FILTER_NEAREST,
+        VK_SAMPLER_MIPMAP_MODE_NEAREST,
+        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
+        0.0f,
+        VK_FALSE,
+        1.0f,
+        VK_FALSE,
+        VK_COMPARE_OP_ALWAYS,
+        0.0f,
+        0.0f,
+        VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK,
+        VK_FALSE
+    };
+    vkCreateSampler(device, &sampler_create_info, nullptr, &sampler);
+
+    create_descriptor_sets();
+    create_pipeline(shader_path);
+}
+
+PostProcess::~PostProcess() {
+    vkDestroyPipeline(device, pipeline, nullptr);
+    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+    vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptor_set_layout, nullptr);
+    vkDestroySampler(device, sampler, nullptr);
+    vkFreeCommandBuffers(device, command_pool, command_buffers.size(), command_buffers.data());
+    vkDestroyCommandPool(device, command_pool, nullptr);
+}
+
+void PostProcess::create_descriptor_sets() {
+    uint32_t sets_count = frames_in_flight * max_targets;
+    VkDescriptorPoolSize descriptor_pool_sizes[2] = {
+        { VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, sets_count },
+        { VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, sets_count }
+    };
+    VkDescriptorPoolCreateInfo descriptor_pool_create_info = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        nullptr,
+        0,
+        sets_count,
+        2,
+        descriptor_pool_sizes
+    };
+    vkCreateDescriptorPool(device, &descriptor_pool_create_info, nullptr, &descriptor_pool);
+
+    VkDescriptorSetLayoutBinding descriptor_set_layout_bindings[2] = {
+        {
+            0,
+            VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+            1,
+            VK_SHADER_STAGE_COMPUTE_BIT,
+            nullptr
+        },
+        {
+            1,
+            VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+            1,
+            VK_SHADER_STAGE_COMPUTE_BIT,
+            nullptr
+        }
+    };
+    VkDescriptorSetLayoutCreateInfo descriptor_set_layout_create_info = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        nullptr,
+        0,
+        2,
+        descriptor_set_layout_bindings
+    };
+    vkCreateDescriptorSetLayout(device, &descriptor_set_layout_create_info, nullptr, &descriptor_set_layout);
+
+    std::vector<VkDescriptorSetLayout> descriptor_set_layouts(sets_count, descriptor_set_layout);
+    VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        nullptr,
+        descriptor_pool,
+        sets_count,
+        descriptor_set_layouts.data()
+    };
+    descriptor_sets.resize(sets_count);
+    vkAllocateDescriptorSets(device, &descriptor_set_allocate_info, descriptor_sets.data());
+}
+
+void PostProcess::create_pipeline(const std::string& shader_path) {
+    std::ifstream shader_file(shader_path, std::ios::in | std::ios::binary);
+    std::vector<char> shader_contents(std::filesystem::file_size(shader_path));
+    shader_file.read(shader_contents.data(), shader_contents.size());
+    VkShaderModuleCreateInfo shader_module_create_info = {
+        VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        nullptr,
+        0,
+        shader_contents.size(),
+        reinterpret_cast<uint32_t*>(shader_contents.data())
+    };
+    VkShaderModule compute_shader_module;
+    if (vkCreateShaderModule(device, &shader_module_create_info, nullptr, &compute_shader_module)) { throw POST_SHADER_MODULE_CREATION_FAILED; }
+
+    VkPushConstantRange push_constant_range = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstants) };
+    VkPipelineLayoutCreateInfo pipeline_layout_create_info = {
+        VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+        nullptr,
+        0,
+        1,
+        &descriptor_set_layout,
+        1,
+        &push_constant_range
+    };
+    vkCreatePipelineLayout(device, &pipeline_layout_create_info, nullptr, &pipeline_layout);
+
+    VkComputePipelineCreateInfo compute_pipeline_create_info = {
+        VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+        nullptr,
+        0,
+        {
+            VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+            nullptr,
+            0,
+            VK_SHADER_STAGE_COMPUTE_BIT,
+            compute_shader_module,
+            "main",
+            nullptr
+        },
+        pipeline_layout,
+        VK_NULL_HANDLE,
+        -1
+    };
+    VkResult res = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &compute_pipeline_create_info, nullptr, &pipeline);
+    vkDestroyShaderModule(device, compute_shader_module, nullptr);
+    if (res != VK_SUCCESS) { throw POST_PIPELINE_CREATION_FAILED; }
+}
+
+// must only be called once the previous submission of this frame has completed, its descriptor sets are rewritten
+VkCommandBuffer PostProcess::record(uint32_t frame, const std::vector<Target>& targets, VkQueryPool timestamp_query_pool, uint32_t begin_query, uint32_t end_query) {
+    std::vector<VkDescriptorImageInfo> descriptor_image_infos;
+    std::vector<VkWriteDescriptorSet> write_descriptor_sets;
+    descriptor_image_infos.reserve(2 * targets.size());
+    for (size_t i = 0; i < targets.size() && i < max_targets; i++) {
+        VkDescriptorSet descriptor_set = descriptor_sets[frame * max_targets + i];
+        descriptor_image_infos.push_back({ sampler, targets[i].input_view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL });
+        write_descriptor_sets.push_back({ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr, descriptor_set, 0, 0, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, &descriptor_image_infos.back(), nullptr, nullptr });
+        descriptor_image_infos.push_back({ VK_NULL_HANDLE, targets[i].output_view, VK_IMAGE_LAYOUT_GENERAL });
+        write_descriptor_sets.push_back({ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET, nullptr, descriptor_set, 1, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, &descriptor_image_infos.back(), nullptr, nullptr });
+    }
+    vkUpdateDescriptorSets(device, write_descriptor_sets.size(), write_descriptor_sets.data(), 0, nullptr);
+
+    VkCommandBuffer command_buffer = command_buffers[frame];
+    VkCommandBufferBeginInfo command_buffer_begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr };
+    vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+    if (timestamp_query_pool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_query_pool, begin_query);
+    }
+
+    // the previous contents are not needed, the blit of the previous use has been waited on through the frame fence
+    std::vector<VkImageMemoryBarrier> image_memory_barriers;
+    for (size_t i = 0; i < targets.size() && i < max_targets; i++) {
+        image_memory_barriers.push_back({
+            VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+            nullptr,
+            0,
+            VK_ACCESS_SHADER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_UNDEFINED,
+            VK_IMAGE_LAYOUT_GENERAL,
+            VK_QUEUE_FAMILY_IGNORED,
+            VK_QUEUE_FAMILY_IGNORED,
+            targets[i].output_image,
+            { VK_IMAGE_ASPECT_COLOR_BIT,0,1,0,1 }
+        });
+    }
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, image_memory_barriers.size(), image_memory_barriers.data());
+
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    for (size_t i = 0; i < targets.size() && i < max_targets; i++) {
+        PushConstants push_constants = { static_cast<int32_t>(targets[i].extent.width), static_cast<int32_t>(targets[i].extent.height), static_cast<uint32_t>(mode), 1.6f };
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_sets[frame * max_targets + i], 0, nullptr);
+        vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants), &push_constants);
+        vkCmdDispatch(command_buffer, (targets[i].extent.width + workgroup_size - 1) / workgroup_size, (targets[i].extent.height + workgroup_size - 1) / workgroup_size, 1);
+    }
+
+    if (timestamp_query_pool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool, end_query);
+    }
+    vkEndCommandBuffer(command_buffer);
+    return command_buffer;
+}
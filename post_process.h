@@ -0,0 +1,64 @@
+#pragma once
+#include "volk.h"
+
+#include <vector>
+#include <string>
+
+// Compute post-processing of the rendered scene (tonemap or blur), recorded for its own queue family so it can
+// run on an async compute queue while the graphics queue renders the next frame. The input is sampled in
+// SHADER_READ_ONLY_OPTIMAL layout, the output is a storage image left in GENERAL layout for the blit.
+// Synchronization with the graphics queue is done by the caller through semaphores.
+class PostProcess {
+public:
+    typedef enum Mode {
+        NONE,
+        TONEMAP,
+        BLUR
+    } Mode;
+
+    typedef struct Target {
+        VkImageView input_view;
+        VkImage output_image;
+        VkImageView output_view;
+        VkExtent2D extent;
+    } Target;
+
+    PostProcess(VkDevice device, uint32_t queue_family_index, uint32_t frames_in_flight, uint32_t max_targets, Mode mode, const std::string& shader_path);
+    ~PostProcess();
+
+    VkCommandBuffer record(uint32_t frame, const std::vector<Target>& targets, VkQueryPool timestamp_query_pool, uint32_t begin_query, uint32_t end_query);
+
+    static constexpr VkFormat output_format = VK_FORMAT_R8G8B8A8_UNORM;
+
+    typedef enum Errors {
+        POST_COMMAND_POOL_CREATION_FAILED = -1,
+        POST_SHADER_MODULE_CREATION_FAILED = -2,
+        POST_PIPELINE_CREATION_FAILED = -3
+    } Errors;
+
+private:
+    struct PushConstants {
+        int32_t width;
+        int32_t height;
+        uint32_t mode;
+        float exposure;
+    };
+
+    void create_descriptor_sets();
+    void create_pipeline(const std::string& shader_path);
+
+    VkDevice device;
+    uint32_t frames_in_flight;
+    uint32_t max_targets;
+    Mode mode;
+
+    VkCommandPool command_pool;
+    std::vector<VkCommandBuffer> command_buffers;
+    VkSampler sampler;
+    VkDescriptorPool descriptor_pool;
+    VkDescriptorSetLayout descriptor_set_layout;
+    // max_targets sets per frame in flight, rewritten when the frame is recorded again
+    std::vector<VkDescriptorSet> descriptor_sets;
+    VkPipelineLayout pipeline_layout;
+    VkPipeline pipeline;
+};
@@ -0,0 +1,866 @@
+#define VOLK_IMPLEMENTATION
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "volk.h"
+#include "vulkan_helper.h"
+#include "memory_tracker.h"
+#include "pipeline_registry.h"
+#include "command_stream.h"
+
+// Re-executes a command stream written by VulkanTriangle --stream-capture without a window or swapchain: the
+// resources are created and filled once, the commands are recorded once into a command buffer that is submitted
+// for every iteration, waiting on a fence in between, so each iteration is timed on its own on the CPU and the GPU
+class CommandStreamReplay {
+public:
+    CommandStreamReplay(const std::string& path);
+    ~CommandStreamReplay();
+    void run(uint32_t iterations);
+
+    typedef enum Errors {
+        VOLK_INITIALIZATION_FAILED = -1,
+        INSTANCE_CREATION_FAILED = -2,
+        DEVICE_CREATION_FAILED = -3,
+        MEMORY_ALLOCATION_FAILED = -4,
+        RESOURCE_CREATION_FAILED = -5,
+        UNKNOWN_RECORD = -6
+    } Errors;
+
+private:
+    typedef struct Target {
+        VkImage image;
+        VkDeviceMemory memory;
+        VkImageView view;
+        VkFramebuffer framebuffer;
+        VkRenderPass render_pass;
+    } Target;
+
+    typedef struct Image {
+        VkImage image;
+        VkDeviceMemory memory;
+        VkImageView view;
+    } Image;
+
+    void create_instance();
+    void create_device();
+    VkBuffer create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlagBits memory_properties, const std::string& tag, VkDeviceMemory* memory);
+    VkBuffer create_staging_buffer(const void* data, VkDeviceSize size);
+    VkRenderPass get_render_pass(VkFormat format);
+    void read_buffer(CommandStreamReader& reader);
+    void read_image(CommandStreamReader& reader);
+    void read_target(CommandStreamReader& reader);
+    void read_pipeline(CommandStreamReader& reader);
+    void read_descriptor_set(CommandStreamReader& reader);
+    void read_command(CommandStreamReader& reader);
+    void submit_setup();
+
+    VkInstance instance = VK_NULL_HANDLE;
+    VkPhysicalDevice physical_device;
+    VkPhysicalDeviceMemoryProperties physical_device_memory_properties;
+    uint32_t queue_family_index;
+    float timestamp_period;
+    uint32_t timestamp_valid_bits;
+    VkDevice device = VK_NULL_HANDLE;
+    VkQueue queue;
+    std::unique_ptr<MemoryTracker> memory_tracker;
+    std::unique_ptr<PipelineRegistry> pipeline_registry;
+
+    VkCommandPool command_pool;
+    VkCommandBuffer setup_command_buffer;
+    VkCommandBuffer replay_command_buffer;
+    VkQueryPool timestamp_query_pool = VK_NULL_HANDLE;
+    VkFence fence;
+    VkSampler sampler;
+
+    // the ids of the file, which shaders and layouts share with the registry of the capturing program
+    std::unordered_map<uint32_t, std::pair<VkBuffer, VkDeviceMemory>> buffers;
+    std::unordered_map<uint32_t, Image> images;
+    std::unordered_map<uint32_t, Target> targets;
+    std::unordered_map<uint32_t, uint32_t> shader_ids;
+    std::unordered_map<uint32_t, uint32_t> layout_ids;
+    std::unordered_map<uint32_t, VkPipeline> pipelines;
+    std::unordered_map<uint32_t, VkDescriptorSet> descriptor_sets;
+    std::vector<VkDescriptorPool> descriptor_pools;
+    std::unordered_map<VkFormat, VkRenderPass> render_passes;
+    std::vector<std::pair<VkBuffer, VkDeviceMemory>> staging_buffers;
+    // contents of the host-visible buffers, indirect draws are expanded from them without multiDrawIndirect
+    std::unordered_map<uint32_t, std::vector<char>> host_buffer_data;
+    bool is_multi_draw_indirect_supported;
+
+    size_t stream_size = 0;
+    uint32_t command_count = 0;
+    uint32_t draw_count = 0;
+    uint32_t indirect_draw_count = 0;
+    uint32_t pipeline_bind_count = 0;
+    uint32_t render_pass_count = 0;
+};
+
+CommandStreamReplay::CommandStreamReplay(const std::string& path) {
+    create_instance();
+    create_device();
+
+    CommandStreamReader reader(path);
+    while (reader.next()) {
+        switch (reader.get_type()) {
+        case command_stream::BUFFER: read_buffer(reader); break;
+        case command_stream::IMAGE: read_image(reader); break;
+        case command_stream::TARGET: read_target(reader); break;
+        case command_stream::SHADER: {
+            uint32_t id = reader.read<uint32_t>();
+            shader_ids[id] = pipeline_registry->add_shader(reader.read_bytes(reader.get_remaining_size()));
+            break;
+        }
+        case command_stream::LAYOUT: {
+            uint32_t id = reader.read<uint32_t>();
+            std::vector<VkDescriptorSetLayoutBinding> bindings(reader.read<uint32_t>());
+            for (VkDescriptorSetLayoutBinding& binding : bindings) {
+                binding.binding = reader.read<uint32_t>();
+                binding.descriptorType = static_cast<VkDescriptorType>(reader.read<uint32_t>());
+                binding.descriptorCount = reader.read<uint32_t>();
+                binding.stageFlags = reader.read<uint32_t>();
+                binding.pImmutableSamplers = nullptr;
+            }
+            layout_ids[id] = pipeline_registry->add_layout({ bindings });
+            break;
+        }
+        case command_stream::PIPELINE: read_pipeline(reader); break;
+        case command_stream::DESCRIPTOR_SET: read_descriptor_set(reader); break;
+        default: read_command(reader); break;
+        }
+    }
+    stream_size = reader.get_size();
+    if (timestamp_query_pool != VK_NULL_HANDLE) {
+        vkCmdWriteTimestamp(replay_command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, timestamp_query_pool, 1);
+    }
+    vkEndCommandBuffer(replay_command_buffer);
+    submit_setup();
+}
+
+CommandStreamReplay::~CommandStreamReplay() {
+    if (device != VK_NULL_HANDLE) {
+        vkDeviceWaitIdle(device);
+        pipeline_registry.reset();
+        for (auto& render_pass : render_passes) {
+            vkDestroyRenderPass(device, render_pass.second, nullptr);
+        }
+        for (auto& target : targets) {
+            vkDestroyFramebuffer(device, target.second.framebuffer, nullptr);
+            vkDestroyImageView(device, target.second.view, nullptr);
+            vkDestroyImage(device, target.second.image, nullptr);
+            memory_tracker->free(device, target.second.memory);
+        }
+        for (auto& image : images) {
+            vkDestroyImageView(device, image.second.view, nullptr);
+            vkDestroyImage(device, image.second.image, nullptr);
+            memory_tracker->free(device, image.second.memory);
+        }
+        for (auto& buffer : buffers) {
+            vkDestroyBuffer(device, buffer.second.first, nullptr);
+            memory_tracker->free(device, buffer.second.second);
+        }
+        for (VkDescriptorPool descriptor_pool : descriptor_pools) {
+            vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+        }
+        vkDestroySampler(device, sampler, nullptr);
+        if (timestamp_query_pool != VK_NULL_HANDLE) { vkDestroyQueryPool(device, timestamp_query_pool, nullptr); }
+        vkDestroyFence(device, fence, nullptr);
+        vkDestroyCommandPool(device, command_pool, nullptr);
+        memory_tracker.reset();
+        vkDestroyDevice(device, nullptr);
+    }
+    if (instance != VK_NULL_HANDLE) { vkDestroyInstance(instance, nullptr); }
+}
+
+void CommandStreamReplay::create_instance() {
+    if (volkInitialize() != VK_SUCCESS) { throw VOLK_INITIALIZATION_FAILED; }
+    VkApplicationInfo application_info = {
+        VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        nullptr,
+        "Vulkan Triangle Replay",
+        VK_MAKE_VERSION(1,0,0),
+        "Pure Vulkan",
+        VK_MAKE_VERSION(1,0,0),
+        VK_MAKE_VERSION(1,0,0)
+    };
+#ifdef NDEBUG
+    std::vector<const char*> desired_validation_layers = {};
+#else
+    std::vector<const char*> desired_validation_layers = { "VK_LAYER_LUNARG_standard_validation" };
+#endif
+    VkInstanceCreateInfo instance_create_info = {
+        VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        nullptr,
+        0,
+        &application_info,
+        static_cast<uint32_t>(desired_validation_layers.size()),
+        desired_validation_layers.data(),
+        0,
+        nullptr
+    };
+    if (vkCreateInstance(&instance_create_info, nullptr, &instance)) {
+        instance = VK_NULL_HANDLE;
+        throw INSTANCE_CREATION_FAILED;
+    }
+    volkLoadInstance(instance);
+}
+
+// the first device and its first graphics queue family, as VulkanTriangle selects them without surfaces to present to
+void CommandStreamReplay::create_device() {
+    uint32_t devices_number;
+    vkEnumeratePhysicalDevices(instance, &devices_number, nullptr);
+    if (devices_number == 0) { throw DEVICE_CREATION_FAILED; }
+    std::vector<VkPhysicalDevice> devices(devices_number);
+    vkEnumeratePhysicalDevices(instance, &devices_number, devices.data());
+    physical_device = devices[0];
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &physical_device_memory_properties);
+    VkPhysicalDeviceProperties device_properties;
+    vkGetPhysicalDeviceProperties(physical_device, &device_properties);
+    VkPhysicalDeviceFeatures device_features;
+    vkGetPhysicalDeviceFeatures(physical_device, &device_features);
+
+    uint32_t families_count;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &families_count, nullptr);
+    std::vector<VkQueueFamilyProperties> queue_families_properties(families_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &families_count, queue_families_properties.data());
+    queue_family_index = families_count;
+    for (uint32_t i = 0; i < families_count && queue_family_index == families_count; i++) {
+        if (queue_families_properties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) { queue_family_index = i; }
+    }
+    if (queue_family_index == families_count) { throw DEVICE_CREATION_FAILED; }
+    timestamp_period = device_properties.limits.timestampPeriod;
+    timestamp_valid_bits = queue_families_properties[queue_family_index].timestampValidBits;
+
+    // the captured texture may be block compressed, and the draws of a pipeline may be one indirect multi-draw
+    VkPhysicalDeviceFeatures enabled_features = {};
+    enabled_features.textureCompressionBC = device_features.textureCompressionBC;
+    enabled_features.textureCompressionASTC_LDR = device_features.textureCompressionASTC_LDR;
+    is_multi_draw_indirect_supported = device_features.multiDrawIndirect && device_features.drawIndirectFirstInstance;
+    enabled_features.multiDrawIndirect = is_multi_draw_indirect_supported;
+    enabled_features.drawIndirectFirstInstance = is_multi_draw_indirect_supported;
+    float queue_priority = 1.0f;
+    VkDeviceQueueCreateInfo device_queue_create_info = {
+        VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        nullptr,
+        0,
+        queue_family_index,
+        1,
+        &queue_priority
+    };
+    VkDeviceCreateInfo device_create_info = {
+        VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        nullptr,
+        0,
+        1,
+        &device_queue_create_info,
+        0,
+        nullptr,
+        0,
+        nullptr,
+        &enabled_features
+    };
+    if (vkCreateDevice(physical_device, &device_create_info, nullptr, &device)) {
+        device = VK_NULL_HANDLE;
+        throw DEVICE_CREATION_FAILED;
+    }
+    volkLoadDevice(device);
+    vkGetDeviceQueue(device, queue_family_index, 0, &queue);
+    std::cout << "Replaying on " << device_properties.deviceName << std::endl;
+
+    memory_tracker = std::make_unique<MemoryTracker>(physical_device, false);
+    pipeline_registry = std::make_unique<PipelineRegistry>(device, VK_NULL_HANDLE);
+
+    VkCommandPoolCreateInfo command_pool_create_info = { VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO, nullptr, 0, queue_family_index };
+    vkCreateCommandPool(device, &command_pool_create_info, nullptr, &command_pool);
+    VkCommandBufferAllocateInfo command_buffer_allocate_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr, command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 2 };
+    VkCommandBuffer command_buffers[2];
+    vkAllocateCommandBuffers(device, &command_buffer_allocate_info, command_buffers);
+    setup_command_buffer = command_buffers[0];
+    replay_command_buffer = command_buffers[1];
+    VkFenceCreateInfo fence_create_info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,nullptr,0 };
+    vkCreateFence(device, &fence_create_info, nullptr, &fence);
+
+    // the same sampling as the captured texture's sampler
+    VkSamplerCreateInfo sampler_create_info = {
+        VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        nullptr,
+        0,
+        VK_FILTER_LINEAR,
+        VK_FILTER_LINEAR,
+        VK_SAMPLER_MIPMAP_MODE_LINEAR,
+        VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        0.0f,
+        VK_FALSE,
+        1.0f,
+        VK_FALSE,
+        VK_COMPARE_OP_ALWAYS,
+        0.0f,
+        VK_LOD_CLAMP_NONE,
+        VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK,
+        VK_FALSE
+    };
+    vkCreateSampler(device, &sampler_create_info, nullptr, &sampler);
+
+    // setup commands are submitted once before the first iteration, the replayed ones are submitted every iteration
+    VkCommandBufferBeginInfo command_buffer_begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO, nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT, nullptr };
+    vkBeginCommandBuffer(setup_command_buffer, &command_buffer_begin_info);
+    command_buffer_begin_info.flags = 0;
+    vkBeginCommandBuffer(replay_command_buffer, &command_buffer_begin_info);
+    if (timestamp_valid_bits != 0) {
+        VkQueryPoolCreateInfo query_pool_create_info = { VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO, nullptr, 0, VK_QUERY_TYPE_TIMESTAMP, 2, 0 };
+        vkCreateQueryPool(device, &query_pool_create_info, nullptr, &timestamp_query_pool);
+        vkCmdResetQueryPool(replay_command_buffer, timestamp_query_pool, 0, 2);
+        vkCmdWriteTimestamp(replay_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, timestamp_query_pool, 0);
+    }
+}
+
+VkBuffer CommandStreamReplay::create_buffer(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlagBits memory_properties, const std::string& tag, VkDeviceMemory* memory) {
+    VkBufferCreateInfo buffer_create_info = {
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        nullptr,
+        0,
+        size,
+        usage,
+        VK_SHARING_MODE_EXCLUSIVE,
+        0,
+        nullptr
+    };
+    VkBuffer buffer;
+    if (vkCreateBuffer(device, &buffer_create_info, nullptr, &buffer) != VK_SUCCESS) { throw RESOURCE_CREATION_FAILED; }
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memory_requirements);
+    VkMemoryAllocateInfo memory_allocate_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        nullptr,
+        memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, memory_properties)
+    };
+    if (memory_tracker->allocate(device, memory_allocate_info, size, tag, memory) != VK_SUCCESS) { throw MEMORY_ALLOCATION_FAILED; }
+    vkBindBufferMemory(device, buffer, *memory, 0);
+    return buffer;
+}
+
+VkBuffer CommandStreamReplay::create_staging_buffer(const void* data, VkDeviceSize size) {
+    VkDeviceMemory memory;
+    VkBuffer buffer = create_buffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, "replay_staging", &memory);
+    void* data_pointer;
+    vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data_pointer);
+    std::memcpy(data_pointer, data, size);
+    VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, memory, 0, VK_WHOLE_SIZE };
+    vkFlushMappedMemoryRanges(device, 1, &mapped_memory_range);
+    vkUnmapMemory(device, memory);
+    staging_buffers.push_back({ buffer, memory });
+    return buffer;
+}
+
+// targets stay in the attachment layout, nothing reads them after the render pass
+VkRenderPass CommandStreamReplay::get_render_pass(VkFormat format) {
+    auto found = render_passes.find(format);
+    if (found != render_passes.end()) { return found->second; }
+    VkAttachmentDescription attachment_description = {
+        0,
+        format,
+        VK_SAMPLE_COUNT_1_BIT,
+        VK_ATTACHMENT_LOAD_OP_CLEAR,
+        VK_ATTACHMENT_STORE_OP_STORE,
+        VK_ATTACHMENT_LOAD_OP_DONT_CARE,
+        VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
+    };
+    VkAttachmentReference attachment_reference = { 0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL };
+    VkSubpassDescription subpass_description = {
+        0,
+        VK_PIPELINE_BIND_POINT_GRAPHICS,
+        0,
+        nullptr,
+        1,
+        &attachment_reference,
+        nullptr,
+        nullptr,
+        0,
+        nullptr
+    };
+    VkRenderPassCreateInfo render_pass_create_info = {
+        VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
+        nullptr,
+        0,
+        1,
+        &attachment_description,
+        1,
+        &subpass_description,
+        0,
+        nullptr
+    };
+    VkRenderPass render_pass;
+    if (vkCreateRenderPass(device, &render_pass_create_info, nullptr, &render_pass) != VK_SUCCESS) { throw RESOURCE_CREATION_FAILED; }
+    return render_passes[format] = render_pass;
+}
+
+// host-visible buffers are written directly, device-local ones are copied from a staging buffer during setup
+void CommandStreamReplay::read_buffer(CommandStreamReader& reader) {
+    uint32_t id = reader.read<uint32_t>();
+    bool is_device_local = reader.read<uint32_t>() != 0;
+    VkBufferUsageFlags usage = reader.read<uint32_t>();
+    VkDeviceSize size = reader.read<uint64_t>();
+    std::vector<char> data = reader.read_bytes(size);
+
+    VkDeviceMemory memory;
+    VkBuffer buffer;
+    if (is_device_local) {
+        buffer = create_buffer(size, usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, "replay_buffers", &memory);
+        VkBufferCopy buffer_copy = { 0, 0, size };
+        vkCmdCopyBuffer(setup_command_buffer, create_staging_buffer(data.data(), size), buffer, 1, &buffer_copy);
+    }
+    else {
+        buffer = create_buffer(size, usage, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, "replay_buffers", &memory);
+        void* data_pointer;
+        vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &data_pointer);
+        std::memcpy(data_pointer, data.data(), size);
+        VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, memory, 0, VK_WHOLE_SIZE };
+        vkFlushMappedMemoryRanges(device, 1, &mapped_memory_range);
+        vkUnmapMemory(device, memory);
+        host_buffer_data[id] = std::move(data);
+    }
+    buffers[id] = { buffer, memory };
+}
+
+void CommandStreamReplay::read_image(CommandStreamReader& reader) {
+    uint32_t id = reader.read<uint32_t>();
+    VkFormat format = static_cast<VkFormat>(reader.read<uint32_t>());
+    uint32_t width = reader.read<uint32_t>();
+    uint32_t height = reader.read<uint32_t>();
+    uint32_t level_count = reader.read<uint32_t>();
+
+    Image image;
+    VkImageCreateInfo image_create_info = {
+        VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        nullptr,
+        0,
+        VK_IMAGE_TYPE_2D,
+        format,
+        { width, height, 1 },
+        level_count,
+        1,
+        VK_SAMPLE_COUNT_1_BIT,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        0,
+        nullptr,
+        VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    if (vkCreateImage(device, &image_create_info, nullptr, &image.image) != VK_SUCCESS) { throw RESOURCE_CREATION_FAILED; }
+    VkMemoryRequirements memory_requirements;
+    vkGetImageMemoryRequirements(device, image.image, &memory_requirements);
+    VkMemoryAllocateInfo memory_allocate_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        nullptr,
+        memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+    };
+    if (memory_tracker->allocate(device, memory_allocate_info, memory_requirements.size, "replay_images", &image.memory) != VK_SUCCESS) { throw MEMORY_ALLOCATION_FAILED; }
+    vkBindImageMemory(device, image.image, image.memory, 0);
+
+    VkImageMemoryBarrier image_memory_barrier = {
+        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        nullptr,
+        0,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        image.image,
+        { VK_IMAGE_ASPECT_COLOR_BIT, 0, level_count, 0, 1 }
+    };
+    vkCmdPipelineBarrier(setup_command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+    for (uint32_t level = 0; level < level_count; level++) {
+        std::vector<char> level_data = reader.read_bytes(reader.read<uint64_t>());
+        VkBufferImageCopy buffer_image_copy = {
+            0,
+            0,
+            0,
+            { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 },
+            { 0, 0, 0 },
+            { std::max(1u, width >> level), std::max(1u, height >> level), 1 }
+        };
+        vkCmdCopyBufferToImage(setup_command_buffer, create_staging_buffer(level_data.data(), level_data.size()), image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_image_copy);
+    }
+    image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(setup_command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+
+    VkImageViewCreateInfo image_view_create_info = {
+        VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        nullptr,
+        0,
+        image.image,
+        VK_IMAGE_VIEW_TYPE_2D,
+        format,
+        { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY },
+        { VK_IMAGE_ASPECT_COLOR_BIT, 0, level_count, 0, 1 }
+    };
+    if (vkCreateImageView(device, &image_view_create_info, nullptr, &image.view) != VK_SUCCESS) { throw RESOURCE_CREATION_FAILED; }
+    images[id] = image;
+}
+
+void CommandStreamReplay::read_target(CommandStreamReader& reader) {
+    uint32_t id = reader.read<uint32_t>();
+    VkFormat format = static_cast<VkFormat>(reader.read<uint32_t>());
+    VkExtent2D extent;
+    extent.width = reader.read<uint32_t>();
+    extent.height = reader.read<uint32_t>();
+
+    Target target;
+    target.render_pass = get_render_pass(format);
+    VkImageCreateInfo image_create_info = {
+        VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        nullptr,
+        0,
+        VK_IMAGE_TYPE_2D,
+        format,
+        { extent.width, extent.height, 1 },
+        1,
+        1,
+        VK_SAMPLE_COUNT_1_BIT,
+        VK_IMAGE_TILING_OPTIMAL,
+        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        0,
+        nullptr,
+        VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    if (vkCreateImage(device, &image_create_info, nullptr, &target.image) != VK_SUCCESS) { throw RESOURCE_CREATION_FAILED; }
+    VkMemoryRequirements memory_requirements;
+    vkGetImageMemoryRequirements(device, target.image, &memory_requirements);
+    VkMemoryAllocateInfo memory_allocate_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        nullptr,
+        memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+    };
+    if (memory_tracker->allocate(device, memory_allocate_info, memory_requirements.size, "replay_targets", &target.memory) != VK_SUCCESS) { throw MEMORY_ALLOCATION_FAILED; }
+    vkBindImageMemory(device, target.image, target.memory, 0);
+
+    VkImageViewCreateInfo image_view_create_info = {
+        VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        nullptr,
+        0,
+        target.image,
+        VK_IMAGE_VIEW_TYPE_2D,
+        format,
+        { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY },
+        { VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 }
+    };
+    if (vkCreateImageView(device, &image_view_create_info, nullptr, &target.view) != VK_SUCCESS) { throw RESOURCE_CREATION_FAILED; }
+    VkFramebufferCreateInfo framebuffer_create_info = {
+        VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO,
+        nullptr,
+        0,
+        target.render_pass,
+        1,
+        &target.view,
+        extent.width,
+        extent.height,
+        1
+    };
+    if (vkCreateFramebuffer(device, &framebuffer_create_info, nullptr, &target.framebuffer) != VK_SUCCESS) { throw RESOURCE_CREATION_FAILED; }
+    targets[id] = target;
+}
+
+// the state refers to the capturing program's shader and layout ids and to its render pass, which are replaced by ours
+void CommandStreamReplay::read_pipeline(CommandStreamReader& reader) {
+    uint32_t id = reader.read<uint32_t>();
+    VkFormat format = static_cast<VkFormat>(reader.read<uint32_t>());
+    PipelineRegistry::State state = reader.read<PipelineRegistry::State>();
+    state.vertex_shader = shader_ids.at(state.vertex_shader);
+    state.fragment_shader = shader_ids.at(state.fragment_shader);
+    state.layout = layout_ids.at(state.layout);
+    state.render_pass = pipeline_registry->add_render_pass(get_render_pass(format), { format }, VK_SAMPLE_COUNT_1_BIT);
+    pipelines[id] = pipeline_registry->get_pipeline(pipeline_registry->get(state));
+}
+
+void CommandStreamReplay::read_descriptor_set(CommandStreamReader& reader) {
+    uint32_t id = reader.read<uint32_t>();
+    uint32_t layout = layout_ids.at(reader.read<uint32_t>());
+    std::vector<VkWriteDescriptorSet> write_descriptor_sets(reader.read<uint32_t>());
+    std::vector<VkDescriptorBufferInfo> descriptor_buffer_infos(write_descriptor_sets.size());
+    std::vector<VkDescriptorImageInfo> descriptor_image_infos(write_descriptor_sets.size());
+    std::vector<VkDescriptorPoolSize> descriptor_pool_sizes;
+    for (size_t i = 0; i < write_descriptor_sets.size(); i++) {
+        uint32_t binding = reader.read<uint32_t>();
+        VkDescriptorType type = static_cast<VkDescriptorType>(reader.read<uint32_t>());
+        uint32_t resource = reader.read<uint32_t>();
+        VkDeviceSize offset = reader.read<uint64_t>();
+        VkDeviceSize range = reader.read<uint64_t>();
+        bool is_image = type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        if (is_image) { descriptor_image_infos[i] = { sampler, images.at(resource).view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL }; }
+        else { descriptor_buffer_infos[i] = { buffers.at(resource).first, offset, range }; }
+        write_descriptor_sets[i] = {
+            VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            nullptr,
+            VK_NULL_HANDLE,
+            binding,
+            0,
+            1,
+            type,
+            is_image ? &descriptor_image_infos[i] : nullptr,
+            is_image ? nullptr : &descriptor_buffer_infos[i],
+            nullptr
+        };
+        descriptor_pool_sizes.push_back({ type, 1 });
+    }
+
+    VkDescriptorPoolCreateInfo descriptor_pool_create_info = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        nullptr,
+        0,
+        1,
+        static_cast<uint32_t>(descriptor_pool_sizes.size()),
+        descriptor_pool_sizes.data()
+    };
+    VkDescriptorPool descriptor_pool;
+    vkCreateDescriptorPool(device, &descriptor_pool_create_info, nullptr, &descriptor_pool);
+    descriptor_pools.push_back(descriptor_pool);
+    VkDescriptorSetLayout descriptor_set_layout = pipeline_registry->get_descriptor_set_layout(layout, 0);
+    VkDescriptorSetAllocateInfo descriptor_set_allocate_info = {
+        VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        nullptr,
+        descriptor_pool,
+        1,
+        &descriptor_set_layout
+    };
+    VkDescriptorSet descriptor_set;
+    if (vkAllocateDescriptorSets(device, &descriptor_set_allocate_info, &descriptor_set) != VK_SUCCESS) { throw RESOURCE_CREATION_FAILED; }
+    for (VkWriteDescriptorSet& write_descriptor_set : write_descriptor_sets) {
+        write_descriptor_set.dstSet = descriptor_set;
+    }
+    vkUpdateDescriptorSets(device, static_cast<uint32_t>(write_descriptor_sets.size()), write_descriptor_sets.data(), 0, nullptr);
+    descriptor_sets[id] = descriptor_set;
+}
+
+void CommandStreamReplay::read_command(CommandStreamReader& reader) {
+    VkCommandBuffer command_buffer = replay_command_buffer;
+    command_count++;
+    switch (reader.get_type()) {
+    case command_stream::COPY_BUFFER: {
+        VkBuffer source = buffers.at(reader.read<uint32_t>()).first;
+        VkBuffer destination = buffers.at(reader.read<uint32_t>()).first;
+        VkBufferCopy buffer_copy;
+        buffer_copy.srcOffset = reader.read<uint64_t>();
+        buffer_copy.dstOffset = reader.read<uint64_t>();
+        buffer_copy.size = reader.read<uint64_t>();
+        vkCmdCopyBuffer(command_buffer, source, destination, 1, &buffer_copy);
+        break;
+    }
+    case command_stream::PIPELINE_BARRIER: {
+        VkPipelineStageFlags source_stages = reader.read<uint32_t>();
+        VkPipelineStageFlags destination_stages = reader.read<uint32_t>();
+        VkMemoryBarrier memory_barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER, nullptr, reader.read<uint32_t>(), 0 };
+        memory_barrier.dstAccessMask = reader.read<uint32_t>();
+        vkCmdPipelineBarrier(command_buffer, source_stages, destination_stages, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+        break;
+    }
+    case command_stream::BIND_DESCRIPTOR_SET: {
+        VkPipelineLayout pipeline_layout = pipeline_registry->get_pipeline_layout(layout_ids.at(reader.read<uint32_t>()));
+        VkDescriptorSet descriptor_set = descriptor_sets.at(reader.read<uint32_t>());
+        vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+        break;
+    }
+    case command_stream::BIND_PIPELINE:
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelines.at(reader.read<uint32_t>()));
+        pipeline_bind_count++;
+        break;
+    case command_stream::BIND_VERTEX_BUFFER: {
+        uint32_t binding = reader.read<uint32_t>();
+        VkBuffer buffer = buffers.at(reader.read<uint32_t>()).first;
+        VkDeviceSize offset = reader.read<uint64_t>();
+        vkCmdBindVertexBuffers(command_buffer, binding, 1, &buffer, &offset);
+        break;
+    }
+    case command_stream::BIND_INDEX_BUFFER: {
+        VkBuffer buffer = buffers.at(reader.read<uint32_t>()).first;
+        VkDeviceSize offset = reader.read<uint64_t>();
+        vkCmdBindIndexBuffer(command_buffer, buffer, offset, static_cast<VkIndexType>(reader.read<uint32_t>()));
+        break;
+    }
+    case command_stream::BEGIN_RENDER_PASS: {
+        const Target& target = targets.at(reader.read<uint32_t>());
+        VkExtent2D extent;
+        extent.width = reader.read<uint32_t>();
+        extent.height = reader.read<uint32_t>();
+        VkClearValue clear_value;
+        reader.read_bytes(clear_value.color.float32, sizeof(clear_value.color.float32));
+        VkRenderPassBeginInfo render_pass_begin_info = {
+            VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+            nullptr,
+            target.render_pass,
+            target.framebuffer,
+            {{0,0},extent},
+            1,
+            &clear_value
+        };
+        vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info, VK_SUBPASS_CONTENTS_INLINE);
+        VkViewport viewport = { 0.0f, 0.0f, static_cast<float>(extent.width), static_cast<float>(extent.height), 0.0f, 1.0f };
+        VkRect2D scissor = { {0,0}, extent };
+        vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+        vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+        render_pass_count++;
+        break;
+    }
+    case command_stream::DRAW: {
+        uint32_t parameters[4];
+        reader.read_bytes(parameters, sizeof(parameters));
+        vkCmdDraw(command_buffer, parameters[0], parameters[1], parameters[2], parameters[3]);
+        draw_count++;
+        break;
+    }
+    case command_stream::DRAW_INDEXED: {
+        uint32_t index_count = reader.read<uint32_t>();
+        uint32_t instance_count = reader.read<uint32_t>();
+        uint32_t first_index = reader.read<uint32_t>();
+        int32_t vertex_offset = reader.read<int32_t>();
+        vkCmdDrawIndexed(command_buffer, index_count, instance_count, first_index, vertex_offset, reader.read<uint32_t>());
+        draw_count++;
+        break;
+    }
+    case command_stream::DRAW_INDEXED_INDIRECT: {
+        uint32_t buffer_id = reader.read<uint32_t>();
+        VkDeviceSize offset = reader.read<uint64_t>();
+        uint32_t indirect_count = reader.read<uint32_t>();
+        uint32_t stride = reader.read<uint32_t>();
+        if (is_multi_draw_indirect_supported) {
+            vkCmdDrawIndexedIndirect(command_buffer, buffers.at(buffer_id).first, offset, indirect_count, stride);
+            indirect_draw_count++;
+        }
+        else {
+            // the commands were captured with the buffer, so they are recorded as the draws they stand for
+            const std::vector<char>& data = host_buffer_data.at(buffer_id);
+            for (uint32_t i = 0; i < indirect_count; i++) {
+                VkDrawIndexedIndirectCommand command;
+                std::memcpy(&command, data.data() + offset + static_cast<VkDeviceSize>(i) * stride, sizeof(command));
+                vkCmdDrawIndexed(command_buffer, command.indexCount, command.instanceCount, command.firstIndex, command.vertexOffset, command.firstInstance);
+            }
+        }
+        draw_count += indirect_count;
+        break;
+    }
+    case command_stream::END_RENDER_PASS:
+        vkCmdEndRenderPass(command_buffer);
+        break;
+    default:
+        throw UNKNOWN_RECORD;
+    }
+}
+
+void CommandStreamReplay::submit_setup() {
+    vkEndCommandBuffer(setup_command_buffer);
+    VkSubmitInfo submit_info = {
+        VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        nullptr,
+        0,
+        nullptr,
+        nullptr,
+        1,
+        &setup_command_buffer,
+        0,
+        nullptr
+    };
+    vkQueueSubmit(queue, 1, &submit_info, fence);
+    vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+    vkResetFences(device, 1, &fence);
+    for (auto& staging_buffer : staging_buffers) {
+        vkDestroyBuffer(device, staging_buffer.first, nullptr);
+        memory_tracker->free(device, staging_buffer.second);
+    }
+    staging_buffers.clear();
+}
+
+// CPU time is from submit to the fence signaling, GPU time between the timestamps around the replayed commands
+void CommandStreamReplay::run(uint32_t iterations) {
+    std::cout << "Command stream: " << stream_size / 1024.0 << " KiB, " << buffers.size() << " buffers, " << images.size() << " images, " << targets.size()
+        << " targets, " << pipelines.size() << " pipelines, " << command_count << " commands (" << render_pass_count << " render passes, "
+        << pipeline_bind_count << " pipeline binds, " << draw_count << " draws, " << indirect_draw_count << " indirect multi-draw calls)" << std::endl;
+    memory_tracker->report(std::cout);
+
+    VkSubmitInfo submit_info = {
+        VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        nullptr,
+        0,
+        nullptr,
+        nullptr,
+        1,
+        &replay_command_buffer,
+        0,
+        nullptr
+    };
+    uint64_t mask = timestamp_valid_bits == 64 ? UINT64_MAX : (1ull << timestamp_valid_bits) - 1;
+    std::vector<double> cpu_msec;
+    std::vector<double> gpu_msec;
+    for (uint32_t i = 0; i < iterations; i++) {
+        auto begin = std::chrono::steady_clock::now();
+        vkQueueSubmit(queue, 1, &submit_info, fence);
+        vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+        cpu_msec.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count());
+        vkResetFences(device, 1, &fence);
+        if (timestamp_query_pool != VK_NULL_HANDLE) {
+            uint64_t timestamps[2];
+            vkGetQueryPoolResults(device, timestamp_query_pool, 0, 2, sizeof(timestamps), timestamps, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+            gpu_msec.push_back(((timestamps[1] - timestamps[0]) & mask) * static_cast<double>(timestamp_period) / 1e6);
+        }
+    }
+
+    auto print = [](const char* name, std::vector<double>& msec) {
+        if (msec.empty()) { return; }
+        std::sort(msec.begin(), msec.end());
+        double total = 0.0;
+        for (double value : msec) { total += value; }
+        std::cout << "  " << name << " msec: min " << msec.front() << ", median " << msec[msec.size() / 2] << ", mean " << total / msec.size() << ", max " << msec.back() << std::endl;
+    };
+    std::cout << iterations << " iterations:" << std::endl;
+    print("CPU (submit to fence)", cpu_msec);
+    print("GPU", gpu_msec);
+    if (timestamp_query_pool == VK_NULL_HANDLE) { std::cout << "  GPU time not measured: the queue does not support timestamps" << std::endl; }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: replay <command stream> [iterations, default 100]" << std::endl;
+        return 1;
+    }
+    // the error enums share values, so each is reported with the part that threw it
+    try {
+        uint32_t iterations = argc > 2 ? std::max(1ul, std::stoul(argv[2])) : 100;
+        CommandStreamReplay replay(argv[1]);
+        replay.run(iterations);
+    }
+    catch (CommandStreamReplay::Errors error) {
+        std::cerr << "Replay of " << argv[1] << " failed with error " << error << std::endl;
+        return 1;
+    }
+    catch (command_stream::Errors error) {
+        std::cerr << "Reading the command stream " << argv[1] << " failed with error " << error << std::endl;
+        return 1;
+    }
+    catch (PipelineRegistry::Errors error) {
+        std::cerr << "Creating the pipelines of " << argv[1] << " failed with error " << error << std::endl;
+        return 1;
+    }
+    catch (const std::exception& exception) {
+        std::cerr << "Replay of " << argv[1] << " failed: " << exception.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,272 @@
+#include "scene.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <random>
+
+namespace {
+    constexpr uint32_t no_parent = UINT32_MAX;
+    constexpr uint32_t all_planes = 0x3F;
+    constexpr uint32_t tasks_per_thread = 8;
+    constexpr float object_spacing = 1.5f;
+}
+
+// the mask keeps the planes the box still straddles, a box fully inside a plane is not tested against it again
+bool Scene::is_box_outside(const glm::vec3& min, const glm::vec3& max, const Plane* planes, uint32_t& mask) {
+    for (uint32_t i = 0; i < 6; i++) {
+        if (!(mask & (1u << i))) { continue; }
+        const glm::vec3& normal = planes[i].normal;
+        glm::vec3 positive = { normal.x >= 0.0f ? max.x : min.x, normal.y >= 0.0f ? max.y : min.y, normal.z >= 0.0f ? max.z : min.z };
+        if (glm::dot(normal, positive) + planes[i].distance < 0.0f) { return true; }
+        glm::vec3 negative = { normal.x >= 0.0f ? min.x : max.x, normal.y >= 0.0f ? min.y : max.y, normal.z >= 0.0f ? min.z : max.z };
+        if (glm::dot(normal, negative) + planes[i].distance >= 0.0f) { mask &= ~(1u << i); }
+    }
+    return false;
+}
+
+Scene::Scene(uint32_t object_count, uint32_t worker_count, const glm::vec3& mesh_min, const glm::vec3& mesh_max) :
+    mesh_min(mesh_min),
+    mesh_max(mesh_max) {
+    object_count = std::max(1u, object_count);
+    float side = std::cbrt(static_cast<float>(object_count)) * object_spacing;
+    radius = side * 0.5f;
+
+    // a fixed seed keeps the scene, and so the measurements, the same from run to run
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> position_distribution(-radius, radius);
+    std::uniform_real_distribution<float> scale_distribution(0.3f, 1.0f);
+    instances.resize(object_count);
+    home_positions.resize(object_count);
+    object_min.resize(object_count);
+    object_max.resize(object_count);
+    object_leaves.resize(object_count);
+    object_order.resize(object_count);
+    for (uint32_t i = 0; i < object_count; i++) {
+        home_positions[i] = { position_distribution(generator), position_distribution(generator), position_distribution(generator) };
+        instances[i] = glm::vec4(home_positions[i], scale_distribution(generator));
+        set_object_bounds(i);
+        object_order[i] = i;
+    }
+
+    // enough subtrees below the cut to balance the load over the workers and the calling thread
+    cut_depth = static_cast<uint32_t>(std::ceil(std::log2(static_cast<float>((worker_count + 1) * tasks_per_thread))));
+    nodes.reserve(2 * (object_count / max_leaf_objects + 1));
+    parents.reserve(nodes.capacity());
+    build(0, object_count, no_parent, 0);
+    is_node_dirty.assign(nodes.size(), 0);
+    task_draw_lists.resize(task_roots.size());
+
+    for (uint32_t i = 0; i < worker_count; i++) {
+        workers.emplace_back(&Scene::worker_loop, this);
+    }
+}
+
+Scene::~Scene() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop_workers = true;
+    }
+    start_condition.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void Scene::set_object_bounds(uint32_t object) {
+    glm::vec3 position = glm::vec3(instances[object]);
+    float scale = instances[object].w;
+    object_min[object] = position + scale * mesh_min;
+    object_max[object] = position + scale * mesh_max;
+}
+
+// top-down median split along the widest axis of the centroids, children are laid out right after their parent
+uint32_t Scene::build(uint32_t begin, uint32_t end, uint32_t parent, uint32_t depth) {
+    uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({});
+    parents.push_back(parent);
+
+    glm::vec3 min = object_min[object_order[begin]];
+    glm::vec3 max = object_max[object_order[begin]];
+    glm::vec3 centroid_min = (min + max) * 0.5f;
+    glm::vec3 centroid_max = centroid_min;
+    for (uint32_t i = begin; i < end; i++) {
+        uint32_t object = object_order[i];
+        min = glm::min(min, object_min[object]);
+        max = glm::max(max, object_max[object]);
+        glm::vec3 centroid = (object_min[object] + object_max[object]) * 0.5f;
+        centroid_min = glm::min(centroid_min, centroid);
+        centroid_max = glm::max(centroid_max, centroid);
+    }
+    nodes[index].min = min;
+    nodes[index].max = max;
+
+    bool is_leaf = end - begin <= max_leaf_objects;
+    if (depth == cut_depth || (depth < cut_depth && is_leaf)) {
+        task_roots.push_back(index);
+    }
+    if (is_leaf) {
+        nodes[index].first = begin;
+        nodes[index].count = end - begin;
+        for (uint32_t i = begin; i < end; i++) {
+            object_leaves[object_order[i]] = index;
+        }
+        return index;
+    }
+
+    glm::vec3 extent = centroid_max - centroid_min;
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    uint32_t middle = begin + (end - begin) / 2;
+    std::nth_element(object_order.begin() + begin, object_order.begin() + middle, object_order.begin() + end, [&](uint32_t a, uint32_t b) {
+        return object_min[a][axis] + object_max[a][axis] < object_min[b][axis] + object_max[b][axis];
+    });
+
+    build(begin, middle, index, depth + 1);
+    uint32_t right = build(middle, end, index, depth + 1);
+    nodes[index].first = right;
+    nodes[index].count = 0;
+    return index;
+}
+
+// objects bob around their home position, so the tree stays usable with refits alone and is never rebuilt
+void Scene::update(float time) {
+    auto begin = std::chrono::steady_clock::now();
+    for (uint32_t object = 0; object < instances.size(); object += dynamic_object_stride) {
+        float phase = static_cast<float>(object);
+        glm::vec3 offset = glm::vec3(std::sin(time + phase), std::cos(time * 0.7f + phase), std::sin(time * 1.3f + phase * 0.5f)) * 0.5f;
+        instances[object] = glm::vec4(home_positions[object] + offset, instances[object].w);
+        set_object_bounds(object);
+        // ancestors above an already marked node are marked too
+        for (uint32_t node = object_leaves[object]; node != no_parent && !is_node_dirty[node]; node = parents[node]) {
+            is_node_dirty[node] = 1;
+            dirty_nodes.push_back(node);
+        }
+    }
+    refit();
+    refit_msec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+}
+
+// children always have larger indices than their parent, so refitting in decreasing order visits them first;
+// when a large part of the tree moved, scanning the flags is cheaper than sorting the marked nodes
+void Scene::refit() {
+    refitted_nodes = static_cast<uint32_t>(dirty_nodes.size());
+    if (dirty_nodes.size() > nodes.size() / 8) {
+        for (uint32_t index = static_cast<uint32_t>(nodes.size()); index-- > 0;) {
+            if (is_node_dirty[index]) { refit_node(index); }
+        }
+    }
+    else {
+        std::sort(dirty_nodes.begin(), dirty_nodes.end(), std::greater<uint32_t>());
+        for (uint32_t index : dirty_nodes) {
+            refit_node(index);
+        }
+    }
+    dirty_nodes.clear();
+}
+
+void Scene::refit_node(uint32_t index) {
+    Node& node = nodes[index];
+    if (node.count > 0) {
+        node.min = object_min[object_order[node.first]];
+        node.max = object_max[object_order[node.first]];
+        for (uint32_t i = node.first + 1; i < node.first + node.count; i++) {
+            node.min = glm::min(node.min, object_min[object_order[i]]);
+            node.max = glm::max(node.max, object_max[object_order[i]]);
+        }
+    }
+    else {
+        node.min = glm::min(nodes[index + 1].min, nodes[node.first].min);
+        node.max = glm::max(nodes[index + 1].max, nodes[node.first].max);
+    }
+    is_node_dirty[index] = 0;
+}
+
+const std::vector<uint32_t>& Scene::cull(const glm::mat4& view_projection) {
+    auto begin = std::chrono::steady_clock::now();
+
+    // planes from the rows of the clip matrix, the near plane uses the -w..w depth range which is conservative for 0..w
+    glm::vec4 rows[4];
+    for (int i = 0; i < 4; i++) {
+        rows[i] = glm::vec4(view_projection[0][i], view_projection[1][i], view_projection[2][i], view_projection[3][i]);
+    }
+    glm::vec4 plane_equations[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1], rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+    for (int i = 0; i < 6; i++) {
+        float length = glm::length(glm::vec3(plane_equations[i]));
+        planes[i] = { glm::vec3(plane_equations[i]) / length, plane_equations[i].w / length };
+    }
+
+    next_task = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+        busy_workers = static_cast<uint32_t>(workers.size());
+    }
+    start_condition.notify_all();
+    run_tasks();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done_condition.wait(lock, [this] { return busy_workers == 0; });
+    }
+
+    // concatenated in task order, which is the BVH order, whichever thread culled each subtree
+    draw_list.clear();
+    for (auto& task_draw_list : task_draw_lists) {
+        draw_list.insert(draw_list.end(), task_draw_list.begin(), task_draw_list.end());
+    }
+    cull_msec = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+    return draw_list;
+}
+
+void Scene::run_tasks() {
+    for (uint32_t task = next_task.fetch_add(1); task < task_roots.size(); task = next_task.fetch_add(1)) {
+        task_draw_lists[task].clear();
+        cull_subtree(task_roots[task], task_draw_lists[task]);
+    }
+}
+
+void Scene::worker_loop() {
+    uint64_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            start_condition.wait(lock, [&] { return stop_workers || generation != seen_generation; });
+            if (stop_workers) { return; }
+            seen_generation = generation;
+        }
+        run_tasks();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            busy_workers--;
+        }
+        done_condition.notify_one();
+    }
+}
+
+void Scene::cull_subtree(uint32_t root, std::vector<uint32_t>& visible) const {
+    struct Entry {
+        uint32_t node;
+        uint32_t mask;
+    };
+    // one entry per level plus the pending right child, far more than any tree of 32 bit object counts needs
+    Entry stack[64];
+    uint32_t stack_size = 0;
+    stack[stack_size++] = { root, all_planes };
+    while (stack_size > 0) {
+        Entry entry = stack[--stack_size];
+        const Node& node = nodes[entry.node];
+        if (entry.mask != 0 && is_box_outside(node.min, node.max, planes, entry.mask)) { continue; }
+        if (node.count == 0) {
+            stack[stack_size++] = { node.first, entry.mask };
+            stack[stack_size++] = { entry.node + 1, entry.mask };
+            continue;
+        }
+        for (uint32_t i = node.first; i < node.first + node.count; i++) {
+            uint32_t object = object_order[i];
+            uint32_t mask = entry.mask;
+            if (mask == 0 || !is_box_outside(object_min[object], object_max[object], planes, mask)) {
+                visible.push_back(object);
+            }
+        }
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// CPU side of a large scene: every object is an instance of one mesh placed by a position and a uniform scale.
+// Object bounds live in a flattened BVH of 32 byte nodes in depth-first order, moving objects only refit the
+// nodes above them, and frustum culling is split over the subtrees below a fixed cut and run on worker threads.
+// cull() produces the draw list: the indices of the visible objects, in an order that does not depend on timing.
+class Scene {
+public:
+    Scene(uint32_t object_count, uint32_t worker_count, const glm::vec3& mesh_min, const glm::vec3& mesh_max);
+    ~Scene();
+
+    void update(float time);
+    const std::vector<uint32_t>& cull(const glm::mat4& view_projection);
+
+    const std::vector<uint32_t>& get_draw_list() const { return draw_list; }
+    const glm::vec4& get_instance(uint32_t object) const { return instances[object]; }
+    uint32_t get_object_count() const { return static_cast<uint32_t>(instances.size()); }
+    uint32_t get_worker_count() const { return static_cast<uint32_t>(workers.size()); }
+    float get_radius() const { return radius; }
+    double get_cull_msec() const { return cull_msec; }
+    double get_refit_msec() const { return refit_msec; }
+    uint32_t get_refitted_nodes() const { return refitted_nodes; }
+
+    static constexpr uint32_t max_leaf_objects = 4;
+    // one in this many objects moves every frame
+    static constexpr uint32_t dynamic_object_stride = 16;
+
+private:
+    // inner node: count == 0, the left child follows it and first is the right child;
+    // leaf: objects object_order[first, first + count)
+    struct Node {
+        glm::vec3 min;
+        uint32_t first;
+        glm::vec3 max;
+        uint32_t count;
+    };
+
+    struct Plane {
+        glm::vec3 normal;
+        float distance;
+    };
+
+    static bool is_box_outside(const glm::vec3& min, const glm::vec3& max, const Plane* planes, uint32_t& mask);
+    uint32_t build(uint32_t begin, uint32_t end, uint32_t parent, uint32_t depth);
+    void set_object_bounds(uint32_t object);
+    void refit();
+    void refit_node(uint32_t index);
+    void cull_subtree(uint32_t root, std::vector<uint32_t>& visible) const;
+    void run_tasks();
+    void worker_loop();
+
+    std::vector<glm::vec4> instances;
+    std::vector<glm::vec3> home_positions;
+    std::vector<glm::vec3> object_min;
+    std::vector<glm::vec3> object_max;
+    glm::vec3 mesh_min;
+    glm::vec3 mesh_max;
+    float radius;
+
+    std::vector<Node> nodes;
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> object_order;
+    std::vector<uint32_t> object_leaves;
+    std::vector<uint8_t> is_node_dirty;
+    std::vector<uint32_t> dirty_nodes;
+
+    // subtrees at the cut depth, each one a culling task with its own output list
+    uint32_t cut_depth;
+    std::vector<uint32_t> task_roots;
+    std::vector<std::vector<uint32_t>> task_draw_lists;
+    std::vector<uint32_t> draw_list;
+    Plane planes[6];
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable start_condition;
+    std::condition_variable done_condition;
+    uint64_t generation = 0;
+    uint32_t busy_workers = 0;
+    bool stop_workers = false;
+    std::atomic<uint32_t> next_task = 0;
+
+    double cull_msec = 0.0;
+    double refit_msec = 0.0;
+    uint32_t refitted_nodes = 0;
+};
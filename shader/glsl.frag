@@ -1,10 +1,19 @@
 #version 450
 layout(location = 2) in VS_OUT {
 	vec3 color;
+	vec2 uv;
 } fs_in;
 
+// texture_parameters.x: finest level streamed in so far
+layout(set = 0, binding = 0) uniform uniform_buffer {
+	mat4 m_matrix;
+	vec4 texture_parameters;
+};
+layout(set = 0, binding = 1) uniform sampler2D color_texture;
+
 layout (location = 0) out vec4 color;
 
 void main() {
-	color = vec4(fs_in.color,1.0f);
+	float lod = max(textureQueryLod(color_texture, fs_in.uv).y, texture_parameters.x);
+	color = vec4(fs_in.color*textureLod(color_texture, fs_in.uv, lod).rgb,1.0f);
 }
\ No newline at end of file
@@ -1,15 +1,21 @@
 #version 450
 layout(location = 0) in vec3 position;
 layout(location = 1) in vec3 color;
+// XYZ offset - uniform scale of the instance
+layout(location = 2) in vec4 instance;
 layout(set = 0, binding = 0) uniform uniform_buffer {
 	mat4 m_matrix;
+	vec4 texture_parameters;
 };
 
 layout(location = 2) out VS_OUT {
 	vec3 color;
+	vec2 uv;
 } vs_out;
 
 void main() {
 	vs_out.color = color;
-	gl_Position = m_matrix*vec4(position,1.0f);
+	// the vertices carry no texture coordinates, the texture is mapped planarly from the mesh XY
+	vs_out.uv = position.xy*2.5f+0.5f;
+	gl_Position = m_matrix*vec4(position*instance.w+instance.xyz,1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,14 @@
+#version 450
+layout(location = 0) in VS_OUT {
+	vec2 uv;
+	vec4 color;
+} fs_in;
+
+// glyph coverage, panels and graphs sample a texel that is always set
+layout(set = 0, binding = 0) uniform sampler2D glyph_atlas;
+
+layout (location = 0) out vec4 color;
+
+void main() {
+	color = vec4(fs_in.color.rgb,fs_in.color.a*texture(glyph_atlas, fs_in.uv).r);
+}
\ No newline at end of file
@@ -0,0 +1,16 @@
+#version 450
+layout(location = 0) in vec2 position;
+layout(location = 1) in vec2 uv;
+layout(location = 2) in vec4 color;
+
+layout(location = 0) out VS_OUT {
+	vec2 uv;
+	vec4 color;
+} vs_out;
+
+void main() {
+	vs_out.uv = uv;
+	vs_out.color = color;
+	// the HUD writes its vertices in normalized device coordinates
+	gl_Position = vec4(position,0.0f,1.0f);
+}
\ No newline at end of file
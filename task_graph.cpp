@@ -0,0 +1,121 @@
+#include "task_graph.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+TaskGraph::Task TaskGraph::add(const char* name, std::function<void()> function, const std::vector<Task>& dependencies, bool is_main_thread) {
+    Task task = static_cast<Task>(steps.size());
+    steps.push_back({ name, std::move(function), dependencies, {}, 0, is_main_thread });
+    for (Task dependency : dependencies) {
+        steps[dependency].dependents.push_back(task);
+    }
+    return task;
+}
+
+void TaskGraph::execute(Task task, uint32_t thread) {
+    Step& step = steps[task];
+    step.thread = thread;
+    step.begin_ns = trace::now();
+    {
+        trace::Scope scope(step.name);
+        step.function();
+    }
+    step.end_ns = trace::now();
+}
+
+// without workers every step runs on the calling thread, one at a time in dependency order
+void TaskGraph::run(uint32_t worker_count) {
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<Task> main_ready;
+    std::deque<Task> any_ready;
+    size_t completed = 0;
+    uint32_t running = 0;
+
+    for (Task task = 0; task < steps.size(); task++) {
+        steps[task].remaining_dependencies = static_cast<uint32_t>(steps[task].dependencies.size());
+        if (steps[task].remaining_dependencies == 0) { (steps[task].is_main_thread ? main_ready : any_ready).push_back(task); }
+    }
+    begin_ns = trace::now();
+
+    auto is_finished = [&] { return completed == steps.size() || (exception && running == 0); };
+    auto work = [&](uint32_t thread, bool is_main_thread) {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            condition.wait(lock, [&] { return is_finished() || (!exception && (!any_ready.empty() || (is_main_thread && !main_ready.empty()))); });
+            if (is_finished()) { return; }
+            std::deque<Task>& ready = is_main_thread && !main_ready.empty() ? main_ready : any_ready;
+            Task task = ready.front();
+            ready.pop_front();
+            running++;
+            lock.unlock();
+
+            std::exception_ptr step_exception;
+            try {
+                execute(task, thread);
+            }
+            catch (...) {
+                step_exception = std::current_exception();
+            }
+
+            lock.lock();
+            running--;
+            completed++;
+            if (step_exception && !exception) { exception = step_exception; }
+            for (Task dependent : steps[task].dependents) {
+                if (--steps[dependent].remaining_dependencies == 0) { (steps[dependent].is_main_thread ? main_ready : any_ready).push_back(dependent); }
+            }
+            condition.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (uint32_t i = 0; i < worker_count; i++) {
+        workers.emplace_back([&work, i] {
+            if (trace::is_enabled()) { trace::set_thread_name("startup worker"); }
+            work(i + 1, false);
+        });
+    }
+    work(0, true);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    end_ns = trace::now();
+    if (exception) { std::rethrow_exception(exception); }
+}
+
+void TaskGraph::report(std::ostream& stream) const {
+    std::vector<Task> order(steps.size());
+    for (Task task = 0; task < steps.size(); task++) {
+        order[task] = task;
+    }
+    std::sort(order.begin(), order.end(), [this](Task a, Task b) { return steps[a].begin_ns < steps[b].begin_ns; });
+
+    stream << "Startup steps (start msec, duration msec, thread):" << std::endl;
+    double steps_msec = 0.0;
+    for (Task task : order) {
+        const Step& step = steps[task];
+        double duration_msec = (step.end_ns - step.begin_ns) / 1e6;
+        steps_msec += duration_msec;
+        stream << "  " << step.name << ": " << (step.begin_ns - begin_ns) / 1e6 << ", " << duration_msec << ", " << step.thread << std::endl;
+    }
+
+    // from the step that finished last, walk back through the dependency each step waited for longest
+    std::vector<Task> critical_path;
+    Task task = order.empty() ? 0 : *std::max_element(order.begin(), order.end(), [this](Task a, Task b) { return steps[a].end_ns < steps[b].end_ns; });
+    while (!steps.empty()) {
+        critical_path.push_back(task);
+        const std::vector<Task>& dependencies = steps[task].dependencies;
+        if (dependencies.empty()) { break; }
+        task = *std::max_element(dependencies.begin(), dependencies.end(), [this](Task a, Task b) { return steps[a].end_ns < steps[b].end_ns; });
+    }
+    stream << "Startup msec: " << get_total_msec() << ", sum of steps: " << steps_msec << " (" << (get_total_msec() > 0.0 ? steps_msec / get_total_msec() : 0.0) << "x), critical path:";
+    for (auto step = critical_path.rbegin(); step != critical_path.rend(); step++) {
+        stream << (step == critical_path.rbegin() ? " " : " -> ") << steps[*step].name;
+    }
+    stream << std::endl;
+}
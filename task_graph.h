@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <vector>
+#include <exception>
+
+// Runs named steps as soon as the steps they depend on are done, on worker threads and on the calling thread,
+// which alone runs the steps marked as main thread (GLFW window creation). Each step is traced and timed;
+// the first exception thrown stops scheduling and is rethrown by run() once the running steps are finished.
+// Names must be string literals or otherwise outlive the graph and the trace.
+class TaskGraph {
+public:
+    typedef uint32_t Task;
+
+    Task add(const char* name, std::function<void()> function, const std::vector<Task>& dependencies = {}, bool is_main_thread = false);
+    void run(uint32_t worker_count);
+    void report(std::ostream& stream) const;
+    double get_total_msec() const { return (end_ns - begin_ns) / 1e6; }
+
+private:
+    struct Step {
+        const char* name;
+        std::function<void()> function;
+        std::vector<Task> dependencies;
+        std::vector<Task> dependents;
+        uint32_t remaining_dependencies;
+        bool is_main_thread;
+        uint64_t begin_ns = 0;
+        uint64_t end_ns = 0;
+        uint32_t thread = 0;
+    };
+
+    void execute(Task task, uint32_t thread);
+
+    std::vector<Step> steps;
+    uint64_t begin_ns = 0;
+    uint64_t end_ns = 0;
+    std::exception_ptr exception;
+};
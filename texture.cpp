@@ -0,0 +1,640 @@
+#include "texture.h"
+#include "vulkan_helper.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+
+namespace {
+    constexpr uint8_t ktx2_identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    constexpr uint32_t ktx2_level_index_offset = 80;
+    constexpr uint32_t dds_header_size = 128;
+    constexpr uint32_t dds_dx10_header_size = 20;
+    constexpr uint32_t dds_pixel_format_rgb = 0x40;
+    // staging offsets satisfy the 4 byte and texel block alignment of vkCmdCopyBufferToImage
+    constexpr VkDeviceSize staging_alignment = 16;
+    constexpr uint32_t checker_size = 256;
+    constexpr uint32_t checker_square_size = 32;
+
+    template<typename T>
+    T read(const std::vector<char>& data, size_t offset) {
+        T value;
+        std::memcpy(&value, data.data() + offset, sizeof(T));
+        return value;
+    }
+
+    uint32_t four_cc(const char* code) {
+        return code[0] | (code[1] << 8) | (code[2] << 16) | (code[3] << 24);
+    }
+
+    VkFormat get_dds_format(uint32_t four_cc_code) {
+        if (four_cc_code == four_cc("DXT1")) { return VK_FORMAT_BC1_RGBA_UNORM_BLOCK; }
+        if (four_cc_code == four_cc("DXT3")) { return VK_FORMAT_BC2_UNORM_BLOCK; }
+        if (four_cc_code == four_cc("DXT5")) { return VK_FORMAT_BC3_UNORM_BLOCK; }
+        if (four_cc_code == four_cc("ATI1") || four_cc_code == four_cc("BC4U")) { return VK_FORMAT_BC4_UNORM_BLOCK; }
+        if (four_cc_code == four_cc("ATI2") || four_cc_code == four_cc("BC5U")) { return VK_FORMAT_BC5_UNORM_BLOCK; }
+        return VK_FORMAT_UNDEFINED;
+    }
+
+    VkFormat get_dxgi_format(uint32_t dxgi_format) {
+        switch (dxgi_format) {
+        case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+        case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+        case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+        case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+        case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+        case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+        case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+        case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+        case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+        case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+        case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+        case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+        default: return VK_FORMAT_UNDEFINED;
+        }
+    }
+}
+
+Texture::Texture(VkPhysicalDevice physical_device, VkDevice device, const VkPhysicalDeviceMemoryProperties& physical_device_memory_properties, MemoryTracker& memory_tracker,
+    const std::string& path, VkDeviceSize memory_budget, VkDeviceSize upload_bytes_per_frame, uint32_t frames_in_flight) :
+    device(device),
+    physical_device_memory_properties(physical_device_memory_properties),
+    memory_tracker(memory_tracker),
+    upload_bytes_per_frame(upload_bytes_per_frame),
+    frames_in_flight(frames_in_flight),
+    source(path.empty() ? "white" : path) {
+    if (path.empty() || path == "checker") {
+        generate_image(source);
+    }
+    else {
+        std::ifstream file(path, std::ios::in | std::ios::binary);
+        if (!file) { throw TEXTURE_FILE_READ_FAILED; }
+        std::vector<char> data(std::filesystem::file_size(path));
+        file.read(data.data(), data.size());
+        std::string extension = std::filesystem::path(path).extension().string();
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](char c) { return static_cast<char>(std::tolower(c)); });
+        if (extension == ".ktx2") { load_ktx2(data); }
+        else if (extension == ".dds") { load_dds(data); }
+        else { throw TEXTURE_FORMAT_UNSUPPORTED; }
+        file_data = std::move(data);
+    }
+
+    // block-compressed formats are only reported as sampled when textureCompressionBC/ASTC_LDR are supported
+    VkFormatProperties format_properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, format_info->format, &format_properties);
+    if (!(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT)) { throw TEXTURE_FORMAT_UNSUPPORTED; }
+
+    // a single stored level gets the rest of the chain blitted on the GPU when the format allows it,
+    // compressed images without mips are sampled from level 0 only
+    VkFormatFeatureFlags blit_features = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    is_mip_generation_needed = file_levels.size() == 1 && std::max(width, height) > 1 && format_info->block_width == 1 &&
+        (format_properties.optimalTilingFeatures & blit_features) == blit_features;
+
+    create_image(memory_budget);
+    create_staging_buffer();
+}
+
+Texture::~Texture() {
+    if (staging_buffer != VK_NULL_HANDLE) {
+        vkDestroyBuffer(device, staging_buffer, nullptr);
+        memory_tracker.free(device, staging_memory);
+    }
+    vkDestroySampler(device, sampler, nullptr);
+    vkDestroyImageView(device, view, nullptr);
+    vkDestroyImage(device, image, nullptr);
+    memory_tracker.free(device, memory);
+}
+
+const Texture::FormatInfo* Texture::find_format(VkFormat format) {
+    static const FormatInfo formats[] = {
+        { VK_FORMAT_R8G8B8A8_UNORM, 1, 1, 4, "RGBA8" },
+        { VK_FORMAT_R8G8B8A8_SRGB, 1, 1, 4, "RGBA8 sRGB" },
+        { VK_FORMAT_BC1_RGB_UNORM_BLOCK, 4, 4, 8, "BC1" },
+        { VK_FORMAT_BC1_RGB_SRGB_BLOCK, 4, 4, 8, "BC1 sRGB" },
+        { VK_FORMAT_BC1_RGBA_UNORM_BLOCK, 4, 4, 8, "BC1" },
+        { VK_FORMAT_BC1_RGBA_SRGB_BLOCK, 4, 4, 8, "BC1 sRGB" },
+        { VK_FORMAT_BC2_UNORM_BLOCK, 4, 4, 16, "BC2" },
+        { VK_FORMAT_BC2_SRGB_BLOCK, 4, 4, 16, "BC2 sRGB" },
+        { VK_FORMAT_BC3_UNORM_BLOCK, 4, 4, 16, "BC3" },
+        { VK_FORMAT_BC3_SRGB_BLOCK, 4, 4, 16, "BC3 sRGB" },
+        { VK_FORMAT_BC4_UNORM_BLOCK, 4, 4, 8, "BC4" },
+        { VK_FORMAT_BC5_UNORM_BLOCK, 4, 4, 16, "BC5" },
+        { VK_FORMAT_BC6H_UFLOAT_BLOCK, 4, 4, 16, "BC6H" },
+        { VK_FORMAT_BC7_UNORM_BLOCK, 4, 4, 16, "BC7" },
+        { VK_FORMAT_BC7_SRGB_BLOCK, 4, 4, 16, "BC7 sRGB" },
+        { VK_FORMAT_ASTC_4x4_UNORM_BLOCK, 4, 4, 16, "ASTC 4x4" },
+        { VK_FORMAT_ASTC_4x4_SRGB_BLOCK, 4, 4, 16, "ASTC 4x4 sRGB" },
+        { VK_FORMAT_ASTC_5x5_UNORM_BLOCK, 5, 5, 16, "ASTC 5x5" },
+        { VK_FORMAT_ASTC_5x5_SRGB_BLOCK, 5, 5, 16, "ASTC 5x5 sRGB" },
+        { VK_FORMAT_ASTC_6x6_UNORM_BLOCK, 6, 6, 16, "ASTC 6x6" },
+        { VK_FORMAT_ASTC_6x6_SRGB_BLOCK, 6, 6, 16, "ASTC 6x6 sRGB" },
+        { VK_FORMAT_ASTC_8x8_UNORM_BLOCK, 8, 8, 16, "ASTC 8x8" },
+        { VK_FORMAT_ASTC_8x8_SRGB_BLOCK, 8, 8, 16, "ASTC 8x8 sRGB" }
+    };
+    for (const FormatInfo& info : formats) {
+        if (info.format == format) { return &info; }
+    }
+    throw TEXTURE_FORMAT_UNSUPPORTED;
+}
+
+// level is counted from the full size image, whatever the budget dropped
+VkExtent2D Texture::get_level_extent(uint32_t level) const {
+    return { std::max(1u, width >> level), std::max(1u, height >> level) };
+}
+
+// levels of a complete chain down to 1x1, a file cannot hold more
+uint32_t Texture::get_full_level_count() const {
+    uint32_t full_level_count = 1;
+    while ((std::max(width, height) >> full_level_count) > 0) { full_level_count++; }
+    return full_level_count;
+}
+
+VkDeviceSize Texture::get_level_size(uint32_t level, const FormatInfo& info) const {
+    VkExtent2D extent = get_level_extent(level);
+    VkDeviceSize blocks_x = (extent.width + info.block_width - 1) / info.block_width;
+    VkDeviceSize blocks_y = (extent.height + info.block_height - 1) / info.block_height;
+    return blocks_x * blocks_y * info.block_bytes;
+}
+
+void Texture::load_ktx2(const std::vector<char>& data) {
+    if (data.size() < ktx2_level_index_offset || std::memcmp(data.data(), ktx2_identifier, sizeof(ktx2_identifier))) { throw TEXTURE_FILE_READ_FAILED; }
+    format_info = find_format(static_cast<VkFormat>(read<uint32_t>(data, 12)));
+    width = read<uint32_t>(data, 20);
+    height = read<uint32_t>(data, 24);
+    uint32_t depth = read<uint32_t>(data, 28);
+    uint32_t layer_count = read<uint32_t>(data, 32);
+    uint32_t face_count = read<uint32_t>(data, 36);
+    // 0 asks the loader to generate the mips
+    uint32_t level_count = std::max(1u, read<uint32_t>(data, 40));
+    uint32_t supercompression_scheme = read<uint32_t>(data, 44);
+    if (width == 0 || height == 0 || depth > 1 || layer_count > 1 || face_count != 1 || supercompression_scheme != 0) { throw TEXTURE_FORMAT_UNSUPPORTED; }
+    if (level_count > get_full_level_count()) { throw TEXTURE_FILE_READ_FAILED; }
+    if (data.size() < ktx2_level_index_offset + level_count * 3 * sizeof(uint64_t)) { throw TEXTURE_FILE_READ_FAILED; }
+
+    // the level index starts with level 0, even though the data is stored from the smallest level
+    for (uint32_t level = 0; level < level_count; level++) {
+        size_t entry = ktx2_level_index_offset + level * 3 * sizeof(uint64_t);
+        Level file_level = { read<uint64_t>(data, entry), read<uint64_t>(data, entry + sizeof(uint64_t)) };
+        if (file_level.size != get_level_size(level, *format_info) || file_level.offset + file_level.size > data.size()) { throw TEXTURE_FILE_READ_FAILED; }
+        file_levels.push_back(file_level);
+    }
+}
+
+void Texture::load_dds(const std::vector<char>& data) {
+    if (data.size() < dds_header_size || read<uint32_t>(data, 0) != four_cc("DDS ")) { throw TEXTURE_FILE_READ_FAILED; }
+    height = read<uint32_t>(data, 12);
+    width = read<uint32_t>(data, 16);
+    uint32_t level_count = std::max(1u, read<uint32_t>(data, 28));
+    uint32_t pixel_format_flags = read<uint32_t>(data, 80);
+    uint32_t four_cc_code = read<uint32_t>(data, 84);
+
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkDeviceSize offset = dds_header_size;
+    if (four_cc_code == four_cc("DX10")) {
+        if (data.size() < dds_header_size + dds_dx10_header_size) { throw TEXTURE_FILE_READ_FAILED; }
+        format = get_dxgi_format(read<uint32_t>(data, dds_header_size));
+        offset += dds_dx10_header_size;
+    }
+    else if ((pixel_format_flags & dds_pixel_format_rgb) && read<uint32_t>(data, 88) == 32 &&
+        read<uint32_t>(data, 92) == 0x000000ff && read<uint32_t>(data, 96) == 0x0000ff00 && read<uint32_t>(data, 100) == 0x00ff0000) {
+        format = VK_FORMAT_R8G8B8A8_UNORM;
+    }
+    else {
+        format = get_dds_format(four_cc_code);
+    }
+    format_info = find_format(format);
+    if (width == 0 || height == 0) { throw TEXTURE_FORMAT_UNSUPPORTED; }
+    if (level_count > get_full_level_count()) { throw TEXTURE_FILE_READ_FAILED; }
+
+    // levels follow each other from the largest
+    for (uint32_t level = 0; level < level_count; level++) {
+        Level file_level = { offset, get_level_size(level, *format_info) };
+        if (file_level.offset + file_level.size > data.size()) { throw TEXTURE_FILE_READ_FAILED; }
+        file_levels.push_back(file_level);
+        offset += file_level.size;
+    }
+}
+
+void Texture::generate_image(const std::string& name) {
+    format_info = find_format(VK_FORMAT_R8G8B8A8_UNORM);
+    width = name == "checker" ? checker_size : 1;
+    height = width;
+    file_data.assign(static_cast<size_t>(width) * height * 4, static_cast<char>(0xff));
+    for (uint32_t y = 0; y < height; y++) {
+        for (uint32_t x = 0; x < width; x++) {
+            if (((x / checker_square_size) + (y / checker_square_size)) % 2) {
+                std::memset(&file_data[(static_cast<size_t>(y) * width + x) * 4], 0x60, 3);
+            }
+        }
+    }
+    file_levels.push_back({ 0, file_data.size() });
+}
+
+// without sparse residency the budget is met by leaving out the finest levels altogether. A single level that
+// is to be mipmapped on the GPU is box filtered on the CPU instead, until the chain generated from it fits
+void Texture::create_image(VkDeviceSize memory_budget) {
+    uint32_t full_level_count = static_cast<uint32_t>(file_levels.size());
+    if (is_mip_generation_needed) {
+        full_level_count = get_full_level_count();
+    }
+    auto get_chain_size = [this, full_level_count](uint32_t first) {
+        VkDeviceSize size = 0;
+        for (uint32_t level = first; level < full_level_count; level++) {
+            size += get_level_size(level, *format_info);
+        }
+        return size;
+    };
+    full_chain_size = get_chain_size(0);
+    while (first_level + 1 < full_level_count && get_chain_size(first_level) > memory_budget) {
+        first_level++;
+    }
+    level_count = full_level_count - first_level;
+    if (is_mip_generation_needed && first_level > 0) {
+        std::vector<char> level_data = std::vector<char>(file_data.begin() + file_levels[0].offset, file_data.begin() + file_levels[0].offset + file_levels[0].size);
+        for (uint32_t level = 1; level <= first_level; level++) {
+            VkExtent2D source_extent = get_level_extent(level - 1);
+            VkExtent2D extent = get_level_extent(level);
+            std::vector<char> reduced(get_level_size(level, *format_info));
+            for (uint32_t y = 0; y < extent.height; y++) {
+                for (uint32_t x = 0; x < extent.width; x++) {
+                    for (uint32_t channel = 0; channel < 4; channel++) {
+                        uint32_t sum = 0;
+                        for (uint32_t sample = 0; sample < 4; sample++) {
+                            uint32_t source_x = std::min(x * 2 + sample % 2, source_extent.width - 1);
+                            uint32_t source_y = std::min(y * 2 + sample / 2, source_extent.height - 1);
+                            sum += static_cast<uint8_t>(level_data[(static_cast<size_t>(source_y) * source_extent.width + source_x) * 4 + channel]);
+                        }
+                        reduced[(static_cast<size_t>(y) * extent.width + x) * 4 + channel] = static_cast<char>(sum / 4);
+                    }
+                }
+            }
+            level_data = std::move(reduced);
+        }
+        file_data = std::move(level_data);
+        file_levels.assign(first_level + 1, { 0, 0 });
+        file_levels[first_level] = { 0, file_data.size() };
+    }
+    finest_resident_level = level_count;
+
+    VkExtent2D extent = get_level_extent(first_level);
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    if (is_mip_generation_needed) { usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT; }
+    VkImageCreateInfo image_create_info = {
+        VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
+        nullptr,
+        0,
+        VK_IMAGE_TYPE_2D,
+        format_info->format,
+        { extent.width, extent.height, 1 },
+        level_count,
+        1,
+        VK_SAMPLE_COUNT_1_BIT,
+        VK_IMAGE_TILING_OPTIMAL,
+        usage,
+        VK_SHARING_MODE_EXCLUSIVE,
+        0,
+        nullptr,
+        VK_IMAGE_LAYOUT_UNDEFINED
+    };
+    if (vkCreateImage(device, &image_create_info, nullptr, &image) != VK_SUCCESS) { throw TEXTURE_IMAGE_CREATION_FAILED; }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetImageMemoryRequirements(device, image, &memory_requirements);
+    VkMemoryAllocateInfo memory_allocate_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        nullptr,
+        memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+    };
+    resident_size = get_chain_size(first_level);
+    if (memory_tracker.allocate(device, memory_allocate_info, resident_size, "textures", &memory) != VK_SUCCESS) { throw TEXTURE_MEMORY_ALLOCATION_FAILED; }
+    vkBindImageMemory(device, image, memory, 0);
+
+    VkImageViewCreateInfo image_view_create_info = {
+        VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        nullptr,
+        0,
+        image,
+        VK_IMAGE_VIEW_TYPE_2D,
+        format_info->format,
+        { VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY, VK_COMPONENT_SWIZZLE_IDENTITY },
+        { VK_IMAGE_ASPECT_COLOR_BIT, 0, level_count, 0, 1 }
+    };
+    if (vkCreateImageView(device, &image_view_create_info, nullptr, &view) != VK_SUCCESS) { throw TEXTURE_IMAGE_CREATION_FAILED; }
+
+    VkSamplerCreateInfo sampler_create_info = {
+        VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
+        nullptr,
+        0,
+        VK_FILTER_LINEAR,
+        VK_FILTER_LINEAR,
+        VK_SAMPLER_MIPMAP_MODE_LINEAR,
+        VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        VK_SAMPLER_ADDRESS_MODE_REPEAT,
+        0.0f,
+        VK_FALSE,
+        1.0f,
+        VK_FALSE,
+        VK_COMPARE_OP_ALWAYS,
+        0.0f,
+        VK_LOD_CLAMP_NONE,
+        VK_BORDER_COLOR_FLOAT_OPAQUE_BLACK,
+        VK_FALSE
+    };
+    vkCreateSampler(device, &sampler_create_info, nullptr, &sampler);
+}
+
+// every resident level is copied once into a host-visible buffer, which is freed when streaming is over
+void Texture::create_staging_buffer() {
+    uint32_t staged_levels = is_mip_generation_needed ? 1 : level_count;
+    VkDeviceSize staging_size = 0;
+    for (uint32_t level = 0; level < staged_levels; level++) {
+        staging_offsets.push_back(staging_size);
+        staging_size += (file_levels[first_level + level].size + staging_alignment - 1) / staging_alignment * staging_alignment;
+    }
+
+    VkBufferCreateInfo buffer_create_info = {
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        nullptr,
+        0,
+        staging_size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        0,
+        nullptr
+    };
+    if (vkCreateBuffer(device, &buffer_create_info, nullptr, &staging_buffer) != VK_SUCCESS) { throw TEXTURE_IMAGE_CREATION_FAILED; }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, staging_buffer, &memory_requirements);
+    VkMemoryAllocateInfo memory_allocate_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        nullptr,
+        memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    };
+    if (memory_tracker.allocate(device, memory_allocate_info, staging_size, "texture_staging", &staging_memory) != VK_SUCCESS) { throw TEXTURE_MEMORY_ALLOCATION_FAILED; }
+    vkBindBufferMemory(device, staging_buffer, staging_memory, 0);
+
+    void* staging_data_pointer;
+    vkMapMemory(device, staging_memory, 0, VK_WHOLE_SIZE, 0, &staging_data_pointer);
+    for (uint32_t level = 0; level < staged_levels; level++) {
+        const Level& file_level = file_levels[first_level + level];
+        std::memcpy(static_cast<char*>(staging_data_pointer) + staging_offsets[level], file_data.data() + file_level.offset, file_level.size);
+    }
+    VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, staging_memory, 0, VK_WHOLE_SIZE };
+    vkFlushMappedMemoryRanges(device, 1, &mapped_memory_range);
+    vkUnmapMemory(device, staging_memory);
+    file_data.clear();
+    file_data.shrink_to_fit();
+}
+
+VkBufferImageCopy Texture::get_level_copy(uint32_t level) const {
+    VkExtent2D extent = get_level_extent(first_level + level);
+    return {
+        staging_offsets[level],
+        0,
+        0,
+        { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 },
+        { 0, 0, 0 },
+        { extent.width, extent.height, 1 }
+    };
+}
+
+// level 0 is copied and every level is blitted from the previous one, all in the first frame
+void Texture::record_mip_generation(VkCommandBuffer command_buffer) {
+    VkImageMemoryBarrier image_memory_barrier = {
+        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        nullptr,
+        0,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        image,
+        { VK_IMAGE_ASPECT_COLOR_BIT, 0, level_count, 0, 1 }
+    };
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+    VkBufferImageCopy buffer_image_copy = get_level_copy(0);
+    vkCmdCopyBufferToImage(command_buffer, staging_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_image_copy);
+
+    image_memory_barrier.subresourceRange.levelCount = 1;
+    for (uint32_t level = 1; level < level_count; level++) {
+        image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        image_memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        image_memory_barrier.subresourceRange.baseMipLevel = level - 1;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+
+        VkExtent2D source_extent = get_level_extent(first_level + level - 1);
+        VkExtent2D extent = get_level_extent(first_level + level);
+        VkImageBlit image_blit = {
+            { VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1 },
+            { { 0, 0, 0 }, { static_cast<int32_t>(source_extent.width), static_cast<int32_t>(source_extent.height), 1 } },
+            { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 },
+            { { 0, 0, 0 }, { static_cast<int32_t>(extent.width), static_cast<int32_t>(extent.height), 1 } }
+        };
+        vkCmdBlitImage(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &image_blit, VK_FILTER_LINEAR);
+
+        image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+    }
+    image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    image_memory_barrier.subresourceRange.baseMipLevel = level_count - 1;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+    finest_resident_level = 0;
+}
+
+// uploads levels from the coarsest while they fit in the per frame byte budget, at least one per frame.
+// Levels that are not resident yet are never sampled because the shader clamps the LOD to get_min_lod(),
+// so frames in flight keep sampling the coarser levels while the finer ones are written
+void Texture::record_streaming(VkCommandBuffer command_buffer) {
+    if (finest_resident_level == 0) {
+        if (staging_buffer != VK_NULL_HANDLE && ++frames_since_last_upload >= frames_in_flight) {
+            vkDestroyBuffer(device, staging_buffer, nullptr);
+            memory_tracker.free(device, staging_memory);
+            staging_buffer = VK_NULL_HANDLE;
+        }
+        return;
+    }
+    streaming_frames++;
+    frames_since_last_upload = 0;
+    if (is_mip_generation_needed) {
+        record_mip_generation(command_buffer);
+        return;
+    }
+
+    std::vector<VkImageMemoryBarrier> image_memory_barriers;
+    VkImageMemoryBarrier image_memory_barrier = {
+        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        nullptr,
+        0,
+        VK_ACCESS_SHADER_READ_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        image,
+        { VK_IMAGE_ASPECT_COLOR_BIT, 0, level_count, 0, 1 }
+    };
+    // the descriptor covers every level, so they all need a valid layout before the first draw
+    if (finest_resident_level == level_count) {
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+    }
+
+    std::vector<VkBufferImageCopy> buffer_image_copies;
+    VkDeviceSize uploaded_bytes = 0;
+    uint32_t level = finest_resident_level;
+    while (level > 0 && (buffer_image_copies.empty() || uploaded_bytes + file_levels[first_level + level - 1].size <= upload_bytes_per_frame)) {
+        level--;
+        uploaded_bytes += file_levels[first_level + level].size;
+        buffer_image_copies.push_back(get_level_copy(level));
+    }
+    image_memory_barrier.srcAccessMask = 0;
+    image_memory_barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    image_memory_barrier.subresourceRange.baseMipLevel = level;
+    image_memory_barrier.subresourceRange.levelCount = finest_resident_level - level;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+
+    vkCmdCopyBufferToImage(command_buffer, staging_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(buffer_image_copies.size()), buffer_image_copies.data());
+
+    image_memory_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+    finest_resident_level = level;
+}
+
+std::vector<std::vector<char>> Texture::read_levels(VkCommandPool command_pool, VkQueue queue) {
+    std::vector<VkBufferImageCopy> buffer_image_copies;
+    VkDeviceSize readback_size = 0;
+    for (uint32_t level = 0; level < level_count; level++) {
+        VkExtent2D extent = get_level_extent(first_level + level);
+        buffer_image_copies.push_back({ readback_size, 0, 0, { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 }, { 0, 0, 0 }, { extent.width, extent.height, 1 } });
+        readback_size += (get_level_size(first_level + level, *format_info) + staging_alignment - 1) / staging_alignment * staging_alignment;
+    }
+
+    VkBufferCreateInfo buffer_create_info = {
+        VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        nullptr,
+        0,
+        readback_size,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_SHARING_MODE_EXCLUSIVE,
+        0,
+        nullptr
+    };
+    VkBuffer readback_buffer;
+    if (vkCreateBuffer(device, &buffer_create_info, nullptr, &readback_buffer) != VK_SUCCESS) { throw TEXTURE_IMAGE_CREATION_FAILED; }
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, readback_buffer, &memory_requirements);
+    VkMemoryAllocateInfo memory_allocate_info = {
+        VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        nullptr,
+        memory_requirements.size,
+        vulkan_helper::select_memory_index(physical_device_memory_properties, memory_requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+    };
+    VkDeviceMemory readback_memory;
+    if (memory_tracker.allocate(device, memory_allocate_info, readback_size, "texture_staging", &readback_memory) != VK_SUCCESS) { throw TEXTURE_MEMORY_ALLOCATION_FAILED; }
+    vkBindBufferMemory(device, readback_buffer, readback_memory, 0);
+
+    VkCommandBufferAllocateInfo command_buffer_allocate_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr, command_pool, VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1 };
+    VkCommandBuffer command_buffer;
+    vkAllocateCommandBuffers(device, &command_buffer_allocate_info, &command_buffer);
+    VkCommandBufferBeginInfo command_buffer_begin_info = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,nullptr, VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,nullptr };
+    vkBeginCommandBuffer(command_buffer, &command_buffer_begin_info);
+    VkImageMemoryBarrier image_memory_barrier = {
+        VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        nullptr,
+        0,
+        VK_ACCESS_TRANSFER_READ_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        image,
+        { VK_IMAGE_ASPECT_COLOR_BIT, 0, level_count, 0, 1 }
+    };
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+    vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback_buffer, static_cast<uint32_t>(buffer_image_copies.size()), buffer_image_copies.data());
+    image_memory_barrier.srcAccessMask = 0;
+    image_memory_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    image_memory_barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    image_memory_barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &image_memory_barrier);
+    VkBufferMemoryBarrier buffer_memory_barrier = {
+        VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        nullptr,
+        VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_ACCESS_HOST_READ_BIT,
+        VK_QUEUE_FAMILY_IGNORED,
+        VK_QUEUE_FAMILY_IGNORED,
+        readback_buffer,
+        0,
+        VK_WHOLE_SIZE
+    };
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &buffer_memory_barrier, 0, nullptr);
+    vkEndCommandBuffer(command_buffer);
+
+    VkFenceCreateInfo fence_create_info = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,nullptr,0 };
+    VkFence fence;
+    vkCreateFence(device, &fence_create_info, nullptr, &fence);
+    VkSubmitInfo submit_info = {
+        VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        nullptr,
+        0,
+        nullptr,
+        nullptr,
+        1,
+        &command_buffer,
+        0,
+        nullptr
+    };
+    vkQueueSubmit(queue, 1, &submit_info, fence);
+    vkWaitForFences(device, 1, &fence, VK_TRUE, UINT64_MAX);
+    vkDestroyFence(device, fence, nullptr);
+    vkFreeCommandBuffers(device, command_pool, 1, &command_buffer);
+
+    void* readback_data_pointer;
+    vkMapMemory(device, readback_memory, 0, VK_WHOLE_SIZE, 0, &readback_data_pointer);
+    VkMappedMemoryRange mapped_memory_range = { VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, nullptr, readback_memory, 0, VK_WHOLE_SIZE };
+    vkInvalidateMappedMemoryRanges(device, 1, &mapped_memory_range);
+    std::vector<std::vector<char>> levels;
+    for (uint32_t level = 0; level < level_count; level++) {
+        const char* level_data = static_cast<const char*>(readback_data_pointer) + buffer_image_copies[level].bufferOffset;
+        levels.emplace_back(level_data, level_data + get_level_size(first_level + level, *format_info));
+    }
+    vkUnmapMemory(device, readback_memory);
+    vkDestroyBuffer(device, readback_buffer, nullptr);
+    memory_tracker.free(device, readback_memory);
+    return levels;
+}
+
+void Texture::report(std::ostream& stream) const {
+    const FormatInfo& rgba8 = *find_format(VK_FORMAT_R8G8B8A8_UNORM);
+    VkDeviceSize rgba8_size = 0;
+    for (uint32_t level = first_level; level < first_level + level_count; level++) {
+        rgba8_size += get_level_size(level, rgba8);
+    }
+    VkExtent2D extent = get_level_extent(first_level);
+    stream << "Texture: " << source << ", " << format_info->name << " (" << format_info->block_bytes * 8.0 / (format_info->block_width * format_info->block_height) << " bits per texel), "
+        << extent.width << "x" << extent.height << " with " << level_count << " levels" << (is_mip_generation_needed ? " (mips blitted on the GPU)" : "") << std::endl;
+    stream << "  resident: " << resident_size / 1024.0 << " KiB, as RGBA8: " << rgba8_size / 1024.0 << " KiB (" << 100.0 * (1.0 - static_cast<double>(resident_size) / rgba8_size) << "% saved), full chain: "
+        << full_chain_size / 1024.0 << " KiB, finest levels dropped by the budget: " << first_level << ", streamed in " << streaming_frames << " frames"
+        << (finest_resident_level > 0 ? " (still streaming)" : "") << std::endl;
+}
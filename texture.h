@@ -0,0 +1,98 @@
+#pragma once
+#include "volk.h"
+#include "memory_tracker.h"
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Sampled 2D texture loaded from KTX2 or DDS (RGBA8, BC1-7, ASTC LDR) or generated as a 1x1 white or a checker image.
+// Only the coarsest levels that fit the memory budget are given device memory; they are streamed in from the
+// coarsest to the finest, a few per frame, and get_min_lod() tells the shader which levels are resident so far.
+// Uncompressed images stored without mips get their chain from vkCmdBlitImage in the first record_streaming().
+class Texture {
+public:
+    Texture(VkPhysicalDevice physical_device, VkDevice device, const VkPhysicalDeviceMemoryProperties& physical_device_memory_properties, MemoryTracker& memory_tracker,
+        const std::string& path, VkDeviceSize memory_budget, VkDeviceSize upload_bytes_per_frame, uint32_t frames_in_flight);
+    ~Texture();
+
+    void record_streaming(VkCommandBuffer command_buffer);
+    VkImageView get_view() const { return view; }
+    VkSampler get_sampler() const { return sampler; }
+    VkFormat get_format() const { return format_info->format; }
+    VkExtent2D get_extent() const { return get_level_extent(first_level); }
+    bool is_streaming() const { return finest_resident_level > 0; }
+    float get_min_lod() const { return static_cast<float>(std::min(finest_resident_level, level_count - 1)); }
+    void report(std::ostream& stream) const;
+    // copies the resident levels back to the host, waiting for the queue; only once streaming is over
+    std::vector<std::vector<char>> read_levels(VkCommandPool command_pool, VkQueue queue);
+
+    typedef enum Errors {
+        TEXTURE_FILE_READ_FAILED = -1,
+        TEXTURE_FORMAT_UNSUPPORTED = -2,
+        TEXTURE_IMAGE_CREATION_FAILED = -3,
+        TEXTURE_MEMORY_ALLOCATION_FAILED = -4
+    } Errors;
+
+private:
+    struct FormatInfo {
+        VkFormat format;
+        uint32_t block_width;
+        uint32_t block_height;
+        uint32_t block_bytes;
+        const char* name;
+    };
+
+    // offsets are into file_data, level 0 is the full size image
+    struct Level {
+        VkDeviceSize offset;
+        VkDeviceSize size;
+    };
+
+    static const FormatInfo* find_format(VkFormat format);
+    VkExtent2D get_level_extent(uint32_t level) const;
+    uint32_t get_full_level_count() const;
+    VkDeviceSize get_level_size(uint32_t level, const FormatInfo& info) const;
+    VkBufferImageCopy get_level_copy(uint32_t level) const;
+    void load_ktx2(const std::vector<char>& data);
+    void load_dds(const std::vector<char>& data);
+    void generate_image(const std::string& name);
+    void create_image(VkDeviceSize memory_budget);
+    void create_staging_buffer();
+    void record_mip_generation(VkCommandBuffer command_buffer);
+    void record_level_upload(VkCommandBuffer command_buffer, uint32_t level);
+
+    VkDevice device;
+    VkPhysicalDeviceMemoryProperties physical_device_memory_properties;
+    MemoryTracker& memory_tracker;
+    VkDeviceSize upload_bytes_per_frame;
+    uint32_t frames_in_flight;
+
+    std::string source;
+    const FormatInfo* format_info;
+    uint32_t width;
+    uint32_t height;
+    std::vector<char> file_data;
+    std::vector<Level> file_levels;
+    bool is_mip_generation_needed = false;
+
+    // image level i holds file level first_level + i
+    uint32_t first_level = 0;
+    uint32_t level_count;
+    VkDeviceSize full_chain_size;
+    VkDeviceSize resident_size;
+    VkImage image;
+    VkDeviceMemory memory;
+    VkImageView view;
+    VkSampler sampler;
+
+    VkBuffer staging_buffer = VK_NULL_HANDLE;
+    VkDeviceMemory staging_memory = VK_NULL_HANDLE;
+    std::vector<VkDeviceSize> staging_offsets;
+
+    // level_count until the first level is uploaded
+    uint32_t finest_resident_level;
+    uint32_t streaming_frames = 0;
+    uint32_t frames_since_last_upload = 0;
+};
@@ -0,0 +1,128 @@
+#include "trace.h"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <fstream>
+#include <algorithm>
+
+namespace {
+    constexpr uint64_t ring_capacity = 1 << 16;
+    constexpr uint32_t gpu_track = 0;
+    // thread ids count up from 1, the async compute queue gets a track far from them
+    constexpr uint32_t gpu_compute_track = 0x7FFFFFFF;
+
+    struct Event {
+        const char* name;
+        uint64_t begin_ns;
+        uint64_t end_ns;
+        uint32_t track;
+    };
+
+    // single producer (the owning thread), read only when exporting
+    struct ThreadBuffer {
+        Event events[ring_capacity];
+        std::atomic<uint64_t> write_index = 0;
+        uint32_t thread_id;
+        std::string thread_name;
+    };
+
+    std::mutex registry_mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> registry;
+    thread_local ThreadBuffer* thread_buffer = nullptr;
+
+    ThreadBuffer* get_thread_buffer() {
+        if (thread_buffer == nullptr) {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            registry.push_back(std::make_unique<ThreadBuffer>());
+            thread_buffer = registry.back().get();
+            thread_buffer->thread_id = static_cast<uint32_t>(registry.size());
+            thread_buffer->thread_name = "thread " + std::to_string(thread_buffer->thread_id);
+        }
+        return thread_buffer;
+    }
+
+    void push(const char* name, uint64_t begin_ns, uint64_t end_ns, uint32_t track) {
+        ThreadBuffer* buffer = get_thread_buffer();
+        uint64_t index = buffer->write_index.load(std::memory_order_relaxed);
+        buffer->events[index & (ring_capacity - 1)] = { name, begin_ns, end_ns, track };
+        buffer->write_index.store(index + 1, std::memory_order_release);
+    }
+
+    void write_escaped(std::ofstream& file, const char* text) {
+        for (; *text; text++) {
+            if (*text == '"' || *text == '\\') { file << '\\'; }
+            file << *text;
+        }
+    }
+}
+
+std::atomic<bool> trace::enabled = false;
+
+void trace::set_enabled(bool is_enabled) {
+    enabled.store(is_enabled, std::memory_order_relaxed);
+}
+
+void trace::set_thread_name(const char* name) {
+    ThreadBuffer* buffer = get_thread_buffer();
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    buffer->thread_name = name;
+}
+
+void trace::record(const char* name, uint64_t begin_ns, uint64_t end_ns) {
+    push(name, begin_ns, end_ns, get_thread_buffer()->thread_id);
+}
+
+void trace::record_gpu(const char* name, uint64_t begin_ns, uint64_t end_ns, bool is_compute_queue) {
+    if (!is_enabled()) { return; }
+    push(name, begin_ns, end_ns, is_compute_queue ? gpu_compute_track : gpu_track);
+}
+
+bool trace::write_chrome_json(const std::string& path) {
+    std::vector<Event> events;
+    std::vector<std::pair<uint32_t, std::string>> thread_names;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        for (auto& buffer : registry) {
+            uint64_t end = buffer->write_index.load(std::memory_order_acquire);
+            uint64_t begin = end > ring_capacity ? end - ring_capacity : 0;
+            size_t first_copied = events.size();
+            for (uint64_t i = begin; i < end; i++) {
+                events.push_back(buffer->events[i & (ring_capacity - 1)]);
+            }
+            // drop the events the owning thread may have overwritten while we were copying
+            uint64_t end_after_copy = buffer->write_index.load(std::memory_order_acquire);
+            uint64_t first_safe = end_after_copy + 1 > ring_capacity ? end_after_copy + 1 - ring_capacity : 0;
+            uint64_t overwritten = first_safe > begin ? std::min(first_safe - begin, end - begin) : 0;
+            events.erase(events.begin() + first_copied, events.begin() + first_copied + overwritten);
+            thread_names.push_back({ buffer->thread_id, buffer->thread_name });
+        }
+    }
+    if (events.empty()) { return false; }
+
+    uint64_t origin = events[0].begin_ns;
+    for (auto& event : events) {
+        origin = std::min(origin, event.begin_ns);
+    }
+
+    std::ofstream file(path, std::ios::out);
+    if (!file) { return false; }
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << gpu_track << ",\"args\":{\"name\":\"GPU queue\"}}";
+    file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << gpu_compute_track << ",\"args\":{\"name\":\"GPU compute queue\"}}";
+    for (auto& thread_name : thread_names) {
+        file << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread_name.first << ",\"args\":{\"name\":\"";
+        write_escaped(file, thread_name.second.c_str());
+        file << "\"}}";
+    }
+    file.precision(3);
+    file << std::fixed;
+    for (auto& event : events) {
+        file << ",\n{\"name\":\"";
+        write_escaped(file, event.name);
+        file << "\",\"cat\":\"" << (event.track == gpu_track || event.track == gpu_compute_track ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track
+            << ",\"ts\":" << (event.begin_ns - origin) / 1000.0 << ",\"dur\":" << (event.end_ns - event.begin_ns) / 1000.0 << "}";
+    }
+    file << "\n]}\n";
+    return true;
+}
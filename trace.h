@@ -0,0 +1,38 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include <chrono>
+
+// Scoped CPU markers and GPU spans exported as Chrome trace JSON (chrome://tracing, ui.perfetto.dev).
+// Each thread writes complete events into its own lock-free ring buffer, so a marker costs two clock
+// reads and one store; when tracing is disabled it costs a single relaxed load.
+// Names must be string literals or otherwise outlive the trace.
+namespace trace {
+    extern std::atomic<bool> enabled;
+
+    inline bool is_enabled() { return enabled.load(std::memory_order_relaxed); }
+    inline uint64_t now() { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count(); }
+
+    void set_enabled(bool is_enabled);
+    void set_thread_name(const char* name);
+    void record(const char* name, uint64_t begin_ns, uint64_t end_ns);
+    void record_gpu(const char* name, uint64_t begin_ns, uint64_t end_ns, bool is_compute_queue = false);
+    bool write_chrome_json(const std::string& path);
+
+    class Scope {
+    public:
+        Scope(const char* name) : name(is_enabled() ? name : nullptr), begin_ns(this->name ? now() : 0) {}
+        ~Scope() { if (name) { record(name, begin_ns, now()); } }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* name;
+        uint64_t begin_ns;
+    };
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SCOPE(name) trace::Scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
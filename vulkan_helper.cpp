@@ -1,4 +1,5 @@
 #include "vulkan_helper.h"
+#include "debug_message_sink.h"
 
 VkPresentModeKHR vulkan_helper::select_presentation_mode(const std::vector<VkPresentModeKHR>& presentation_modes, VkPresentModeKHR desired_presentation_mode) {
     VkPresentModeKHR selected_present_mode;
@@ -90,6 +91,15 @@ VkSurfaceFormatKHR vulkan_helper::select_surface_format(const std::vector<VkSurf
     return selected_surface_format;
 }
 
+bool vulkan_helper::is_extension_supported(const std::vector<VkExtensionProperties>& extensions, const char* extension_name) {
+    for (auto& extension : extensions) {
+        if (strcmp(extension.extensionName, extension_name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
 uint32_t vulkan_helper::select_memory_index(const VkPhysicalDeviceMemoryProperties& physical_device_memory_properties, const VkMemoryRequirements& memory_requirements, VkMemoryPropertyFlagBits memory_properties) {
     for (uint32_t type = 0; type < physical_device_memory_properties.memoryTypeCount; ++type) {
         if ((memory_requirements.memoryTypeBits & (1 << type)) &&
@@ -100,8 +110,12 @@ uint32_t vulkan_helper::select_memory_index(const VkPhysicalDeviceMemoryProperti
     return VK_MAX_MEMORY_TYPES;
 }
 
+// pUserData is an optional DebugMessageSink, without it messages are written synchronously
 VkBool32 vulkan_helper::debug_callback(VkDebugReportFlagsEXT flags, VkDebugReportObjectTypeEXT objType, uint64_t srcObject, size_t location, int32_t msgCode, const char* pLayerPrefix, const char* pMsg, void* pUserData) {
-    if (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT) {
+    if (pUserData != nullptr) {
+        static_cast<DebugMessageSink*>(pUserData)->push(flags, msgCode, pLayerPrefix, pMsg);
+    }
+    else if (flags & VK_DEBUG_REPORT_ERROR_BIT_EXT) {
         std::cerr << "ERROR: [" << pLayerPrefix << "] Code " << msgCode << " : " << pMsg << std::endl;
     }
     else if (flags & VK_DEBUG_REPORT_WARNING_BIT_EXT) {